@@ -3,227 +3,1569 @@
  *
  * Generates a self-description JSON string for any Arduino-compatible board.
  * Zero external dependencies: uses only Wire, SPI, and stdlib.
+ * All fragments, including plugin-provided ones, are emitted through
+ * CepJsonWriter and never allocate; scratch a plugin needs comes from an
+ * optional CepArena (cep.setArena()) and is released after each build.
  *
  * Usage:
  *   #include "cep.h"
  *   CEP cep;
- *   String json = cep.getCapabilitiesJSON();
- *   Serial.println(json);
+ *   cep.writeCapabilities(Serial);          // stream, no document buffer
+ *   String json = cep.getCapabilitiesJSON(); // or collect into a String
+ *
+ *   char buf[768];                           // or a fixed buffer, no heap
+ *   size_t len = cep.serializeTo(buf, sizeof(buf));
+ *   if (len >= sizeof(buf)) { ... buffer too small, need len + 1 ... }
+ *
+ *   uint8_t bin[256];                        // CBOR for ble / lora transports
+ *   size_t n = cep.serializeTo((char*)bin, sizeof(bin), CEP_FORMAT_CBOR);
+ *
+ *   if (cep.isDirty()) { ... re-send ... }   // scan result is cached;
+ *   cep.invalidate();                        // force a rescan after hot-plug
+ *                                            // (or cep_hotplug.h, incremental)
+ *
+ * Fast boot after deep sleep (ESP32):
+ *   RTC_DATA_ATTR CepScanSnapshot snap;      // survives deep sleep
+ *   cep.restoreSnapshot(snap);               // setup(): verify, else full scan
+ *   cep.saveSnapshot(snap);                  // just before esp_deep_sleep_start()
+ *
+ * Heartbeat / delta registration (see server/routes/devices.js):
+ *   cep.writeHeartbeat(client);              // {"id":..,"hash":..} when clean
+ *   if (cep.writeDelta(client) == 0) { ... } // changed elements only, or 0 =
+ *                                            // send the full document
+ *   cep.commitDelta();                       // once the PATCH got a 2xx
+ *
+ * Duty-cycled nodes (cep_scheduler.h):
+ *   sched.run();                             // heartbeat, sampler reads, sample
+ *                                            // flush and hot-plug when due, one
+ *                                            // radio wake, then sleep
+ *
+ * Scan tuning / multi-bus:
+ *   CepScanConfig scan;                      // defaults: Wire, 0x01-0x7E, 100 kHz
+ *   scan.clockHz = 400000;                   // fast mode
+ *   scan.knownOnly = true;                   // probe only plugin addresses
+ *   scan.addBus(Wire1, 25, 26);              // second controller -> bus 1
+ *   scan.addMux(Wire, 21, 22, 0x70);         // TCA9548A channels -> buses 2-9
+ *   cep.setScanConfig(scan);
+ *
+ * SPI / UART enumeration (cep_probes.h):
+ *   cep.addProbe(spiProbe);                  // WHO_AM_I reads on CS pins
+ *   cep.addProbe(gpsProbe);                  // UART autobaud
+ *   Probes run with every scan, on ESP32 each on its own task while the
+ *   I2C scan proceeds.
  *
  * Chipset plugins:
- *   Include chipset headers before or after cep.h, then register:
- *   cep.registerChipset(&bme280Chip);
+ *   Include chipset headers after cep.h, then either resolve the set at
+ *   compile time (flash-resident, no RAM per plugin):
+ *   cep.useChipsets<&BME280_Chip, &SSD1306_Chip>();
+ *   or register at runtime (up to CEP_MAX_CHIPSETS):
+ *   cep.registerChipset(&BME280_Chip);
+ *   Plugins with a sampler (BME280, MPU-6050) can also be read live at a
+ *   fixed rate, see cep_sampling.h. On ESP32, cep_bus_task.h moves scans,
+ *   register transfers and sampling onto a bus task off the main loop.
+ *
+ * Telemetry:
+ *   cep.telemetry().scanUs ...               // counters, always kept
+ *   cep.setTelemetry(300000);                // + {"type":"telemetry"} element,
+ *                                            // refreshed every 5 min
+ *
+ * On-device inference (cep_inference.h):
+ *   cep.setInference(&model.info());         // advertised under compute
+ *
+ * Build cost (time per phase, heap churn, payload size) is measured by the
+ * cep_benchmark/ sketch, or on a PC against the host/ Arduino core.
  *
  * On ESP32 you get: MAC-based device ID, CPU freq, heap, flash, WiFi, I2C scan.
  * On plain Arduino you get: compile-time board model, I2C scan.
+ *
+ * Every static fragment (keys, literal values, pin lists, plugin names and
+ * provides lists) is stored in flash and streamed from there, so SRAM use is
+ * the CEP object plus a few bytes of writer state. Check per board with
+ *   arduino-cli compile --fqbn <board> ...   ("Global variables use N bytes")
  */
 
 #pragma once
 
 #include <Arduino.h>
 #include <Wire.h>
+#include "cep_json.h"
+
+#ifdef ESP32
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#endif
+
+#define CEP_STR_(x) #x
+#define CEP_STR(x)  CEP_STR_(x)
 
 // ── Chipset plugin interface ───────────────────────────────────────────────────
 
+struct CepSamplerOps;   // live readings, see cep_sampling.h
+
+// Plain aggregate (no vtable), so descriptors can be constexpr and live in
+// flash. The descriptor and everything it points to (name, address list,
+// provides strings and array) must be PROGMEM; CEP reads them with
+// pgm_read_*/memcpy_P. See chipsets/bme280_chip.h:
+//   static constexpr CepChipsetDescriptor FOO_Chip PROGMEM =
+//       { _foo_name, _foo_addrs, _foo_provides, CEP_BUS_I2C, nullptr, nullptr, 0 };
 struct CepChipsetDescriptor {
-    const char* name;
-    const uint8_t* i2cAddresses;   // zero-terminated list
-    const char** provides;          // null-terminated list of capability strings
-    const char* bus;                // "i2c" | "spi"
-
-    // Optional: override to produce custom JSON fragment.
-    // Return empty String to use default sensor JSON.
-    virtual String describe(int busId, uint8_t address) const { return ""; }
+    const char*        name;
+    const uint8_t*     i2cAddresses;   // zero-terminated list
+    const char* const* provides;       // null-terminated list of capability strings
+    const char*        bus;            // "i2c" | "spi"
+
+    // Optional: write one custom JSON value for a matched device.
+    // nullptr uses the default sensor JSON.
+    void (*describeTo)(CepJsonWriter& w, uint8_t busId, uint8_t address);
+
+    // Optional: how to read the device (PROGMEM, see cep_sampling.h).
+    // nullptr for describe-only plugins.
+    const CepSamplerOps* sampler;
+
+    uint8_t flags;   // CEP_CHIP_* bits
+};
+
+// describeTo() output can change between builds (e.g. it includes a live
+// reading or a mode register), so CEP must not memoize it
+#define CEP_CHIP_DYNAMIC 0x01
+
+// What an on-device inference engine (cep_inference.h) advertises in the
+// compute capability as "inference":{...}. model is PROGMEM.
+struct CepInferenceInfo {
+    const char* model;        // model id; JumpNet routes /infer by bundleId
+    uint32_t    opsPerSec;    // measured int8 ops (2 per MAC), 0 = unknown
+    uint16_t    inputs;
+    uint16_t    outputs;
+    uint16_t    port;         // HTTP port serving POST /infer, 0 = not served
+};
+
+// Shared flash-resident bus names for descriptors
+static constexpr char CEP_BUS_I2C[] PROGMEM = "i2c";
+static constexpr char CEP_BUS_SPI[] PROGMEM = "spi";
+static constexpr char CEP_BUS_UART[] PROGMEM = "uart";
+
+// ── Bus probe interface ───────────────────────────────────────────────────────
+//
+// Buses that cannot be enumerated by address probing (SPI chip selects, UART
+// ports) are scanned by a CepBusProbe; cep_probes.h has SPI WHO_AM_I and
+// UART autobaud probes. A probe keeps its own result and writes its own
+// capability elements from it.
+
+struct CepBusProbe;
+
+// Plain aggregate in flash, like CepSamplerOps
+struct CepProbeOps {
+    // Enumerate the bus, blocking. On ESP32 this runs on a task of its own
+    // while the I2C scan runs, so it may only touch its own bus and state.
+    void (*scan)(CepBusProbe& probe);
+
+    // Write capability element i of the last scan (the bus first, then one
+    // per device found) and return true; false past the last element.
+    bool (*element)(const CepBusProbe& probe, uint8_t i, CepJsonWriter& w);
+};
+
+// Base of every probe: concrete probes derive from it and point ops at
+// their flash-resident table
+struct CepBusProbe {
+    const CepProbeOps* ops;
+};
+
+// ── Compile-time chipset registry ─────────────────────────────────────────────
+//
+//   cep.useChipsets<&BME280_Chip, &SSD1306_Chip, &MPU6050_Chip>();
+//
+// The pointer list and the 128-entry address -> chipset table are computed by
+// the compiler and placed in flash, so the plugin set costs no RAM and has no
+// MAX_CHIPSETS cap (up to 255 plugins, the table's index width). The
+// descriptors must be constexpr. As with registerChipset(), the first plugin
+// listed owns an address that several plugins declare.
+
+constexpr bool cepDeclaresAddress(const uint8_t* a, uint8_t addr) {
+    return *a == 0 ? false : (*a == addr ? true : cepDeclaresAddress(a + 1, addr));
+}
+
+template <const CepChipsetDescriptor*... Chips>
+struct CepAddressOwner;
+
+template <>
+struct CepAddressOwner<> {
+    static constexpr uint8_t of(uint8_t, uint8_t) { return 0; }
+};
+
+template <const CepChipsetDescriptor* Chip, const CepChipsetDescriptor*... Rest>
+struct CepAddressOwner<Chip, Rest...> {
+    // 1-based index of the first chipset declaring addr, 0 if none
+    static constexpr uint8_t of(uint8_t addr, uint8_t idx) {
+        return cepDeclaresAddress(Chip->i2cAddresses, addr)
+                   ? idx
+                   : CepAddressOwner<Rest...>::of(addr, (uint8_t)(idx + 1));
+    }
+};
+
+template <unsigned... I> struct CepIndexSeq {};
+template <unsigned N, unsigned... I> struct CepMakeIndexSeq : CepMakeIndexSeq<N - 1, N - 1, I...> {};
+template <unsigned... I> struct CepMakeIndexSeq<0, I...> { typedef CepIndexSeq<I...> type; };
+
+template <typename Owner, typename Seq> struct CepAddressTable;
+
+template <typename Owner, unsigned... I>
+struct CepAddressTable<Owner, CepIndexSeq<I...> > {
+    static const uint8_t table[128];
+};
+
+template <typename Owner, unsigned... I>
+const uint8_t CepAddressTable<Owner, CepIndexSeq<I...> >::table[128] PROGMEM = {
+    Owner::of((uint8_t)I, 1)...
+};
+
+template <const CepChipsetDescriptor*... Chips>
+struct CepChipsets {
+    static_assert(sizeof...(Chips) > 0,   "CepChipsets needs at least one chipset");
+    static_assert(sizeof...(Chips) < 256, "CepChipsets supports up to 255 chipsets");
+
+    static const uint8_t count = sizeof...(Chips);
+    static const CepChipsetDescriptor* const list[sizeof...(Chips)];
+
+    typedef CepAddressTable<CepAddressOwner<Chips...>, typename CepMakeIndexSeq<128>::type> Table;
+};
+
+template <const CepChipsetDescriptor*... Chips>
+const CepChipsetDescriptor* const CepChipsets<Chips...>::list[sizeof...(Chips)] PROGMEM = { Chips... };
+
+// ── I2C scan configuration ─────────────────────────────────────────────────────
+
+// Buses one scan covers (each mux channel is one). The ESP32 default fits
+// both controllers plus one full TCA9548A.
+#ifndef CEP_MAX_I2C_BUSES
+#  ifdef ESP32
+#    define CEP_MAX_I2C_BUSES 10
+#  else
+#    define CEP_MAX_I2C_BUSES 2
+#  endif
+#endif
+
+// One logical I2C bus: a TwoWire controller, optionally behind one channel of
+// a TCA9548A multiplexer. Each mux channel is listed as its own bus.
+struct CepI2CBus {
+    TwoWire* wire;
+    int8_t   sda;          // reported pin numbers; also passed to begin() on ESP32
+    int8_t   scl;
+    uint8_t  muxAddress;   // TCA9548A address (0x70-0x77), 0 = not muxed
+    uint8_t  muxChannel;   // 0-7 when muxAddress != 0
+};
+
+// Route a muxed bus: mask is the TCA9548A channel bitmap (0 = all off)
+inline void cepSelectMux(const CepI2CBus& bus, uint8_t mask) {
+    bus.wire->beginTransmission(bus.muxAddress);
+    bus.wire->write(mask);
+    bus.wire->endTransmission();
+}
+
+struct CepScanConfig {
+    uint8_t        firstAddress;   // inclusive probe range, within 0x01-0x7F
+    uint8_t        lastAddress;
+    const uint8_t* skip;           // zero-terminated addresses never probed, or nullptr
+    bool           knownOnly;      // probe only addresses declared by registered chipsets
+    uint32_t       clockHz;        // 100000, 400000 (fast mode) or 1000000 (fast mode plus)
+    uint16_t       probeDelayUs;   // settle time between probes; endTransmission() is
+                                   // already synchronous, so 0 is fine for most buses
+    CepI2CBus      buses[CEP_MAX_I2C_BUSES];
+    uint8_t        numBuses;
+
+    // Defaults: full 0x01-0x7E range on the board's primary Wire bus at 100 kHz.
+    CepScanConfig()
+        : firstAddress(0x01), lastAddress(0x7E), skip(nullptr), knownOnly(false),
+          clockHz(100000), probeDelayUs(0), numBuses(0) {
+        addBus(Wire, SDA, SCL);
+    }
+
+    // Drop the default bus, e.g. before describing a custom topology.
+    void clearBuses() { numBuses = 0; }
+
+    // Returns the new bus id, or -1 if CEP_MAX_I2C_BUSES is reached.
+    int addBus(TwoWire& wire, int8_t sda, int8_t scl) {
+        return _add(wire, sda, scl, 0, 0);
+    }
+
+    // One channel of a TCA9548A on an already-added controller.
+    int addMuxChannel(TwoWire& wire, int8_t sda, int8_t scl,
+                      uint8_t muxAddress, uint8_t channel) {
+        return _add(wire, sda, scl, muxAddress, channel);
+    }
+
+    // All eight channels of a TCA9548A. Devices that answer with every channel
+    // off (upstream of the mux) are left out of the channels' results.
+    // Returns the number of channels added, fewer than 8 once
+    // CEP_MAX_I2C_BUSES is reached.
+    uint8_t addMux(TwoWire& wire, int8_t sda, int8_t scl, uint8_t muxAddress = 0x70) {
+        uint8_t added = 0;
+        for (uint8_t ch = 0; ch < 8; ch++) {
+            if (addMuxChannel(wire, sda, scl, muxAddress, ch) < 0) break;
+            added++;
+        }
+        return added;
+    }
+
+private:
+    int _add(TwoWire& wire, int8_t sda, int8_t scl, uint8_t muxAddress, uint8_t channel) {
+        if (numBuses >= CEP_MAX_I2C_BUSES) return -1;
+        CepI2CBus& b = buses[numBuses];
+        b.wire       = &wire;
+        b.sda        = sda;
+        b.scl        = scl;
+        b.muxAddress = muxAddress;
+        b.muxChannel = channel;
+        return numBuses++;
+    }
+};
+
+// ── String sink ───────────────────────────────────────────────────────────────
+
+// Print adapter that appends to an Arduino String. Only used by the
+// getCapabilitiesJSON() convenience wrapper; streaming callers never need it.
+class CepStringPrint : public Print {
+public:
+    explicit CepStringPrint(String& s) : _s(s) {}
+
+    size_t write(uint8_t c) override {
+        _s += (char)c;
+        return 1;
+    }
+
+private:
+    String& _s;
 };
 
 // ── CEP builder ───────────────────────────────────────────────────────────────
 
+// Runtime registerChipset() slots. Firmware that only uses useChipsets<>()
+// can define CEP_MAX_CHIPSETS 0 to drop the RAM table entirely.
+#ifndef CEP_MAX_CHIPSETS
+#define CEP_MAX_CHIPSETS 16
+#endif
+
+// addProbe() slots
+#ifndef CEP_MAX_PROBES
+#ifdef ESP32
+#define CEP_MAX_PROBES 4
+#else
+#define CEP_MAX_PROBES 2
+#endif
+#endif
+
+// Stack of each probe task (ESP32)
+#ifndef CEP_PROBE_STACK
+#define CEP_PROBE_STACK 3072
+#endif
+
+// Capability elements tracked for writeDelta() (4 bytes of RAM each). A
+// document with more elements always falls back to a full send; 0 disables
+// deltas.
+#ifndef CEP_DELTA_SECTIONS
+#ifdef ESP32
+#define CEP_DELTA_SECTIONS 16
+#else
+#define CEP_DELTA_SECTIONS 8
+#endif
+#endif
+
+// Memoized sensor elements: each matched device's element is rendered once
+// per format into this many bytes of RAM and copied on later builds, so
+// documents with many sensors skip re-encoding names, provides lists and
+// plugin output. 0 disables the cache (and its RAM).
+#ifndef CEP_FRAGMENT_CACHE
+#ifdef ESP32
+#define CEP_FRAGMENT_CACHE 1024
+#else
+#define CEP_FRAGMENT_CACHE 0
+#endif
+#endif
+
+// Cached elements at most (8 bytes of RAM each)
+#ifndef CEP_FRAGMENT_SLOTS
+#define CEP_FRAGMENT_SLOTS 16
+#endif
+
+// Everything a woken node needs to skip the full scan (CEP::saveSnapshot()).
+// Plain bytes: keep it in RTC memory across deep sleep or in NVS across power
+// cycles. A snapshot from a different scan configuration, chipset set or
+// build layout is rejected, as is a corrupted one.
+struct CepScanSnapshot {
+    uint32_t magic;
+    uint32_t configHash;                          // scan config + chipset names
+    uint8_t  foundMap[CEP_MAX_I2C_BUSES][16];
+    uint8_t  upstreamMap[CEP_MAX_I2C_BUSES][16];  // mux buses: answers with no channel on
+    uint8_t  numBuses;
+    uint8_t  format;                              // CepFormat of lastHash
+    uint8_t  emitted;
+    uint8_t  numSections;
+    uint32_t lastHash;
+    uint32_t headerHash;
+#if CEP_DELTA_SECTIONS > 0
+    uint32_t sectionHash[CEP_DELTA_SECTIONS];
+#else
+    uint32_t sectionHash[1];
+#endif
+    uint32_t check;                               // FNV-1a of the bytes above
+};
+
+// Always-on counters: CEP keeps the scan and build ones, CepRegistrar the
+// request ones. *Us / *Ms fields are the last run, *Max* the worst since
+// boot, the rest totals since boot. Read them with cep.telemetry(), or
+// publish them as a {"type":"telemetry"} capability (cep.setTelemetry()).
+struct CepTelemetry {
+    uint32_t scans;          // full I2C scans
+    uint32_t scanUs;         // bus probes included
+    uint32_t scanMaxUs;
+    uint32_t i2cProbes;      // addresses probed: scans, snapshot checks, hot-plug
+    uint32_t i2cNacks;       // ... that nothing answered
+    uint32_t builds;         // documents emitted by writeCapabilities()
+    uint32_t buildUs;
+    uint32_t buildMaxUs;
+    uint32_t bytesOut;       // documents and deltas
+    uint32_t heapPeak;       // most heap one build held (ESP32)
+    uint32_t heapMinFree;    // ESP32 low-water mark and largest free block, as of
+    uint32_t heapMaxBlock;   // the last publish
+    uint32_t regOk;          // registrar requests answered
+    uint32_t regFailures;    // no connection, timeouts, 5xx
+    uint32_t regMs;          // round trip of the last answered request
+    uint32_t regMaxMs;
+
+    void probed(bool acked) {
+        i2cProbes++;
+        if (!acked) i2cNacks++;
+    }
+
+    void answered(uint32_t ms) {
+        regOk++;
+        regMs = ms;
+        if (ms > regMaxMs) regMaxMs = ms;
+    }
+
+    static void worst(uint32_t& last, uint32_t& max, uint32_t v) {
+        last = v;
+        if (v > max) max = v;
+    }
+};
+
+// device.transport. A gateway that runs this code on behalf of an attached
+// board (host/ build) reports how that board is reached, e.g. -DCEP_TRANSPORT="usb".
+#ifndef CEP_TRANSPORT
+#define CEP_TRANSPORT "serial"
+#endif
+
 class CEP {
 public:
-    static const int MAX_CHIPSETS = 16;
+    static const int MAX_CHIPSETS = CEP_MAX_CHIPSETS;
 
-    CEP() : _numChipsets(0) {}
+    CEP()
+        : _staticList(nullptr), _staticTable(nullptr), _numStatic(0),
+          _numChipsets(0), _scanValid(false), _emitted(false), _lastHash(0),
+          _lastFormat(CEP_FORMAT_JSON), _headerHash(0), _numSections(0),
+          _deltaStaged(false), _deltaHash(0),
+          _inference(nullptr), _arena(nullptr), _numProbes(0),
+          _telemetryMs(0), _telemetryAt(0) {
+        _memoClear();
+        memset(&_telemetry, 0, sizeof(_telemetry));
+        memset(&_published, 0, sizeof(_published));
+#ifdef ESP32
+        _heapBase = _heapLow = 0;
+#endif
+#if CEP_MAX_CHIPSETS > 0
+        memset(_addrChip, 0, sizeof(_addrChip));
+#endif
+        memset(_foundMap, 0, sizeof(_foundMap));
+        memset(_upstreamMap, 0, sizeof(_upstreamMap));
+    }
 
-    // Register a chipset plugin
+    // Use a compile-time chipset set (see CepChipsets). Consulted before any
+    // plugins added with registerChipset().
+    template <const CepChipsetDescriptor*... Chips>
+    void useChipsets() {
+        typedef CepChipsets<Chips...> Set;
+        _staticList  = Set::list;
+        _staticTable = Set::Table::table;
+        _numStatic   = Set::count;
+        _emitted     = false;   // sensor list may change
+        _memoClear();
+    }
+
+    // Register a chipset plugin at runtime. Each I2C address maps to one
+    // chipset: if two plugins declare the same address, the one registered
+    // first owns it, so register the more specific plugin first.
     void registerChipset(const CepChipsetDescriptor* chip) {
-        if (_numChipsets < MAX_CHIPSETS) {
-            _chipsets[_numChipsets++] = chip;
+#if CEP_MAX_CHIPSETS > 0
+        if (_numChipsets >= MAX_CHIPSETS) return;
+        _chipsets[_numChipsets++] = chip;
+        const uint8_t* a = (const uint8_t*)pgm_read_ptr(&chip->i2cAddresses);
+        for (uint8_t addr; (addr = pgm_read_byte(a)) != 0; a++) {
+            if (addr < 128 && _addrChip[addr] == 0) _addrChip[addr] = (uint8_t)_numChipsets;
         }
+        _emitted = false;   // sensor list may change
+        _memoClear();
+#else
+        (void)chip;
+#endif
     }
 
-    // ── Main entry point ─────────────────────────────────────────────────────
+    // ── Snapshot / dirty tracking ────────────────────────────────────────────
+    //
+    // The I2C scan is the expensive part of a build (126 bus probes), so its
+    // result is kept until invalidate() is called — e.g. after a hot-plug.
+    // Everything else is cheap to re-read and is folded into a content hash
+    // so firmware can skip re-sending a document that has not changed.
 
-    String getCapabilitiesJSON() {
-        String caps = "";
+    // Force a fresh bus scan on the next build.
+    void invalidate() {
+        _scanValid = false;
+    }
+
+    // Replace the scan configuration (address range, clock, buses...).
+    // Takes effect on the next build. The range is clamped to 0x01-0x7F:
+    // 0x00 is the general call address, and I2C addresses have seven bits.
+    void setScanConfig(const CepScanConfig& cfg) {
+        _scan = cfg;
+        if (_scan.firstAddress < 0x01) _scan.firstAddress = 0x01;
+        if (_scan.lastAddress > 0x7F)  _scan.lastAddress  = 0x7F;
+        invalidate();
+        _memoClear();   // bus ids may mean other buses now
+    }
 
-        _appendCompute(caps);
-        caps += ",";
+    const CepScanConfig& scanConfig() const { return _scan; }
 
-        String sensors = "";
-        _appendI2C(caps, sensors);
+    // Advertise an on-device inference engine (nullptr to withdraw). The
+    // info is read at each build, so later changes (e.g. a measured
+    // opsPerSec) show up as a dirty document.
+    void setInference(const CepInferenceInfo* info) {
+        _inference = info;
+    }
+
+    // Scratch arena handed to plugins during builds (CepJsonWriter::arena()),
+    // rewound at the end of every build; nullptr (default) for none.
+    void setArena(CepArena* arena) {
+        _arena = arena;
+    }
 
-        if (sensors.length() > 0) {
-            caps += "," + sensors;
+    CepArena* arena() const { return _arena; }
+
+    // Counters since boot (see CepTelemetry); CepRegistrar and cep_hotplug.h
+    // add to them too.
+    CepTelemetry& telemetry() { return _telemetry; }
+
+    // Publish the counters as a {"type":"telemetry"} capability, refreshed at
+    // most every periodMs (0, the default, leaves it out). The element only
+    // changes when isDirty() finds the period over, so in between documents
+    // and hashes stay stable; with CepRegistrar that is one small delta per
+    // period.
+    void setTelemetry(unsigned long periodMs) {
+        _telemetryMs = periodMs;
+        _publish();
+    }
+
+    // Enumerate a non-I2C bus with every scan, starting with the next one.
+    // The probe must outlive the CEP. Returns false when CEP_MAX_PROBES are
+    // registered.
+    bool addProbe(CepBusProbe& probe) {
+        if (_numProbes >= CEP_MAX_PROBES) return false;
+        _probes[_numProbes++] = &probe;
+        invalidate();
+        return true;
+    }
+
+    // Re-run the bus scan now (also what the next build would do after
+    // invalidate()). Probes run alongside the I2C scan where there is a
+    // scheduler; this returns once all of them are done.
+    void rescan() {
+        const unsigned long start = micros();
+        uint8_t running = _startProbes();
+        _scanI2C();
+        _joinProbes(running);
+        _telemetry.scans++;
+        CepTelemetry::worst(_telemetry.scanUs, _telemetry.scanMaxUs, micros() - start);
+        _scanValid = true;
+        _memoPrune();
+    }
+
+    // FNV-1a hash of the document as it would be emitted now, in the format
+    // of the last build. Uses the cached scan unless it has been invalidated;
+    // nothing is buffered.
+    uint32_t contentHash() {
+        CepHashPrint hasher;
+        _write(hasher, _lastFormat);
+        return hasher.hash();
+    }
+
+    // Hash of the last complete document emitted by any of the build calls.
+    uint32_t lastHash() const { return _lastHash; }
+
+    // True when a rescan is pending or the document differs from the one last
+    // emitted. Reading this never touches the bus unless a rescan is pending.
+    bool isDirty() {
+        if (_telemetryMs && millis() - _telemetryAt >= _telemetryMs) _publish();
+        if (!_scanValid || !_emitted) return true;
+        return contentHash() != _lastHash;
+    }
+
+    // ── Fast boot ────────────────────────────────────────────────────────────
+    //
+    // A node that deep-sleeps between reports would otherwise rescan every
+    // address and resend its whole document on each wake. The snapshot keeps
+    // the scan bitmap and the hashes of the last emitted document, so after
+    // restoreSnapshot() builds need no scan and isDirty() / writeHeartbeat()
+    // / writeDelta() carry on from before the sleep.
+
+    // Capture the current scan and emitted-document state. Returns false (and
+    // leaves s invalid) when there is no scan to save.
+    bool saveSnapshot(CepScanSnapshot& s) {
+        memset(&s, 0, sizeof(s));
+        if (!_scanValid) return false;
+        s.magic       = _snapshotMagic();
+        s.configHash  = _configHash();
+        memcpy(s.foundMap, _foundMap, sizeof(s.foundMap));
+        memcpy(s.upstreamMap, _upstreamMap, sizeof(s.upstreamMap));
+        s.numBuses    = _scan.numBuses;
+        s.format      = (uint8_t)_lastFormat;
+        s.emitted     = _emitted;
+        s.numSections = _numSections;
+        s.lastHash    = _lastHash;
+        s.headerHash  = _headerHash;
+        memcpy(s.sectionHash, _sectionHash, sizeof(s.sectionHash));
+        s.check       = _snapshotCheck(s);
+        return true;
+    }
+
+    // Adopt a snapshot after a quick verification: only addresses that
+    // answered before and addresses a chipset declares are probed (a few per
+    // bus instead of the whole range). Returns true if everything still
+    // answers as before; otherwise, or for a stale or corrupt snapshot,
+    // returns false and the next build does a full scan. A new device at an
+    // address no plugin declares goes unnoticed until the next full scan.
+    bool restoreSnapshot(const CepScanSnapshot& s) {
+        if (s.magic != _snapshotMagic() || s.check != _snapshotCheck(s) ||
+            s.numBuses != _scan.numBuses || s.configHash != _configHash()) {
+            return false;
+        }
+
+        // Probe results are not kept: the probes run again, concurrently
+        uint8_t running = _startProbes();
+        bool    same    = _verifySnapshot(s);
+        _joinProbes(running);
+        if (!same) return false;
+
+        memcpy(_foundMap, s.foundMap, sizeof(_foundMap));
+        memcpy(_upstreamMap, s.upstreamMap, sizeof(_upstreamMap));
+        _scanValid   = true;
+        _memoPrune();
+        _lastFormat  = (CepFormat)s.format;
+        _emitted     = s.emitted;
+        _numSections = s.numSections;
+        _lastHash    = s.lastHash;
+        _headerHash  = s.headerHash;
+        memcpy(_sectionHash, s.sectionHash, sizeof(_sectionHash));
+        _deltaStaged = false;
+        return true;
+    }
+
+    // ── Scan results ─────────────────────────────────────────────────────────
+
+    // True if address answered on bus busId in the (cached) scan
+    bool found(uint8_t busId, uint8_t address) {
+        if (!_scanValid) rescan();
+        return busId < _scan.numBuses && address < 128 && _testBit(_foundMap[busId], address);
+    }
+
+    // Plugin that owns an I2C address, or nullptr
+    const CepChipsetDescriptor* chipsetAt(uint8_t address) const {
+        return _chipsetAt(address);
+    }
+
+    // Bus and address of the nth found device handled by chip (scan order).
+    // Returns false if there are fewer than nth + 1 such devices.
+    bool locate(const CepChipsetDescriptor* chip, uint8_t& busId, uint8_t& address,
+                uint8_t nth = 0) {
+        if (!_scanValid) rescan();
+        for (uint8_t b = 0; b < _scan.numBuses; b++) {
+            for (uint8_t addr = 1; addr < 128; addr++) {
+                if (!_testBit(_foundMap[b], addr) || _chipsetAt(addr) != chip) continue;
+                if (nth-- == 0) {
+                    busId   = b;
+                    address = addr;
+                    return true;
+                }
+            }
         }
+        return false;
+    }
+
+    // ── Incremental updates (cep_hotplug.h) ──────────────────────────────────
+
+    // False until the first scan (or restoreSnapshot()) and after invalidate()
+    bool scanValid() const { return _scanValid; }
+
+    // Whether a full scan probes address on bus busId (range, skip list,
+    // knownOnly, the bus's own mux and what answered upstream of it)
+    bool probes(uint8_t busId, uint8_t address) const {
+        return busId < _scan.numBuses && address >= _scan.firstAddress &&
+               address <= _scan.lastAddress && _shouldProbe(_scan.buses[busId], address) &&
+               !_testBit(_upstreamMap[busId], address);
+    }
+
+    // Fold one probe result into the cached scan. Returns true if it changed
+    // the scan; the next build, isDirty() and writeDelta() see it. Ignored
+    // while a rescan is pending.
+    bool setFound(uint8_t busId, uint8_t address, bool present) {
+        if (!_scanValid || busId >= _scan.numBuses || address >= 128) return false;
+        uint8_t& byte = _foundMap[busId][address >> 3];
+        uint8_t  bit  = (uint8_t)(1 << (address & 7));
+        if (((byte & bit) != 0) == present) return false;
+        if (present) byte |= bit;
+        else         byte &= (uint8_t)~bit;
+        return true;
+    }
+
+    // ── Main entry point ─────────────────────────────────────────────────────
+
+    // Stream the capability document to any Print sink (Serial, WiFiClient,
+    // chunked HTTP body...). Nothing larger than a single fragment is ever
+    // held in RAM. CEP_FORMAT_CBOR emits the compact binary encoding
+    // (Content-Type: application/cbor). Returns the number of bytes written.
+    size_t writeCapabilities(Print& out, CepFormat fmt = CEP_FORMAT_JSON) {
+        if (!_scanValid) rescan();   // timed as a scan, not as part of the build
+        const unsigned long start = micros();
+#ifdef ESP32
+        _heapBase = _heapLow = ESP.getFreeHeap();
+#endif
+        CepHashPrint    hasher(&out);
+        CepSectionPrint sections(_sectionHash, CEP_DELTA_SECTIONS, &hasher);
+        size_t n = _write(sections, fmt, &sections);
+        _telemetry.builds++;
+        _telemetry.bytesOut += n;
+        CepTelemetry::worst(_telemetry.buildUs, _telemetry.buildMaxUs, micros() - start);
+#ifdef ESP32
+        if (_heapBase - _heapLow > _telemetry.heapPeak) _telemetry.heapPeak = _heapBase - _heapLow;
+#endif
+        _lastHash    = hasher.hash();
+        _lastFormat  = fmt;
+        _emitted     = true;
+        _deltaStaged = false;
+        _keepSections(sections);
+        return n;
+    }
 
-        _appendGPIO(caps);
-        _appendADC(caps);
+    // ── Heartbeat / delta ────────────────────────────────────────────────────
 
+    // device.id as it appears in the document (e.g. for PATCH /devices/:id).
+    // snprintf semantics, like serializeTo().
+    size_t deviceId(char* buf, size_t cap) {
+        CepBufferPrint sink(buf, cap);
 #ifdef ESP32
-        caps += ",";
-        _appendNetwork(caps);
+        char id[18];
+        _efuseMacId(id);
+        sink.print(id);
+#else
+        sink.print(F("arduino-" ARDUINO_BOARD));
 #endif
+        sink.terminate();
+        return sink.total();
+    }
+
+    // {"id":"..","hash":"xxxxxxxx"} for POST /devices/heartbeat: the server
+    // answers 200 while its copy matches lastHash(), otherwise 404/409 and
+    // the device sends the full document. Always JSON.
+    size_t writeHeartbeat(Print& out) {
+        char hash[9];
+        _hashHex(hash, _lastHash);
+        CepJsonWriter w(out);
+        w.beginObject();
+        w.key(F("id"));
+        _writeDeviceId(w);
+        w.member(F("hash"), hash);
+        w.endObject();
+        return w.bytes();
+    }
 
-        String doc = "{";
-        doc += "\"device\":" + _deviceObject() + ",";
-        doc += "\"capabilities\":[" + caps + "]";
-        doc += "}";
+    // Patch for PATCH /devices/:id, in the format of the last build:
+    //   {"id":..,"base":"<lastHash>","hash":"<new hash>",
+    //    "ops":[{"op":"replace","path":"/capabilities/N","value":{..}}, ...]}
+    // carrying only the capability elements whose bytes changed. Writes
+    // nothing and returns 0 when a full document is the better (or only)
+    // option: nothing emitted yet, the device block or the number of elements
+    // changed, or more than half of the elements changed. The baseline for
+    // lastHash()/isDirty() stays put until commitDelta(), so a patch that
+    // never reaches the server is simply written again.
+    // Costs one measuring pass plus one pass per changed element; none of
+    // them touch the bus unless a rescan is pending.
+    size_t writeDelta(Print& out) {
+#if CEP_DELTA_SECTIONS > 0
+        if (!_emitted || _numSections > CEP_DELTA_SECTIONS) return 0;
+        const CepFormat fmt = _lastFormat;
+
+        uint32_t        now[CEP_DELTA_SECTIONS];
+        CepHashPrint    hasher;
+        CepSectionPrint probe(now, CEP_DELTA_SECTIONS, &hasher);
+        _write(probe, fmt, &probe);
+        if (probe.overflowed() || probe.count() != _numSections ||
+            probe.headerHash() != _headerHash) {
+            return 0;
+        }
+
+        uint8_t changed = 0;
+        for (uint8_t i = 0; i < _numSections; i++) changed += now[i] != _sectionHash[i];
+        if (changed * 2 > _numSections) return 0;
+
+        char base[9], hash[9];
+        _hashHex(base, _lastHash);
+        _hashHex(hash, hasher.hash());
+
+        CepJsonWriter w(out, fmt);
+        w.beginObject();
+        w.key(F("id"));
+        _writeDeviceId(w);
+        w.member(F("base"), base);
+        w.member(F("hash"), hash);
+        w.beginArray(F("ops"));
+        size_t n = 0;
+        for (uint8_t i = 0; i < _numSections; i++) {
+            if (now[i] == _sectionHash[i]) continue;
+            char path[24];
+            snprintf(path, sizeof(path), "/capabilities/%u", (unsigned)i);
+            w.beginObject();
+            w.member(F("op"), F("replace"));
+            w.member(F("path"), path);
+            w.key(F("value"));
+            w.valueFollows();
+            CepSectionPrint cut(nullptr, 0, &out);
+            cut.forwardOnly(i, fmt == CEP_FORMAT_JSON);
+            _write(cut, fmt, &cut);
+            n += cut.forwarded();
+            w.endObject();
+        }
+        w.endArray();
+        w.endObject();
+
+        _deltaHash   = hasher.hash();
+        _deltaStaged = true;
+        memcpy(_deltaSections, now, sizeof(_deltaSections));
+        _telemetry.bytesOut += w.bytes() + n;
+        return w.bytes() + n;
+#else
+        (void)out;
+        return 0;
+#endif
+    }
+
+    // Make the patch from the last writeDelta() the new baseline, once the
+    // server has applied it (2xx). False when there is none to commit, e.g.
+    // a full build has replaced it since.
+    bool commitDelta() {
+#if CEP_DELTA_SECTIONS > 0
+        if (!_deltaStaged || !_emitted) return false;
+        _deltaStaged = false;
+        _lastHash    = _deltaHash;
+        memcpy(_sectionHash, _deltaSections, sizeof(_sectionHash));
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // Serialise into caller-owned memory (static or stack), without touching
+    // the heap. Returns the document length; if that is >= cap the output
+    // was truncated and the return value is the buffer size needed minus one,
+    // as with snprintf. The buffer is always NUL-terminated when cap > 0.
+    size_t serializeTo(char* buf, size_t cap, CepFormat fmt = CEP_FORMAT_JSON) {
+        CepBufferPrint sink(buf, cap);
+        writeCapabilities(sink, fmt);
+        sink.terminate();
+        if (sink.total() >= cap) _emitted = false;   // truncated: not really sent
+        return sink.total();
+    }
+
+    // Convenience wrapper: the same document collected into a String. The
+    // document is measured first (no bus traffic once scanned) so the String
+    // takes one block of exactly the right size instead of growing through a
+    // chain of reallocations; empty if the heap cannot supply that block.
+    String getCapabilitiesJSON() {
+        CepHashPrint measure;
+        size_t n = _write(measure, CEP_FORMAT_JSON);
+        String doc;
+        if (!doc.reserve((unsigned int)n)) return doc;
+        CepStringPrint sink(doc);
+        writeCapabilities(sink);
         return doc;
     }
 
 private:
-    const CepChipsetDescriptor* _chipsets[MAX_CHIPSETS];
+    // Compile-time set from useChipsets(): both arrays live in flash
+    const CepChipsetDescriptor* const* _staticList;
+    const uint8_t*                     _staticTable;
+    uint8_t                            _numStatic;
+
     int _numChipsets;
+#if CEP_MAX_CHIPSETS > 0
+    const CepChipsetDescriptor* _chipsets[MAX_CHIPSETS];
+
+    // I2C address -> chipset index + 1 (0 = no plugin), built at registration
+    uint8_t _addrChip[128];
+#endif
+
+    CepScanConfig _scan;
+
+    // Result of the last I2C scan, one bit per address per bus, consumed by
+    // _writeI2C / _writeSensors
+    uint8_t _foundMap[CEP_MAX_I2C_BUSES][16];
+    // Per mux bus, what answered on its controller with every channel off.
+    // A TCA9548A passes the upstream bus through, so those devices would
+    // otherwise show up again on each channel; they are not probed there.
+    uint8_t _upstreamMap[CEP_MAX_I2C_BUSES][16];
+    bool    _scanValid;
+
+    bool      _emitted;     // _lastHash describes a complete emitted document
+    uint32_t  _lastHash;
+    CepFormat _lastFormat;
+
+    // Per-element hashes of the last emitted document, for writeDelta()
+    uint32_t _headerHash;
+    uint8_t  _numSections;
+#if CEP_DELTA_SECTIONS > 0
+    uint32_t _sectionHash[CEP_DELTA_SECTIONS];
+#else
+    uint32_t _sectionHash[1];
+#endif
+
+    // Written by writeDelta(), adopted by commitDelta()
+    bool     _deltaStaged;
+    uint32_t _deltaHash;
+#if CEP_DELTA_SECTIONS > 0
+    uint32_t _deltaSections[CEP_DELTA_SECTIONS];
+#endif
+
+    const CepInferenceInfo* _inference;
+    CepArena*               _arena;
+
+    CepBusProbe* _probes[CEP_MAX_PROBES];
+    uint8_t      _numProbes;
+
+    CepTelemetry  _telemetry;
+    CepTelemetry  _published;     // what the telemetry element shows
+    unsigned long _telemetryMs;   // 0 = no telemetry element
+    unsigned long _telemetryAt;
+#ifdef ESP32
+    uint32_t      _heapBase;      // free heap when the build started
+    uint32_t      _heapLow;       // lowest seen since
+#endif
+#ifdef ESP32
+    struct CepProbeRun {
+        CepBusProbe* probe;
+        TaskHandle_t owner;   // notified when the probe is done
+    };
+    CepProbeRun  _probeRun[CEP_MAX_PROBES];
+#endif
+
+    // Sensor element cache: _memoIndex[i] describes bytes of _memo
+    struct CepFragment {
+        const CepChipsetDescriptor* chip;
+        uint8_t  busId;
+        uint8_t  address;
+        uint8_t  format;
+        uint16_t offset;
+        uint16_t length;
+    };
+#if CEP_FRAGMENT_CACHE > 0
+    uint8_t     _memo[CEP_FRAGMENT_CACHE];
+    CepFragment _memoIndex[CEP_FRAGMENT_SLOTS];
+#endif
+    uint16_t    _memoUsed;
+    uint8_t     _memoCount;
+    bool        _memoFull;   // a render did not fit; stop trying until pruned
+
+    void _keepSections(const CepSectionPrint& s) {
+        _headerHash  = s.headerHash();
+        _numSections = s.overflowed() ? (uint8_t)(CEP_DELTA_SECTIONS + 1) : s.count();
+    }
+
+    static void _hashHex(char* buf, uint32_t h) {
+        snprintf(buf, 9, "%08lx", (unsigned long)h);
+    }
+
+    // Changes whenever the snapshot layout does (bus / section limits)
+    static uint32_t _snapshotMagic() {
+        return 0x43455053UL ^ (uint32_t)sizeof(CepScanSnapshot);   // "CEPS"
+    }
+
+    static uint32_t _snapshotCheck(const CepScanSnapshot& s) {
+        CepHashPrint h;
+        h.write((const uint8_t*)&s, offsetof(CepScanSnapshot, check));
+        return h.hash();
+    }
+
+    // What a scan bitmap depends on: the scan configuration (not the TwoWire
+    // objects, whose addresses may move between builds) and the chipset
+    // names, in lookup order
+    uint32_t _configHash() const {
+        CepHashPrint h;
+        h.write(_scan.firstAddress);
+        h.write(_scan.lastAddress);
+        h.write(_scan.knownOnly);
+        h.write((const uint8_t*)&_scan.clockHz, sizeof(_scan.clockHz));
+        for (const uint8_t* a = _scan.skip; a && *a; a++) h.write(*a);
+        h.write(_scan.numBuses);
+        for (uint8_t b = 0; b < _scan.numBuses; b++) {
+            const CepI2CBus& bus = _scan.buses[b];
+            h.write((uint8_t)bus.sda);
+            h.write((uint8_t)bus.scl);
+            h.write(bus.muxAddress);
+            h.write(bus.muxChannel);
+        }
+        for (uint8_t i = 0; i < _numStatic; i++) {
+            const CepChipsetDescriptor* c = (const CepChipsetDescriptor*)pgm_read_ptr(&_staticList[i]);
+            h.print((const __FlashStringHelper*)pgm_read_ptr(&c->name));
+            h.write(0);
+        }
+#if CEP_MAX_CHIPSETS > 0
+        for (int i = 0; i < _numChipsets; i++) {
+            h.print((const __FlashStringHelper*)pgm_read_ptr(&_chipsets[i]->name));
+            h.write(0);
+        }
+#endif
+        return h.hash();
+    }
+
+    // Element boundary: tell sections, and sample the heap for heapPeak
+    void _mark(CepSectionPrint* s) {
+        if (s) s->mark();
+#ifdef ESP32
+        uint32_t free = ESP.getFreeHeap();
+        if (free < _heapLow) _heapLow = free;
+#endif
+    }
+
+    // sections (optional) is told where each capability element starts
+    size_t _write(Print& out, CepFormat fmt, CepSectionPrint* sections = nullptr) {
+        if (!_scanValid) rescan();
+
+        const size_t scratch = _arena ? _arena->mark() : 0;
+        CepJsonWriter w(out, fmt);
+        w.setArena(_arena);
+        w.beginObject();
+        w.key(F("device"));
+        _writeDevice(w);
+
+        w.beginArray(F("capabilities"));
+        _mark(sections);
+        _writeCompute(w);
+        _mark(sections);
+        _writeI2C(w);
+        _writeSensors(w, sections);
+        _writeProbes(w, sections);
+        _mark(sections);
+        _writeGPIO(w);
+        _mark(sections);
+        _writeADC(w);
+#ifdef ESP32
+        _mark(sections);
+        _writeNetwork(w);
+#endif
+        if (_telemetryMs) {
+            _mark(sections);
+            _writeTelemetry(w);
+        }
+        if (sections) sections->close();
+        w.endArray();
+
+        w.endObject();
+        if (_arena) _arena->release(scratch);
+        return w.bytes();
+    }
 
     // ── Device identity ────────────────────────────────────────────────────
 
-    String _deviceObject() {
-        String d = "{";
-        d += "\"id\":\"" + _deviceId() + "\",";
-        d += "\"class\":\"microcontroller\",";
-        d += "\"transport\":\"serial\",";
-        d += "\"model\":\"" + String(ARDUINO_BOARD) + "\",";
-        d += "\"firmware\":\"" + String(ESP_ARDUINO_VERSION_MAJOR) + "." +
-             String(ESP_ARDUINO_VERSION_MINOR) + "." +
-             String(ESP_ARDUINO_VERSION_PATCH) + "\"";
-        d += "}";
-        return d;
+    void _writeDevice(CepJsonWriter& w) {
+        w.beginObject();
+        w.key(F("id"));
+        _writeDeviceId(w);
+        w.member(F("class"), F("microcontroller"));
+        w.member(F("transport"), F(CEP_TRANSPORT));
+        w.member(F("model"), F(ARDUINO_BOARD));
+#ifdef ESP_ARDUINO_VERSION_MAJOR
+        w.member(F("firmware"), F(CEP_STR(ESP_ARDUINO_VERSION_MAJOR) "."
+                                  CEP_STR(ESP_ARDUINO_VERSION_MINOR) "."
+                                  CEP_STR(ESP_ARDUINO_VERSION_PATCH)));
+#endif
+        w.endObject();
     }
 
-    String _deviceId() {
+    void _writeDeviceId(CepJsonWriter& w) {
 #ifdef ESP32
-        uint64_t mac = ESP.getEfuseMac();
         char buf[18];
-        snprintf(buf, sizeof(buf), "%02x:%02x:%02x:%02x:%02x:%02x",
+        _efuseMacId(buf);
+        w.value(buf);
+#else
+        w.value(F("arduino-" ARDUINO_BOARD));
+#endif
+    }
+
+#ifdef ESP32
+    static void _efuseMacId(char* buf) {
+        uint64_t mac = ESP.getEfuseMac();
+        snprintf(buf, 18, "%02x:%02x:%02x:%02x:%02x:%02x",
                  (uint8_t)(mac >> 40),
                  (uint8_t)(mac >> 32),
                  (uint8_t)(mac >> 24),
                  (uint8_t)(mac >> 16),
                  (uint8_t)(mac >>  8),
                  (uint8_t)(mac      ));
-        return String(buf);
-#else
-        return "arduino-" + String(ARDUINO_BOARD);
-#endif
     }
+#endif
 
     // ── Compute ───────────────────────────────────────────────────────────
 
-    void _appendCompute(String& caps) {
-        caps += "{\"type\":\"compute\"";
+    void _writeCompute(CepJsonWriter& w) {
+        w.beginObject();
+        w.member(F("type"), F("compute"));
 #ifdef ESP32
-        caps += ",\"mhz\":" + String(ESP.getCpuFreqMHz());
-        caps += ",\"ram_kb\":" + String(ESP.getHeapSize() / 1024);
-        caps += ",\"flash_kb\":" + String(ESP.getFlashChipSize() / 1024);
+        w.member(F("mhz"),      (unsigned long)ESP.getCpuFreqMHz());
+        w.member(F("ram_kb"),   (unsigned long)(ESP.getHeapSize() / 1024));
+        w.member(F("flash_kb"), (unsigned long)(ESP.getFlashChipSize() / 1024));
 #endif
-        caps += "}";
+        if (_inference && _inference->model) {
+            w.beginObject(F("inference"));
+            w.member(F("model"), (const __FlashStringHelper*)_inference->model);
+            w.member(F("ops_per_sec"), (unsigned long)_inference->opsPerSec);
+            w.member(F("inputs"), (unsigned int)_inference->inputs);
+            w.member(F("outputs"), (unsigned int)_inference->outputs);
+            if (_inference->port) w.member(F("port"), (unsigned int)_inference->port);
+            w.endObject();
+        }
+        w.endObject();
     }
 
     // ── I2C scan + chipset matching ───────────────────────────────────────
 
-    void _appendI2C(String& caps, String& sensors) {
-        Wire.begin();
-
-        String devices = "[";
-        bool first = true;
-
-        // Internal: track found addresses for chipset matching
-        uint8_t found[64];
-        int     nFound = 0;
-
-        for (uint8_t addr = 1; addr < 127; addr++) {
-            Wire.beginTransmission(addr);
-            if (Wire.endTransmission() == 0) {
-                found[nFound++] = addr;
-                char hex[7];
-                snprintf(hex, sizeof(hex), "\"0x%02x\"", addr);
-                if (!first) devices += ",";
-                devices += String(hex);
-                first = false;
+    static bool _testBit(const uint8_t* map, uint8_t addr) {
+        return map[addr >> 3] & (1 << (addr & 7));
+    }
+
+    const CepChipsetDescriptor* _chipsetAt(uint8_t addr) const {
+        addr &= 0x7f;
+        if (_staticTable) {
+            uint8_t idx = pgm_read_byte(&_staticTable[addr]);
+            if (idx) return (const CepChipsetDescriptor*)pgm_read_ptr(&_staticList[idx - 1]);
+        }
+#if CEP_MAX_CHIPSETS > 0
+        uint8_t idx = _addrChip[addr];
+        if (idx) return _chipsets[idx - 1];
+#endif
+        return nullptr;
+    }
+
+    // Start and clock each controller once, even when several mux channels
+    // share it: only bus b's first appearance in the configuration begins it.
+    void _beginBus(uint8_t b) {
+        const CepI2CBus& bus = _scan.buses[b];
+        for (uint8_t p = 0; p < b; p++) {
+            if (_scan.buses[p].wire == bus.wire) return;
+        }
+#ifdef ESP32
+        bus.wire->begin(bus.sda, bus.scl, _scan.clockHz);
+#else
+        bus.wire->begin();
+#endif
+        bus.wire->setClock(_scan.clockHz);
+    }
+
+    // First bus on the same controller behind the same mux as bus b (b itself
+    // when there is none): channels of one mux share its upstream devices
+    uint8_t _muxFirst(uint8_t b) const {
+        const CepI2CBus& bus = _scan.buses[b];
+        for (uint8_t p = 0; p < b; p++) {
+            if (_scan.buses[p].wire == bus.wire && _scan.buses[p].muxAddress == bus.muxAddress) return p;
+        }
+        return b;
+    }
+
+    void _scanI2C() {
+        memset(_foundMap, 0, sizeof(_foundMap));
+        memset(_upstreamMap, 0, sizeof(_upstreamMap));
+
+        for (uint8_t b = 0; b < _scan.numBuses; b++) {
+            const CepI2CBus& bus = _scan.buses[b];
+            _beginBus(b);
+
+            if (bus.muxAddress) {
+                uint8_t p = _muxFirst(b);
+                if (p < b) {
+                    memcpy(_upstreamMap[b], _upstreamMap[p], sizeof(_upstreamMap[b]));
+                } else {
+                    _selectMux(bus, 0);
+                    _probeBus(bus, _upstreamMap[b], nullptr);
+                }
+                _selectMux(bus, (uint8_t)(1 << bus.muxChannel));
             }
-            delayMicroseconds(100);
-        }
-        devices += "]";
-
-        caps += ",{\"type\":\"i2c\",\"buses\":[{\"id\":0,\"sda\":21,\"scl\":22,"
-                "\"freq_hz\":100000,\"devices_found\":" + devices + "}]}";
-
-        // Match found addresses to chipset plugins
-        bool firstSensor = true;
-        for (int i = 0; i < nFound; i++) {
-            for (int c = 0; c < _numChipsets; c++) {
-                const CepChipsetDescriptor* chip = _chipsets[c];
-                for (int k = 0; chip->i2cAddresses[k] != 0; k++) {
-                    if (chip->i2cAddresses[k] == found[i]) {
-                        String custom = chip->describe(0, found[i]);
-                        String s;
-                        if (custom.length() > 0) {
-                            s = custom;
-                        } else {
-                            char hex[7];
-                            snprintf(hex, sizeof(hex), "0x%02x", found[i]);
-                            s  = "{\"type\":\"sensor\"";
-                            s += ",\"chipset\":\"" + String(chip->name) + "\"";
-                            s += ",\"bus\":\"i2c\",\"bus_id\":0";
-                            s += ",\"address\":\"" + String(hex) + "\"";
-                            s += ",\"provides\":[";
-                            bool fp = true;
-                            for (int p = 0; chip->provides[p] != nullptr; p++) {
-                                if (!fp) s += ",";
-                                s += "\"" + String(chip->provides[p]) + "\"";
-                                fp = false;
-                            }
-                            s += "]}";
-                        }
-                        if (!firstSensor) sensors += ",";
-                        sensors += s;
-                        firstSensor = false;
-                    }
+
+            _probeBus(bus, _foundMap[b], _upstreamMap[b]);
+
+            if (bus.muxAddress) _selectMux(bus, 0);
+        }
+    }
+
+    // Probe the scan range on bus into map, except the addresses set in skip
+    void _probeBus(const CepI2CBus& bus, uint8_t* map, const uint8_t* skip) {
+        for (uint16_t addr = _scan.firstAddress; addr <= _scan.lastAddress; addr++) {
+            if (!_shouldProbe(bus, (uint8_t)addr)) continue;
+            if (skip && _testBit(skip, (uint8_t)addr)) continue;
+            bus.wire->beginTransmission((uint8_t)addr);
+            bool acked = bus.wire->endTransmission() == 0;
+            if (acked) map[addr >> 3] |= (uint8_t)(1 << (addr & 7));
+            _telemetry.probed(acked);
+            if (_scan.probeDelayUs) delayMicroseconds(_scan.probeDelayUs);
+        }
+    }
+
+    // Probe the saved devices and every plugin address on each bus (and, once
+    // per mux, upstream of it); true if all of them answer (or stay silent)
+    // as in the snapshot
+    bool _verifySnapshot(const CepScanSnapshot& s) {
+        for (uint8_t b = 0; b < _scan.numBuses; b++) {
+            const CepI2CBus& bus = _scan.buses[b];
+            _beginBus(b);
+            bool same = true;
+            if (bus.muxAddress) {
+                if (_muxFirst(b) == b) {
+                    _selectMux(bus, 0);
+                    same = _verifyBus(bus, s.upstreamMap[b], nullptr);
                 }
+                _selectMux(bus, (uint8_t)(1 << bus.muxChannel));
             }
+            same = same && _verifyBus(bus, s.foundMap[b], s.upstreamMap[b]);
+            if (bus.muxAddress) _selectMux(bus, 0);
+            if (!same) return false;
         }
+        return true;
     }
 
-    // ── GPIO ──────────────────────────────────────────────────────────────
+    bool _verifyBus(const CepI2CBus& bus, const uint8_t* map, const uint8_t* skip) {
+        for (uint16_t addr = _scan.firstAddress; addr <= _scan.lastAddress; addr++) {
+            bool was = _testBit(map, (uint8_t)addr);
+            if (!was && !_chipsetAt((uint8_t)addr)) continue;
+            if (!_shouldProbe(bus, (uint8_t)addr)) continue;
+            if (skip && _testBit(skip, (uint8_t)addr)) continue;
+            bus.wire->beginTransmission((uint8_t)addr);
+            bool acked = bus.wire->endTransmission() == 0;
+            _telemetry.probed(acked);
+            if (acked != was) return false;
+        }
+        return true;
+    }
+
+    // ── Bus probes ─────────────────────────────────────────────────────────
+
+    static void _runProbe(CepBusProbe& probe) {
+        CepProbeOps ops;
+        memcpy_P(&ops, probe.ops, sizeof(ops));
+        if (ops.scan) ops.scan(probe);
+    }
+
+#ifdef ESP32
+    static void _probeTask(void* arg) {
+        CepProbeRun* run = (CepProbeRun*)arg;
+        _runProbe(*run->probe);
+        xTaskNotifyGive(run->owner);
+        vTaskDelete(nullptr);
+    }
+#endif
 
-    void _appendGPIO(String& caps) {
+    // Start every probe on a task of its own; a probe whose task cannot be
+    // created (or any probe, without a scheduler) runs to completion here.
+    // Returns the number of tasks to wait for.
+    uint8_t _startProbes() {
+        uint8_t running = 0;
+        for (uint8_t i = 0; i < _numProbes; i++) {
 #ifdef ESP32
-        caps += ",{\"type\":\"gpio\",\"digital_out\":[2,4,5,12,13,14,15,16,17,18,19,21,22,23,25,26,27,32,33]"
-                ",\"digital_in\":[32,33,34,35,36,39]}";
+            CepProbeRun& run = _probeRun[i];
+            run.probe = _probes[i];
+            run.owner = xTaskGetCurrentTaskHandle();
+            if (xTaskCreatePinnedToCore(_probeTask, "cep_probe", CEP_PROBE_STACK, &run,
+                                        uxTaskPriorityGet(nullptr), nullptr,
+                                        tskNO_AFFINITY) == pdPASS) {
+                running++;
+                continue;
+            }
+#endif
+            _runProbe(*_probes[i]);
+        }
+        return running;
+    }
+
+    void _joinProbes(uint8_t running) {
+#ifdef ESP32
+        while (running--) ulTaskNotifyTake(pdFALSE, portMAX_DELAY);
 #else
-        caps += ",{\"type\":\"gpio\"}";
+        (void)running;
 #endif
     }
 
+    // Each probe's elements, in registration order
+    void _writeProbes(CepJsonWriter& w, CepSectionPrint* sections) {
+        for (uint8_t i = 0; i < _numProbes; i++) {
+            CepProbeOps ops;
+            memcpy_P(&ops, _probes[i]->ops, sizeof(ops));
+            if (!ops.element) continue;
+            for (uint8_t e = 0; ; e++) {
+                _mark(sections);   // an element that writes nothing is not counted
+                if (!ops.element(*_probes[i], e, w)) break;
+            }
+        }
+    }
+
+    void _selectMux(const CepI2CBus& bus, uint8_t mask) {
+        cepSelectMux(bus, mask);
+    }
+
+    bool _shouldProbe(const CepI2CBus& bus, uint8_t addr) const {
+        if (addr == bus.muxAddress) return false;   // the mux answers on every channel
+        if (_scan.skip) {
+            for (const uint8_t* s = _scan.skip; *s; s++) {
+                if (*s == addr) return false;
+            }
+        }
+        return !_scan.knownOnly || _chipsetAt(addr) != nullptr;
+    }
+
+    void _writeI2C(CepJsonWriter& w) {
+        w.beginObject();
+        w.member(F("type"), F("i2c"));
+        w.beginArray(F("buses"));
+        for (uint8_t b = 0; b < _scan.numBuses; b++) {
+            const CepI2CBus& bus = _scan.buses[b];
+            w.beginObject();
+            w.member(F("id"), (int)b);
+            w.member(F("sda"), (int)bus.sda);
+            w.member(F("scl"), (int)bus.scl);
+            w.member(F("freq_hz"), (unsigned long)_scan.clockHz);
+            if (bus.muxAddress) {
+                w.memberHex8(F("mux"), bus.muxAddress);
+                w.member(F("mux_channel"), (int)bus.muxChannel);
+            }
+            w.beginArray(F("devices_found"));
+            for (uint8_t addr = 1; addr < 128; addr++) {
+                if (_testBit(_foundMap[b], addr)) w.hex8(addr);
+            }
+            w.endArray();
+            w.endObject();
+        }
+        w.endArray();
+        w.endObject();
+    }
+
+    // Match found addresses to chipset plugins: one table lookup per device
+    void _writeSensors(CepJsonWriter& w, CepSectionPrint* sections) {
+        for (uint8_t b = 0; b < _scan.numBuses; b++) {
+            for (uint8_t addr = 1; addr < 128; addr++) {
+                if (!_testBit(_foundMap[b], addr)) continue;
+                const CepChipsetDescriptor* chip = _chipsetAt(addr);
+                if (!chip) continue;
+                _mark(sections);
+                _writeSensor(w, chip, b, addr);
+            }
+        }
+    }
+
+    void _writeSensor(CepJsonWriter& w, const CepChipsetDescriptor* chip,
+                      uint8_t busId, uint8_t address) {
+        CepChipsetDescriptor d;
+        memcpy_P(&d, chip, sizeof(d));
+#if CEP_FRAGMENT_CACHE > 0
+        if (!(d.flags & CEP_CHIP_DYNAMIC)) {
+            const CepFragment* f = _memoFind(chip, busId, address, w.format());
+            if (!f) f = _memoRender(d, chip, busId, address, w);
+            if (f) {
+                w.rawValue(&_memo[f->offset], f->length);
+                return;
+            }
+        }
+#endif
+        _describe(w, d, busId, address);
+    }
+
+    void _describe(CepJsonWriter& w, const CepChipsetDescriptor& d,
+                   uint8_t busId, uint8_t address) {
+        if (d.describeTo) {
+            d.describeTo(w, busId, address);
+        } else {
+            _writeDefaultSensor(w, d, busId, address);
+        }
+    }
+
+    // ── Fragment cache ────────────────────────────────────────────────────
+
+    void _memoClear() {
+        _memoUsed  = 0;
+        _memoCount = 0;
+        _memoFull  = false;
+    }
+
+    // Drop elements of devices the scan no longer finds, compacting the
+    // arena; survivors keep their bytes
+    void _memoPrune() {
+#if CEP_FRAGMENT_CACHE > 0
+        uint16_t used = 0;
+        uint8_t  kept = 0;
+        for (uint8_t i = 0; i < _memoCount; i++) {
+            CepFragment f = _memoIndex[i];
+            if (f.busId >= _scan.numBuses || !_testBit(_foundMap[f.busId], f.address)) continue;
+            if (f.offset != used) memmove(&_memo[used], &_memo[f.offset], f.length);
+            f.offset = used;
+            used = (uint16_t)(used + f.length);
+            _memoIndex[kept++] = f;
+        }
+        _memoUsed  = used;
+        _memoCount = kept;
+        _memoFull  = false;
+#endif
+    }
+
+#if CEP_FRAGMENT_CACHE > 0
+    const CepFragment* _memoFind(const CepChipsetDescriptor* chip, uint8_t busId,
+                                 uint8_t address, CepFormat fmt) const {
+        for (uint8_t i = 0; i < _memoCount; i++) {
+            const CepFragment& f = _memoIndex[i];
+            if (f.address == address && f.busId == busId && f.chip == chip && f.format == fmt) return &f;
+        }
+        return nullptr;
+    }
+
+    // Render one element into the arena; nullptr if slots or bytes run out
+    const CepFragment* _memoRender(const CepChipsetDescriptor& d, const CepChipsetDescriptor* chip,
+                                   uint8_t busId, uint8_t address, const CepJsonWriter& w) {
+        const CepFormat fmt = w.format();
+        if (_memoFull || _memoCount >= CEP_FRAGMENT_SLOTS) return nullptr;
+        size_t room = CEP_FRAGMENT_CACHE - _memoUsed;
+        CepBufferPrint sink((char*)&_memo[_memoUsed], room);   // keeps 1 byte for a NUL
+        CepJsonWriter  sub(sink, fmt);
+        sub.setArena(w.arena());
+        _describe(sub, d, busId, address);
+        if (sink.total() >= room) {
+            _memoFull = true;
+            return nullptr;
+        }
+        CepFragment& f = _memoIndex[_memoCount++];
+        f.chip    = chip;
+        f.busId   = busId;
+        f.address = address;
+        f.format  = (uint8_t)fmt;
+        f.offset  = _memoUsed;
+        f.length  = (uint16_t)sink.total();
+        _memoUsed = (uint16_t)(_memoUsed + f.length);
+        return &f;
+    }
+#endif
+
+    // d is an SRAM copy of the descriptor; its strings are still in flash
+    void _writeDefaultSensor(CepJsonWriter& w, const CepChipsetDescriptor& d,
+                             uint8_t busId, uint8_t address) {
+        w.beginObject();
+        w.member(F("type"), F("sensor"));
+        w.member(F("chipset"), (const __FlashStringHelper*)d.name);
+        w.member(F("bus"), (const __FlashStringHelper*)d.bus);
+        w.member(F("bus_id"), (int)busId);
+        w.memberHex8(F("address"), address);
+        w.beginArray(F("provides"));
+        for (const char* const* p = d.provides; ; p++) {
+            const char* measure = (const char*)pgm_read_ptr(p);
+            if (!measure) break;
+            w.value((const __FlashStringHelper*)measure);
+        }
+        w.endArray();
+        w.endObject();
+    }
+
+    // ── GPIO ──────────────────────────────────────────────────────────────
+
+    void _writeGPIO(CepJsonWriter& w) {
+        w.beginObject();
+        w.member(F("type"), F("gpio"));
+#ifdef ESP32
+        static const uint8_t digitalOut[] PROGMEM = { 2, 4, 5, 12, 13, 14, 15, 16, 17, 18, 19,
+                                                      21, 22, 23, 25, 26, 27, 32, 33 };
+        static const uint8_t digitalIn[]  PROGMEM = { 32, 33, 34, 35, 36, 39 };
+        w.memberIntArrayP(F("digital_out"), digitalOut, sizeof(digitalOut));
+        w.memberIntArrayP(F("digital_in"),  digitalIn,  sizeof(digitalIn));
+#endif
+        w.endObject();
+    }
+
     // ── ADC ───────────────────────────────────────────────────────────────
 
-    void _appendADC(String& caps) {
+    void _writeADC(CepJsonWriter& w) {
+#ifdef ESP32
+        static const uint8_t pins[] PROGMEM = { 32, 33, 34, 35, 36, 39 };
+        w.beginObject();
+        w.member(F("type"), F("adc"));
+        w.memberIntArrayP(F("pins"), pins, sizeof(pins));
+        w.member(F("resolution"), 12);
+        w.member(F("channels"), 6);
+        w.endObject();
+#else
+        (void)w;
+#endif
+    }
+
+    // ── Telemetry ─────────────────────────────────────────────────────────
+
+    void _publish() {
+#ifdef ESP32
+        _telemetry.heapMinFree  = ESP.getMinFreeHeap();
+        _telemetry.heapMaxBlock = ESP.getMaxAllocHeap();
+#endif
+        _published   = _telemetry;
+        _telemetryAt = millis();
+    }
+
+    void _writeTelemetry(CepJsonWriter& w) {
+        const CepTelemetry& t = _published;
+        w.beginObject();
+        w.member(F("type"), F("telemetry"));
+        w.member(F("uptime_s"), (unsigned long)(_telemetryAt / 1000));
+        w.member(F("scans"), (unsigned long)t.scans);
+        w.member(F("scan_us"), (unsigned long)t.scanUs);
+        w.member(F("scan_max_us"), (unsigned long)t.scanMaxUs);
+        w.member(F("i2c_probes"), (unsigned long)t.i2cProbes);
+        w.member(F("i2c_nacks"), (unsigned long)t.i2cNacks);
+        w.member(F("builds"), (unsigned long)t.builds);
+        w.member(F("build_us"), (unsigned long)t.buildUs);
+        w.member(F("build_max_us"), (unsigned long)t.buildMaxUs);
+        w.member(F("bytes_out"), (unsigned long)t.bytesOut);
 #ifdef ESP32
-        caps += ",{\"type\":\"adc\",\"pins\":[32,33,34,35,36,39],\"resolution\":12,\"channels\":6}";
+        w.member(F("heap_peak_b"), (unsigned long)t.heapPeak);
+        w.member(F("heap_min_free_b"), (unsigned long)t.heapMinFree);
+        w.member(F("heap_max_block_b"), (unsigned long)t.heapMaxBlock);
 #endif
+        w.member(F("reg_ok"), (unsigned long)t.regOk);
+        w.member(F("reg_failures"), (unsigned long)t.regFailures);
+        w.member(F("reg_ms"), (unsigned long)t.regMs);
+        w.member(F("reg_max_ms"), (unsigned long)t.regMaxMs);
+        w.endObject();
     }
 
     // ── Network (ESP32 only) ───────────────────────────────────────────────
 
 #ifdef ESP32
-    void _appendNetwork(String& caps) {
+    void _writeNetwork(CepJsonWriter& w) {
         uint8_t mac[6];
         esp_read_mac(mac, ESP_MAC_WIFI_STA);
         char macStr[18];
         snprintf(macStr, sizeof(macStr), "%02x:%02x:%02x:%02x:%02x:%02x",
                  mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
-        caps += "{\"type\":\"network\",\"interfaces\":["
-                "{\"kind\":\"wifi\",\"mac\":\"" + String(macStr) + "\"}]}";
+        w.beginObject();
+        w.member(F("type"), F("network"));
+        w.beginArray(F("interfaces"));
+        w.beginObject();
+        w.member(F("kind"), F("wifi"));
+        w.member(F("mac"), macStr);
+        w.endObject();
+        w.endArray();
+        w.endObject();
     }
 #endif
 };
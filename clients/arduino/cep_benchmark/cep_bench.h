@@ -0,0 +1,255 @@
+/*
+ * cep_bench.h  —  Time, heap and size measurements for CEP document builds
+ *
+ * Shared by the cep_benchmark sketch and the host harness
+ * (host/cep_bench_host.cpp), so numbers from a board and from x86 come out
+ * in the same CSV shape and can be diffed between serializer changes.
+ *
+ * Each iteration times four phases with micros():
+ *   scan       cep.rescan(): every bus probe
+ *   match      found() + chipsetAt() over every bus and address
+ *   serialize  writeCapabilities() into a hashing sink (no I/O)
+ *   network    the sketch's send callback, if any (skipped otherwise)
+ * and then each serializer variant (stream, fixed buffer, String, CBOR),
+ * recording its output size and the heap around it: free heap before / after
+ * the variant's iterations, how far the low-water mark dropped, and the
+ * largest free block before / after, which exposes fragmentation.
+ *
+ * Usage:
+ *   CepBench bench(cep);
+ *   bench.setNetwork(sendDoc, &client);       // optional
+ *   bench.run(100);
+ *   bench.report(Serial);
+ *
+ * Heap figures need ESP32 (or the host build with -DESP32); elsewhere they
+ * read 0.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include "../cep.h"
+
+// Fixed buffer for the serializeTo() variant; larger documents are counted
+// but truncated (report shows the full size)
+#ifndef CEP_BENCH_BUF
+#define CEP_BENCH_BUF 1536
+#endif
+
+enum CepBenchPhase : uint8_t {
+    CEP_BENCH_SCAN,
+    CEP_BENCH_MATCH,
+    CEP_BENCH_SERIALIZE,
+    CEP_BENCH_NETWORK,
+    CEP_BENCH_PHASES
+};
+
+enum CepBenchVariant : uint8_t {
+    CEP_BENCH_STREAM,   // writeCapabilities() into a measuring sink
+    CEP_BENCH_BUFFER,   // serializeTo() a fixed buffer
+    CEP_BENCH_STRING,   // getCapabilitiesJSON()
+    CEP_BENCH_CBOR,     // writeCapabilities(CEP_FORMAT_CBOR) into a measuring sink
+    CEP_BENCH_VARIANTS
+};
+
+struct CepBenchStat {
+    uint32_t minUs;
+    uint32_t maxUs;
+    uint64_t totalUs;
+    uint16_t runs;
+
+    void reset() {
+        minUs   = UINT32_MAX;
+        maxUs   = 0;
+        totalUs = 0;
+        runs    = 0;
+    }
+
+    void add(uint32_t us) {
+        if (us < minUs) minUs = us;
+        if (us > maxUs) maxUs = us;
+        totalUs += us;
+        runs++;
+    }
+
+    uint32_t avgUs() const { return runs ? (uint32_t)(totalUs / runs) : 0; }
+    uint32_t lowUs() const { return runs ? minUs : 0; }
+};
+
+struct CepBenchHeap {
+    uint32_t free;
+    uint32_t minFree;
+    uint32_t largest;
+
+    static CepBenchHeap now() {
+        CepBenchHeap h;
+#ifdef ESP32
+        h.free    = ESP.getFreeHeap();
+        h.minFree = ESP.getMinFreeHeap();
+        h.largest = ESP.getMaxAllocHeap();
+#else
+        h.free = h.minFree = h.largest = 0;
+#endif
+        return h;
+    }
+};
+
+struct CepBenchVariantResult {
+    CepBenchStat time;
+    size_t       bytes;
+    CepBenchHeap before;
+    CepBenchHeap after;
+};
+
+class CepBench {
+public:
+    explicit CepBench(CEP& cep) : _cep(cep), _send(nullptr), _ctx(nullptr), _iterations(0) {
+        _reset();
+    }
+
+    // Network phase: send one document and return the bytes sent (0 = the
+    // send failed and is not timed). Without it the phase is skipped.
+    void setNetwork(size_t (*send)(CEP& cep, void* ctx), void* ctx) {
+        _send = send;
+        _ctx  = ctx;
+    }
+
+    void run(uint16_t iterations) {
+        _reset();
+        _iterations = iterations;
+
+        for (uint16_t i = 0; i < iterations; i++) {
+            uint32_t t = micros();
+            _cep.rescan();
+            _phase[CEP_BENCH_SCAN].add(micros() - t);
+
+            t = micros();
+            _match();
+            _phase[CEP_BENCH_MATCH].add(micros() - t);
+
+            CepHashPrint sink;
+            t = micros();
+            _cep.writeCapabilities(sink);
+            _phase[CEP_BENCH_SERIALIZE].add(micros() - t);
+
+            if (_send) {
+                t = micros();
+                size_t n = _send(_cep, _ctx);
+                if (n) _phase[CEP_BENCH_NETWORK].add(micros() - t);
+            }
+        }
+
+        for (uint8_t v = 0; v < CEP_BENCH_VARIANTS; v++) {
+            CepBenchVariantResult& r = _variant[v];
+            r.before = CepBenchHeap::now();
+            for (uint16_t i = 0; i < iterations; i++) {
+                uint32_t t = micros();
+                r.bytes = _serialize((CepBenchVariant)v);
+                r.time.add(micros() - t);
+            }
+            r.after = CepBenchHeap::now();
+        }
+    }
+
+    const CepBenchStat&          phase(CepBenchPhase p) const     { return _phase[p]; }
+    const CepBenchVariantResult& variant(CepBenchVariant v) const { return _variant[v]; }
+
+    // CSV, one table for phases and one for serializer variants
+    void report(Print& out) const {
+        out.print(F("# cep_bench iterations="));
+        out.println((unsigned long)_iterations);
+        out.println(F("phase,runs,min_us,avg_us,max_us"));
+        for (uint8_t p = 0; p < CEP_BENCH_PHASES; p++) {
+            const CepBenchStat& s = _phase[p];
+            out.print((const __FlashStringHelper*)_phaseName(p));
+            _csv(out, s.runs);
+            _csv(out, s.lowUs());
+            _csv(out, s.avgUs());
+            _csv(out, s.maxUs);
+            out.println();
+        }
+        out.println(F("variant,bytes,min_us,avg_us,max_us,free_before,free_after,"
+                      "min_free_drop,largest_before,largest_after"));
+        for (uint8_t v = 0; v < CEP_BENCH_VARIANTS; v++) {
+            const CepBenchVariantResult& r = _variant[v];
+            out.print((const __FlashStringHelper*)_variantName(v));
+            _csv(out, (uint32_t)r.bytes);
+            _csv(out, r.time.lowUs());
+            _csv(out, r.time.avgUs());
+            _csv(out, r.time.maxUs);
+            _csv(out, r.before.free);
+            _csv(out, r.after.free);
+            _csv(out, r.before.minFree - r.after.minFree);
+            _csv(out, r.before.largest);
+            _csv(out, r.after.largest);
+            out.println();
+        }
+    }
+
+private:
+    CEP&                  _cep;
+    size_t              (*_send)(CEP&, void*);
+    void*                 _ctx;
+    uint16_t              _iterations;
+    CepBenchStat          _phase[CEP_BENCH_PHASES];
+    CepBenchVariantResult _variant[CEP_BENCH_VARIANTS];
+    char                  _buf[CEP_BENCH_BUF];
+
+    static const char* _phaseName(uint8_t p) {
+        static const char names[] PROGMEM = "scan\0match\0serialize\0network";
+        return _nth(names, p);
+    }
+
+    static const char* _variantName(uint8_t v) {
+        static const char names[] PROGMEM = "stream\0buffer\0string\0cbor";
+        return _nth(names, v);
+    }
+
+    // nth entry of a NUL-separated PROGMEM list
+    static const char* _nth(const char* list, uint8_t n) {
+        while (n--) list += strlen_P(list) + 1;
+        return list;
+    }
+
+    static void _csv(Print& out, uint32_t v) {
+        out.print(',');
+        out.print((unsigned long)v);
+    }
+
+    void _reset() {
+        for (uint8_t p = 0; p < CEP_BENCH_PHASES; p++) _phase[p].reset();
+        for (uint8_t v = 0; v < CEP_BENCH_VARIANTS; v++) {
+            _variant[v].time.reset();
+            _variant[v].bytes = 0;
+        }
+    }
+
+    // What a document build does per device to pick the plugin
+    void _match() {
+        volatile uint8_t matched = 0;
+        const CepScanConfig& scan = _cep.scanConfig();
+        for (uint8_t b = 0; b < scan.numBuses; b++) {
+            for (uint8_t addr = 1; addr < 128; addr++) {
+                if (_cep.found(b, addr) && _cep.chipsetAt(addr)) matched++;
+            }
+        }
+        (void)matched;
+    }
+
+    size_t _serialize(CepBenchVariant v) {
+        switch (v) {
+        case CEP_BENCH_BUFFER:
+            return _cep.serializeTo(_buf, sizeof(_buf));
+        case CEP_BENCH_STRING:
+            return _cep.getCapabilitiesJSON().length();
+        case CEP_BENCH_CBOR: {
+            CepHashPrint sink;
+            return _cep.writeCapabilities(sink, CEP_FORMAT_CBOR);
+        }
+        default: {
+            CepHashPrint sink;
+            return _cep.writeCapabilities(sink);
+        }
+        }
+    }
+};
@@ -0,0 +1,84 @@
+/**
+ * clients/arduino/cep_benchmark/cep_benchmark.ino
+ *
+ * JumpNet CEP — build-time, heap and payload benchmark.
+ *
+ * This sketch:
+ *  1. Times ITERATIONS document builds phase by phase (scan, match,
+ *     serialize and, with WiFi credentials, network: a POST /devices/register
+ *     to a JumpNet node over a fresh connection)
+ *  2. Times each serializer variant and reports its output size and the heap
+ *     around it (free, low-water drop, largest free block)
+ *  3. Prints both as CSV to Serial, in the same shape as the host harness
+ *     (host/cep_bench_host.cpp), then repeats every 30 s
+ *
+ * Board: ESP32 (heap figures); other boards report timings and sizes only.
+ * Required: no external libraries.
+ */
+
+#include "../cep.h"
+#include "../chipsets/bme280_chip.h"
+#include "../chipsets/ssd1306_chip.h"
+#include "../chipsets/mpu6050_chip.h"
+#include "cep_bench.h"
+
+#ifdef ESP32
+#include <WiFi.h>
+#endif
+
+// ── Config ────────────────────────────────────────────────────────────────────
+const uint16_t ITERATIONS     = 100;
+const char*    WIFI_SSID      = "";                // Set to include the network phase
+const char*    WIFI_PASSWORD  = "";
+const char*    JUMPNET_HOST   = "192.168.1.100";
+const uint16_t JUMPNET_PORT   = 4080;
+
+CEP      cep;
+CepBench bench(cep);
+
+#ifdef ESP32
+// One registration over a new connection; returns the body size, 0 on failure
+static size_t sendDocument(CEP& cep, void*) {
+    WiFiClient client;
+    if (!client.connect(JUMPNET_HOST, JUMPNET_PORT, 1000)) return 0;
+
+    CepHashPrint measure;
+    size_t len = cep.writeCapabilities(measure);
+    client.print(F("POST /devices/register HTTP/1.1\r\nHost: "));
+    client.print(JUMPNET_HOST);
+    client.print(F("\r\nContent-Type: application/json\r\nConnection: close\r\nContent-Length: "));
+    client.print((unsigned long)len);
+    client.print(F("\r\n\r\n"));
+    size_t sent = cep.writeCapabilities(client);
+
+    // Wait for the status line so the phase covers the round trip
+    uint32_t start = millis();
+    while (!client.available() && client.connected() && millis() - start < 2000) delay(1);
+    bool ok = client.available() > 0;
+    client.stop();
+    return ok && sent == len ? sent : 0;
+}
+#endif
+
+void setup() {
+    Serial.begin(115200);
+    delay(500);
+
+    cep.useChipsets<&BME280_Chip, &SSD1306_Chip, &MPU6050_Chip>();
+
+#ifdef ESP32
+    if (strlen(WIFI_SSID) > 0) {
+        WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+        uint32_t start = millis();
+        while (WiFi.status() != WL_CONNECTED && millis() - start < 10000) delay(100);
+        if (WiFi.status() == WL_CONNECTED) bench.setNetwork(sendDocument, nullptr);
+    }
+#endif
+}
+
+void loop() {
+    bench.run(ITERATIONS);
+    bench.report(Serial);
+    Serial.println();
+    delay(30000);
+}
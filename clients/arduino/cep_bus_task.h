@@ -0,0 +1,280 @@
+/*
+ * cep_bus_task.h  —  Asynchronous I2C for CEP: scans, register transfers and
+ *                    samplers on a dedicated bus task
+ *
+ * On ESP32 a CepBusTask owns every TwoWire the CEP scan configuration uses.
+ * It runs pinned to one core (by default core 0, so loop() on core 1 never
+ * waits on the bus) and works through a queue of jobs: a full CEP scan, or a
+ * register read / write on one device. Between jobs it polls the samplers
+ * handed to it, so sampling and ad-hoc transfers never collide on a bus.
+ *
+ * A job is a caller-owned CepBusJob: submit it, then either pass a callback
+ * (runs on the bus task when the job finishes) or treat the job as a future
+ * and check ready() / wait() on it. Nothing allocates after start().
+ *
+ * Usage:
+ *   CepBusTask bus(cep);
+ *   bus.add(imu);                              // bus task polls the sampler
+ *   bus.start();
+ *
+ *   static CepBusJob scanJob;
+ *   bus.scan(scanJob);                         // returns at once
+ *   ...
+ *   if (scanJob.ready()) cep.writeCapabilities(client);   // cached scan
+ *
+ *   static uint8_t whoami;
+ *   static CepBusJob job;
+ *   bus.read(job, 0, 0x68, 0x75, &whoami, 1, onWhoAmI);   // callback style
+ *
+ * A CepHotplug given to add() is polled between jobs too, so incremental
+ * re-enumeration shares the bus with sampling instead of racing it.
+ *
+ * While a scan is pending don't build documents or call cep.found() /
+ * locate(): they read the scan result the bus task is writing. Samplers given
+ * to add() must not also run their own startTask().
+ *
+ * Other boards have no second core: jobs run inline inside the submitting
+ * call (the callback fires before it returns) and poll() drives the samplers
+ * from loop(), so the same sketch builds everywhere.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include <Wire.h>
+#include "cep.h"
+#include "cep_sampling.h"
+#include "cep_hotplug.h"
+
+#ifdef ESP32
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#endif
+
+// Jobs that can wait in the queue at once
+#ifndef CEP_BUS_QUEUE
+#define CEP_BUS_QUEUE 8
+#endif
+
+// Samplers one bus task can drive
+#ifndef CEP_BUS_SAMPLERS
+#define CEP_BUS_SAMPLERS 4
+#endif
+
+enum CepBusOp : uint8_t {
+    CEP_BUS_OP_SCAN,    // cep.rescan()
+    CEP_BUS_OP_READ,    // len bytes from reg into data
+    CEP_BUS_OP_WRITE,   // reg, then len bytes from data
+};
+
+enum CepJobStatus : int8_t {
+    CEP_JOB_OK       = 0,
+    CEP_JOB_PENDING  = 1,
+    CEP_JOB_NACK     = -1,   // device did not answer / short read
+    CEP_JOB_BAD_BUS  = -2,   // busId outside the scan configuration
+    CEP_JOB_REJECTED = -3,   // queue full or task not running
+};
+
+// One transfer. Owned by the caller and must stay alive until it completes;
+// the buffer behind data likewise. Reuse is fine once ready().
+struct CepBusJob {
+    CepBusOp     op;
+    uint8_t      busId;
+    uint8_t      address;
+    uint8_t      reg;
+    uint8_t*     data;
+    uint8_t      len;       // <= CEP_I2C_CHUNK for reads
+    void       (*done)(CepBusJob& job, void* ctx);   // optional, runs on the bus task
+    void*        ctx;
+    volatile int8_t status; // CepJobStatus
+
+    bool ready() const { return status != CEP_JOB_PENDING; }
+    bool ok() const    { return status == CEP_JOB_OK; }
+};
+
+class CepBusTask {
+public:
+    explicit CepBusTask(CEP& cep) : _cep(cep), _numSamplers(0), _hotplug(nullptr) {
+#ifdef ESP32
+        _queue    = nullptr;
+        _task     = nullptr;
+        _stopping = false;
+#endif
+    }
+
+    // Hand a sampler to the bus task (attach() and begin() it first).
+    bool add(CepSampler& sampler) {
+        if (_numSamplers >= CEP_BUS_SAMPLERS) return false;
+        _samplers[_numSamplers++] = &sampler;
+        return true;
+    }
+
+    // Hand incremental hot-plug to the bus task (one per task)
+    void add(CepHotplug& hotplug) {
+        _hotplug = &hotplug;
+    }
+
+#ifdef ESP32
+    // Start the bus task. Add samplers before this.
+    bool start(BaseType_t core = 0, UBaseType_t priority = 3, uint32_t stackBytes = 4096) {
+        if (_task) return false;
+        if (!_queue) _queue = xQueueCreate(CEP_BUS_QUEUE, sizeof(CepBusJob*));
+        if (!_queue) return false;
+        return xTaskCreatePinnedToCore(_taskLoop, "cep_bus", stackBytes, this,
+                                       priority, &_task, core) == pdPASS;
+    }
+
+    // Ask the task to exit after the jobs already queued; it deletes itself
+    // between transfers, never in the middle of one. New jobs are rejected
+    // from now on; running() stays true (and start() fails) until it is gone.
+    void stop() {
+        if (!_task || _stopping) return;
+        _stopping = true;
+        CepBusJob* quit = nullptr;
+        xQueueSend(_queue, &quit, portMAX_DELAY);
+    }
+
+    bool running() const { return _task != nullptr; }
+
+    void poll() {}   // the task does this
+#else
+    bool start() { return true; }
+    void stop()  {}
+    bool running() const { return false; }
+
+    // Drive the samplers from loop()
+    void poll() { _pollSamplers(); }
+#endif
+
+    // ── Jobs ─────────────────────────────────────────────────────────────────
+    // All return false (job.status = CEP_JOB_REJECTED, callback not called)
+    // if the queue is full or the task is not running.
+
+    bool submit(CepBusJob& job) {
+        job.status = CEP_JOB_PENDING;
+#ifdef ESP32
+        CepBusJob* p = &job;
+        if (!_task || _stopping || xQueueSend(_queue, &p, 0) != pdTRUE) {
+            job.status = CEP_JOB_REJECTED;
+            return false;
+        }
+#else
+        _run(job);
+#endif
+        return true;
+    }
+
+    // Rescan every bus; documents built after completion use the new result
+    bool scan(CepBusJob& job, void (*done)(CepBusJob&, void*) = nullptr, void* ctx = nullptr) {
+        return submit(_fill(job, CEP_BUS_OP_SCAN, 0, 0, 0, nullptr, 0, done, ctx));
+    }
+
+    bool read(CepBusJob& job, uint8_t busId, uint8_t address, uint8_t reg, uint8_t* buf,
+              uint8_t len, void (*done)(CepBusJob&, void*) = nullptr, void* ctx = nullptr) {
+        return submit(_fill(job, CEP_BUS_OP_READ, busId, address, reg, buf, len, done, ctx));
+    }
+
+    bool write(CepBusJob& job, uint8_t busId, uint8_t address, uint8_t reg, uint8_t* buf,
+               uint8_t len, void (*done)(CepBusJob&, void*) = nullptr, void* ctx = nullptr) {
+        return submit(_fill(job, CEP_BUS_OP_WRITE, busId, address, reg, buf, len, done, ctx));
+    }
+
+    // Block the calling task until job completes or timeoutMs passes; the
+    // bus task keeps running meanwhile. Returns job.ready().
+    bool wait(const CepBusJob& job, uint32_t timeoutMs = 1000) {
+        uint32_t start = millis();
+        while (!job.ready() && millis() - start < timeoutMs) {
+#ifdef ESP32
+            vTaskDelay(1);
+#else
+            yield();
+#endif
+        }
+        return job.ready();
+    }
+
+private:
+    CEP&        _cep;
+    CepSampler* _samplers[CEP_BUS_SAMPLERS];
+    uint8_t     _numSamplers;
+    CepHotplug* _hotplug;
+#ifdef ESP32
+    QueueHandle_t _queue;
+    TaskHandle_t  _task;       // cleared by the task itself as it exits
+    volatile bool _stopping;   // quit queued, task still draining
+
+    static void _taskLoop(void* arg) {
+        CepBusTask* self = (CepBusTask*)arg;
+        for (;;) {
+            // Block until a job arrives; with samplers or hot-plug attached
+            // wake every tick to poll them (cheap: poll() returns unless one
+            // is due).
+            CepBusJob* job;
+            TickType_t wait = self->_numSamplers || self->_hotplug ? 1 : portMAX_DELAY;
+            if (xQueueReceive(self->_queue, &job, wait) == pdTRUE) {
+                if (!job) break;
+                self->_run(*job);
+            }
+            self->_pollSamplers();
+        }
+        self->_stopping = false;
+        self->_task     = nullptr;
+        vTaskDelete(nullptr);
+    }
+#endif
+
+    static CepBusJob& _fill(CepBusJob& job, CepBusOp op, uint8_t busId, uint8_t address,
+                            uint8_t reg, uint8_t* data, uint8_t len,
+                            void (*done)(CepBusJob&, void*), void* ctx) {
+        job.op      = op;
+        job.busId   = busId;
+        job.address = address;
+        job.reg     = reg;
+        job.data    = data;
+        job.len     = len;
+        job.done    = done;
+        job.ctx     = ctx;
+        return job;
+    }
+
+    void _pollSamplers() {
+        for (uint8_t i = 0; i < _numSamplers; i++) _samplers[i]->poll();
+        if (_hotplug) _hotplug->poll();
+    }
+
+    void _run(CepBusJob& job) {
+        int8_t status = _transfer(job);
+#ifdef ESP32
+        __sync_synchronize();   // data visible before status, for the other core
+#endif
+        job.status = status;
+        if (job.done) job.done(job, job.ctx);
+    }
+
+    int8_t _transfer(CepBusJob& job) {
+        if (job.op == CEP_BUS_OP_SCAN) {
+            _cep.rescan();
+            return CEP_JOB_OK;
+        }
+        const CepScanConfig& scan = _cep.scanConfig();
+        if (job.busId >= scan.numBuses) return CEP_JOB_BAD_BUS;
+        const CepI2CBus& bus = scan.buses[job.busId];
+        if (bus.muxAddress) cepSelectMux(bus, (uint8_t)(1 << bus.muxChannel));
+
+        bool ok;
+        if (job.op == CEP_BUS_OP_READ) {
+            ok = cepI2CRead(*bus.wire, job.address, job.reg, job.data, job.len);
+        } else {
+            bus.wire->beginTransmission(job.address);
+            bus.wire->write(job.reg);
+            for (uint8_t i = 0; i < job.len; i++) bus.wire->write(job.data[i]);
+            ok = bus.wire->endTransmission() == 0;
+        }
+
+        // Close the channel: parts behind another mux, or on the root bus,
+        // may share the address
+        if (bus.muxAddress) cepSelectMux(bus, 0);
+        return ok ? CEP_JOB_OK : CEP_JOB_NACK;
+    }
+};
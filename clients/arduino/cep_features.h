@@ -0,0 +1,333 @@
+/*
+ * cep_features.h  —  On-device feature extraction over sampler windows
+ *
+ * A CepFeatureWindow consumes a CepSampler's ring (see cep_sampling.h),
+ * collects fixed-size windows of selected channels and reduces each window
+ * to a few numbers, so a node uploads a feature vector to POST /infer
+ * instead of raw samples. All arithmetic is integer: int64 accumulators for
+ * the statistics and a Q15 radix-2 FFT with per-stage scaling, so the same
+ * code runs on AVR, ESP32 and ESP32-S3 without an FPU or DSP library.
+ *
+ * Usage:
+ *   CepFeatureWindow<128, 3> vib(imu, 0x07);   // accel x/y/z, 128-sample windows
+ *   ...
+ *   if (vib.update()) {                        // a window just completed
+ *       vib.writeTo(client);                   // {"features":{...}}
+ *   }
+ *
+ *   CepFeatureWindow<32, 3> env(bme, 0x07, CEP_FEATURES_DELTA);
+ *
+ * Feature kinds (per selected channel, in the channel's own units):
+ *   CEP_FEATURES_STATS  mean, std (square root of the variance), rms
+ *   CEP_FEATURES_FFT    CEP_FEATURE_BANDS (at most W / 2) amplitudes over
+ *                       equal-width bands from DC to Nyquist, mean removed
+ *   CEP_FEATURES_DELTA  first value, then sample-to-sample differences:
+ *                       lossless, and small numbers for slow signals
+ *
+ * Only one consumer may pop a sampler: use either a feature window or
+ * cepWriteBatch() on it, not both.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include "cep_json.h"
+#include "cep_sampling.h"
+
+// FFT bands reported per channel
+#ifndef CEP_FEATURE_BANDS
+#define CEP_FEATURE_BANDS 8
+#endif
+
+enum CepFeatureKind : uint8_t {
+    CEP_FEATURES_STATS = 0x01,
+    CEP_FEATURES_FFT   = 0x02,
+    CEP_FEATURES_DELTA = 0x04,
+};
+
+// sin(2 pi i / 256) for i = 0..64 in Q15; the rest of the circle by symmetry
+static constexpr int16_t _cep_sin_q15[] PROGMEM = {
+        0,   804,  1608,  2410,  3212,  4011,  4808,  5602,  6393,  7179,  7962,
+     8739,  9512, 10278, 11039, 11793, 12539, 13279, 14010, 14732, 15446, 16151,
+    16846, 17530, 18204, 18868, 19519, 20159, 20787, 21403, 22005, 22594, 23170,
+    23731, 24279, 24811, 25329, 25832, 26319, 26790, 27245, 27683, 28105, 28510,
+    28898, 29268, 29621, 29956, 30273, 30571, 30852, 31113, 31356, 31580, 31785,
+    31971, 32137, 32285, 32412, 32521, 32609, 32678, 32728, 32757, 32767,
+};
+
+inline int16_t cepSinQ15(uint8_t t) {
+    if (t < 64)  return (int16_t)pgm_read_word(&_cep_sin_q15[t]);
+    if (t < 128) return (int16_t)pgm_read_word(&_cep_sin_q15[128 - t]);
+    if (t < 192) return (int16_t)-(int16_t)pgm_read_word(&_cep_sin_q15[t - 128]);
+    return (int16_t)-(int16_t)pgm_read_word(&_cep_sin_q15[256 - t]);
+}
+
+inline int16_t cepCosQ15(uint8_t t) { return cepSinQ15((uint8_t)(t + 64)); }
+
+// Integer square root, floor
+inline uint32_t cepIsqrt(uint64_t v) {
+    uint64_t root = 0;
+    uint64_t bit  = (uint64_t)1 << 62;
+    while (bit > v) bit >>= 2;
+    while (bit) {
+        if (v >= root + bit) {
+            v    -= root + bit;
+            root  = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t)root;
+}
+
+// In-place radix-2 FFT over n (power of two, <= 256) Q15 points. Every stage
+// halves its outputs, so the result is X / n and never overflows.
+inline void cepFftQ15(int16_t* re, int16_t* im, uint16_t n) {
+    for (uint16_t i = 1, j = 0; i < n; i++) {
+        uint16_t bit = n >> 1;
+        for (; j & bit; bit >>= 1) j ^= bit;
+        j ^= bit;
+        if (i < j) {
+            int16_t t = re[i]; re[i] = re[j]; re[j] = t;
+            t = im[i]; im[i] = im[j]; im[j] = t;
+        }
+    }
+    for (uint16_t len = 2; len <= n; len <<= 1) {
+        uint16_t half = len >> 1;
+        uint16_t step = 256 / len;
+        for (uint16_t i = 0; i < n; i += len) {
+            for (uint16_t k = 0; k < half; k++) {
+                int32_t c  = cepCosQ15((uint8_t)(k * step));
+                int32_t s  = -cepSinQ15((uint8_t)(k * step));   // e^(-j 2 pi k / len)
+                int16_t* ar = &re[i + k];
+                int16_t* ai = &im[i + k];
+                int16_t* br = &re[i + k + half];
+                int16_t* bi = &im[i + k + half];
+                int32_t tr = (*br * c - *bi * s) >> 15;
+                int32_t ti = (*br * s + *bi * c) >> 15;
+                int32_t ur = *ar, ui = *ai;
+                *ar = (int16_t)((ur + tr) >> 1);
+                *ai = (int16_t)((ui + ti) >> 1);
+                *br = (int16_t)((ur - tr) >> 1);
+                *bi = (int16_t)((ui - ti) >> 1);
+            }
+        }
+    }
+}
+
+// ── Feature window ────────────────────────────────────────────────────────────
+// W samples per window (power of two, 8..256), up to C channels selected by
+// channelMask (bit i = sample value i). hop samples are dropped between
+// windows: W for back-to-back windows, W / 2 for 50 % overlap.
+
+template <uint16_t W, uint8_t C = 3>
+class CepFeatureWindow {
+    static_assert(W >= 8 && W <= 256 && (W & (W - 1)) == 0, "window must be a power of two, 8..256");
+    static_assert(C >= 1 && C <= CEP_SAMPLE_CHANNELS, "channel count out of range");
+
+public:
+    CepFeatureWindow(CepSampler& src, uint8_t channelMask,
+                     uint8_t kinds = CEP_FEATURES_STATS | CEP_FEATURES_FFT, uint16_t hop = W)
+        : _src(src), _kinds(kinds), _hop(hop && hop <= W ? hop : W), _fill(0),
+          _numCh(0), _ready(false), _periodUs(0) {
+        for (uint8_t i = 0; i < CEP_SAMPLE_CHANNELS && _numCh < C; i++) {
+            if (channelMask & (1 << i)) _ch[_numCh++] = i;
+        }
+    }
+
+    // Pop queued samples until a window completes (true) or the ring is
+    // empty (false). The completed window, and so writeTo(), stays valid
+    // until the next update(); later samples wait in the ring meanwhile.
+    bool update() {
+        CepSample s;
+        while (_src.pop(s)) {
+            if (_fill == W) _slide();
+            _times[_fill] = s.timestampUs;
+            for (uint8_t c = 0; c < _numCh; c++) {
+                _win[c][_fill] = _ch[c] < s.count ? s.values[_ch[c]] : 0;
+            }
+            if (++_fill == W) {
+                _compute();
+                _ready = true;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool ready() const { return _ready; }
+
+    uint8_t channels() const        { return _numCh; }
+    int32_t mean(uint8_t c) const   { return _mean[c]; }
+    int32_t std(uint8_t c) const    { return _std[c]; }
+    int32_t rms(uint8_t c) const    { return _rms[c]; }
+    int32_t band(uint8_t c, uint8_t b) const { return _bands[c][b]; }
+    uint32_t periodUs() const       { return _periodUs; }
+
+    // Stream the last completed window for POST /infer:
+    //   {"bundleId":..,"features":{"chipset":"mpu6050","bus_id":0,
+    //    "address":"0x68","window":128,"t0_us":..,"period_us":1000,
+    //    "channels":[..],"mean":[..],"std":[..],"rms":[..],
+    //    "fft":[[band0..],..],"first":[..],"delta":[[..],..]}}
+    // bundleId may be null (server default). CEP_FORMAT_CBOR output goes to
+    // POST /infer as Content-Type: application/cbor. Returns bytes written.
+    size_t writeTo(Print& out, const char* bundleId = nullptr, CepFormat fmt = CEP_FORMAT_JSON) {
+        CepJsonWriter w(out, fmt);
+        w.beginObject();
+        if (bundleId) w.member(F("bundleId"), bundleId);
+        w.beginObject(F("features"));
+        if (_src.chipset()) {
+            w.member(F("chipset"), (const __FlashStringHelper*)pgm_read_ptr(&_src.chipset()->name));
+            w.member(F("bus_id"), (int)_src.busId());
+            w.memberHex8(F("address"), _src.address());
+        }
+        w.member(F("window"), (unsigned int)W);
+        w.member(F("t0_us"), (unsigned long)_times[0]);
+        w.member(F("period_us"), (unsigned long)_periodUs);
+
+        w.beginArray(F("channels"));
+        for (uint8_t c = 0; c < _numCh; c++) {
+            const char* name = _channelName(_ch[c]);
+            if (name) w.value((const __FlashStringHelper*)name);
+            else      w.value((int)_ch[c]);
+        }
+        w.endArray();
+
+        if (_kinds & CEP_FEATURES_STATS) {
+            _array(w, F("mean"), _mean);
+            _array(w, F("std"), _std);
+            _array(w, F("rms"), _rms);
+        }
+        if (_kinds & CEP_FEATURES_FFT) {
+            w.beginArray(F("fft"));
+            for (uint8_t c = 0; c < _numCh; c++) {
+                w.beginArray();
+                for (uint8_t b = 0; b < BANDS; b++) w.value((long)_bands[c][b]);
+                w.endArray();
+            }
+            w.endArray();
+        }
+        if (_kinds & CEP_FEATURES_DELTA) {
+            w.beginArray(F("first"));
+            for (uint8_t c = 0; c < _numCh; c++) w.value((long)_win[c][0]);
+            w.endArray();
+            w.beginArray(F("delta"));
+            for (uint8_t c = 0; c < _numCh; c++) {
+                w.beginArray();
+                for (uint16_t i = 1; i < W; i++) w.value((long)(_win[c][i] - _win[c][i - 1]));
+                w.endArray();
+            }
+            w.endArray();
+        }
+        w.endObject();
+        w.endObject();
+        return w.bytes();
+    }
+
+private:
+    // Short windows have fewer bins than CEP_FEATURE_BANDS
+    static constexpr uint8_t BANDS = CEP_FEATURE_BANDS < W / 2 ? CEP_FEATURE_BANDS : W / 2;
+    static_assert(CEP_FEATURE_BANDS >= 1, "CEP_FEATURE_BANDS must be at least 1");
+
+    CepSampler& _src;
+    uint8_t     _kinds;
+    uint16_t    _hop;
+    uint16_t    _fill;
+    uint8_t     _numCh;
+    uint8_t     _ch[C];
+    bool        _ready;
+    uint32_t    _periodUs;
+    uint32_t    _times[W];
+    int32_t     _win[C][W];
+
+    int32_t _mean[C], _std[C], _rms[C];
+    int32_t _bands[C][BANDS];
+    int16_t _re[W], _im[W];   // FFT scratch, kept off the (task) stack
+
+    template <typename K>
+    void _array(CepJsonWriter& w, K key, const int32_t* v) {
+        w.beginArray(key);
+        for (uint8_t c = 0; c < _numCh; c++) w.value((long)v[c]);
+        w.endArray();
+    }
+
+    // PROGMEM name of sample value i, or nullptr past the plugin's list
+    const char* _channelName(uint8_t i) const {
+        const char* const* names = _src.ops().channels;
+        for (uint8_t n = 0; names; n++) {
+            const char* name = (const char*)pgm_read_ptr(&names[n]);
+            if (!name || n == i) return name;
+        }
+        return nullptr;
+    }
+
+    void _compute() {
+        _periodUs = (_times[W - 1] - _times[0]) / (W - 1);
+        for (uint8_t c = 0; c < _numCh; c++) {
+            const int32_t* x = _win[c];
+            int64_t sum = 0;
+            for (uint16_t i = 0; i < W; i++) sum += x[i];
+            int32_t mean = (int32_t)(sum / (int64_t)W);
+
+            if (_kinds & CEP_FEATURES_STATS) {
+                uint64_t sq = 0, dev = 0;
+                for (uint16_t i = 0; i < W; i++) {
+                    int64_t d = (int64_t)x[i] - mean;
+                    sq  += (uint64_t)((int64_t)x[i] * x[i]);
+                    dev += (uint64_t)(d * d);
+                }
+                _mean[c] = mean;
+                _std[c]  = (int32_t)cepIsqrt(dev / W);
+                _rms[c]  = (int32_t)cepIsqrt(sq / W);
+            }
+            if (_kinds & CEP_FEATURES_FFT) _spectrum(c, mean);
+        }
+    }
+
+    // Block floating point: shift the mean-free window so its peak fills
+    // Q15, transform, then undo the shift on the band amplitudes.
+    void _spectrum(uint8_t c, int32_t mean) {
+        const int32_t* x = _win[c];
+        uint32_t peak = 0;
+        for (uint16_t i = 0; i < W; i++) {
+            int32_t d = x[i] - mean;
+            uint32_t a = (uint32_t)(d < 0 ? -d : d);
+            if (a > peak) peak = a;
+        }
+        int8_t shift = 0;                        // > 0: scaled up, < 0: down
+        while (peak && (peak << 1) < 0x8000 && shift < 16) { peak <<= 1; shift++; }
+        while (peak >= 0x8000) { peak >>= 1; shift--; }
+        for (uint16_t i = 0; i < W; i++) {
+            int32_t d = x[i] - mean;
+            _re[i] = (int16_t)(shift >= 0 ? d * (1L << shift) : d >> -shift);
+            _im[i] = 0;
+        }
+        cepFftQ15(_re, _im, W);
+
+        // Bins 0..W/2 - 1 (DC ~ 0 after mean removal) in equal bands. A
+        // sinusoid of amplitude A gives |X/W| = A / 2 in its bin, so report
+        // 2 * sqrt(sum |X/W|^2) per band: the amplitude in channel units.
+        const uint16_t per = (W / 2) / BANDS;
+        for (uint8_t b = 0; b < BANDS; b++) {
+            uint64_t energy = 0;
+            for (uint16_t k = b * per; k < (uint16_t)(b + 1) * per; k++) {
+                energy += (uint64_t)((int32_t)_re[k] * _re[k] + (int32_t)_im[k] * _im[k]);
+            }
+            uint64_t amp = (uint64_t)cepIsqrt(energy) * 2;
+            _bands[c][b] = (int32_t)(shift >= 0 ? amp >> shift : amp << -shift);
+        }
+    }
+
+    // Keep the last W - hop samples for the next window
+    void _slide() {
+        uint16_t keep = W - _hop;
+        if (keep) {
+            memmove(_times, _times + _hop, keep * sizeof(_times[0]));
+            for (uint8_t c = 0; c < _numCh; c++) {
+                memmove(_win[c], _win[c] + _hop, keep * sizeof(_win[c][0]));
+            }
+        }
+        _fill = keep;
+    }
+};
@@ -0,0 +1,208 @@
+/*
+ * cep_hotplug.h  —  Incremental I2C re-enumeration for cep.h
+ *
+ * Instead of a full rescan (126 probes per bus, ~14 ms at 100 kHz) a
+ * CepHotplug walks the scan range a few addresses per poll(), inside a time
+ * budget, and folds what it sees into CEP's cached scan. A device that
+ * appears or disappears is reported once it has read the same on `debounce`
+ * consecutive passes, so a single NACK from a busy part is not a removal.
+ * Every confirmed change makes cep.isDirty() true, and the registrar's next
+ * request is a small delta; an unchanged bus never produces traffic.
+ * As in a full scan, a mux channel does not report devices upstream of the
+ * mux (they answer on every channel).
+ *
+ * Usage:
+ *   CepHotplug hotplug(cep);
+ *   hotplug.setBudget(300);                      // us of bus time per poll()
+ *   hotplug.onChange(onDevice);                  // optional
+ *
+ *   void loop() {
+ *       hotplug.poll();                          // a few probes, never a scan
+ *       registrar.poll();                        // sends the delta
+ *   }
+ *
+ *   void onDevice(const CepHotplugEvent& e, void*) {
+ *       if (e.added && e.chipset == &BME280_Chip) { ...attach a sampler... }
+ *   }
+ *
+ * poll() does nothing until the first full scan has run (any build, or
+ * restoreSnapshot()). Call it from whatever owns the bus: with a CepBusTask
+ * running, hand it to the task instead (bus.add(hotplug)), which polls it
+ * between jobs, and pick an interval so probing leaves the bus mostly idle:
+ *   hotplug.setInterval(50);                     // a burst every 50 ms
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include <Wire.h>
+#include "cep.h"
+
+// Addresses that can be mid-debounce at once; further disagreements wait
+// for a free slot on a later pass
+#ifndef CEP_HOTPLUG_PENDING
+#define CEP_HOTPLUG_PENDING 4
+#endif
+
+struct CepHotplugEvent {
+    uint8_t                     busId;
+    uint8_t                     address;
+    bool                        added;     // false = removed
+    const CepChipsetDescriptor* chipset;   // plugin owning the address, or nullptr
+};
+
+class CepHotplug {
+public:
+    explicit CepHotplug(CEP& cep)
+        : _cep(cep), _budgetUs(500), _intervalMs(0), _lastMs(0), _debounce(2),
+          _cb(nullptr), _ctx(nullptr), _bus(0), _addr(0), _passes(0), _changes(0) {
+        memset(_pending, 0, sizeof(_pending));
+    }
+
+    // Bus time one poll() may spend; at least one address is probed per call
+    void setBudget(uint32_t us) { _budgetUs = us; }
+
+    // Minimum time between bursts; poll() returns at once in between
+    void setInterval(uint32_t ms) { _intervalMs = ms; }
+
+    // Consecutive passes a change must persist before it is reported (>= 1)
+    void setDebounce(uint8_t passes) { _debounce = passes ? passes : 1; }
+
+    void onChange(void (*cb)(const CepHotplugEvent& e, void* ctx), void* ctx = nullptr) {
+        _cb  = cb;
+        _ctx = ctx;
+    }
+
+    // millis() of the next burst; with no interval every poll() probes
+    uint32_t nextDue() const { return _lastMs + _intervalMs; }
+
+    // Completed passes over every bus, and changes reported so far
+    uint32_t passes() const  { return _passes; }
+    uint32_t changes() const { return _changes; }
+
+    // Probe the next few addresses. Returns the number of changes confirmed
+    // by this call.
+    uint8_t poll() {
+        if (!_cep.scanValid()) return 0;
+        const CepScanConfig& scan = _cep.scanConfig();
+        if (scan.numBuses == 0) return 0;
+        if (_bus >= scan.numBuses) _bus = 0;
+        if (_intervalMs) {
+            uint32_t now = millis();
+            if (now - _lastMs < _intervalMs) return 0;
+            _lastMs = now;
+        }
+
+        uint8_t  confirmed = 0;
+        uint8_t  idle      = 0;   // buses passed without a probe
+        uint32_t start     = micros();
+        const CepI2CBus* bus = &scan.buses[_bus];
+        if (bus->muxAddress) cepSelectMux(*bus, (uint8_t)(1 << bus->muxChannel));
+
+        for (bool first = true; first || micros() - start < _budgetUs; first = false) {
+            uint8_t addr = _nextAddress(scan);
+            if (!addr) {   // bus done: move on, rerouting the mux if needed
+                if (bus->muxAddress) cepSelectMux(*bus, 0);
+                if (++idle > scan.numBuses) break;   // nothing to probe anywhere
+                if (++_bus >= scan.numBuses) {
+                    _bus = 0;
+                    _passes++;
+                }
+                bus = &scan.buses[_bus];
+                if (bus->muxAddress) cepSelectMux(*bus, (uint8_t)(1 << bus->muxChannel));
+                continue;
+            }
+            idle = 0;
+            bus->wire->beginTransmission(addr);
+            bool present = bus->wire->endTransmission() == 0;
+            _cep.telemetry().probed(present);
+            if (present && bus->muxAddress && !_cep.found(_bus, addr)) {
+                present = !_upstream(*bus, addr);   // plugged in upstream since the scan
+            }
+            if (_observe(_bus, addr, present)) confirmed++;
+        }
+
+        if (bus->muxAddress) cepSelectMux(*bus, 0);
+        return confirmed;
+    }
+
+private:
+    struct Pending {
+        uint8_t busId;
+        uint8_t address;   // 0 = free slot
+        uint8_t seen;      // consecutive passes disagreeing with the scan
+    };
+
+    CEP&     _cep;
+    uint32_t _budgetUs;
+    uint32_t _intervalMs;
+    uint32_t _lastMs;
+    uint8_t  _debounce;
+    void   (*_cb)(const CepHotplugEvent&, void*);
+    void*    _ctx;
+    uint8_t  _bus;         // cursor
+    uint8_t  _addr;        // last address probed on _bus, 0 = none yet
+    uint32_t _passes;
+    uint32_t _changes;
+    Pending  _pending[CEP_HOTPLUG_PENDING];
+
+    // Next address on the cursor bus a full scan would probe, 0 at the end
+    uint8_t _nextAddress(const CepScanConfig& scan) {
+        uint16_t a = _addr < scan.firstAddress ? scan.firstAddress : _addr + 1;
+        for (; a <= scan.lastAddress; a++) {
+            if (_cep.probes(_bus, (uint8_t)a)) {
+                _addr = (uint8_t)a;
+                return _addr;
+            }
+        }
+        _addr = 0;
+        return 0;
+    }
+
+    // Whether addr answers on bus's controller with the mux's channels off
+    bool _upstream(const CepI2CBus& bus, uint8_t addr) {
+        cepSelectMux(bus, 0);
+        bus.wire->beginTransmission(addr);
+        bool acked = bus.wire->endTransmission() == 0;
+        _cep.telemetry().probed(acked);
+        cepSelectMux(bus, (uint8_t)(1 << bus.muxChannel));
+        return acked;
+    }
+
+    // Returns true when this probe confirms a change
+    bool _observe(uint8_t busId, uint8_t addr, bool present) {
+        Pending* slot = nullptr;
+        Pending* spare = nullptr;
+        for (uint8_t i = 0; i < CEP_HOTPLUG_PENDING; i++) {
+            Pending& p = _pending[i];
+            if (p.address == addr && p.busId == busId) slot = &p;
+            else if (!p.address && !spare)             spare = &p;
+        }
+
+        if (_cep.found(busId, addr) == present) {   // agrees with the scan
+            if (slot) slot->address = 0;
+            return false;
+        }
+        if (!slot) {
+            if (!spare) return false;
+            slot = spare;
+            slot->busId   = busId;
+            slot->address = addr;
+            slot->seen    = 0;
+        }
+        if (++slot->seen < _debounce) return false;
+
+        slot->address = 0;
+        _cep.setFound(busId, addr, present);
+        _changes++;
+        if (_cb) {
+            CepHotplugEvent e;
+            e.busId   = busId;
+            e.address = addr;
+            e.added   = present;
+            e.chipset = _cep.chipsetAt(addr);
+            _cb(e, _ctx);
+        }
+        return true;
+    }
+};
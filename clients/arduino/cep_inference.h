@@ -0,0 +1,354 @@
+/*
+ * cep_inference.h  —  Small int8 MLP interpreter for on-device /infer
+ *
+ * Runs a fully connected int8 network whose weights live in flash, e.g. a
+ * gesture or anomaly classifier over a CepFeatureWindow's features
+ * (cep_features.h). The engine advertises itself through the CEP compute
+ * capability ("inference":{"model","ops_per_sec",...}) and, on ESP32,
+ * CepInferServer answers POST /infer on the LAN so a JumpNet node can route
+ * lightweight feature requests to the device instead of its own runtime
+ * (server/lib/delegate.js).
+ *
+ * Usage:
+ *   #include "gesture_model.h"                 // a PROGMEM CepModel, see below
+ *   CepInference   model(&GestureModel);
+ *   CepInferServer server(model, 8080);        // ESP32
+ *
+ *   model.benchmark();                         // measure ops_per_sec once
+ *   server.begin();                            // after WiFi is up
+ *   cep.setInference(&model.info());
+ *   ...
+ *   server.poll();                             // in loop(), non-blocking
+ *   int16_t cls = model.inferFeatures(x, n);   // or call it locally
+ *
+ * Quantisation follows the usual int8 scheme: each layer accumulates int8 x
+ * int8 products plus an int32 bias, then requantises with
+ *   out = clamp((acc * multiplier) >> shift, -128, 127)
+ * and optionally a ReLU. Float feature inputs are never needed: int32
+ * features are mapped to int8 with a per-input offset and scale.
+ *
+ * A model header, as an exporter would generate it:
+ *   static constexpr int8_t  _g_w0[] PROGMEM = { ... };     // 16 x 24
+ *   static constexpr int32_t _g_b0[] PROGMEM = { ... };
+ *   ...
+ *   static constexpr CepDenseLayer _g_layers[] PROGMEM = {
+ *       { 24, 16, _g_w0, _g_b0, 1518, 16, CEP_ACT_RELU },
+ *       { 16,  4, _g_w1, _g_b1,  977, 16, CEP_ACT_NONE },
+ *   };
+ *   static constexpr char _g_id[] PROGMEM = "gesture-v1";
+ *   static constexpr CepModel GestureModel PROGMEM = {
+ *       _g_id, _g_layers, 2, _g_off, _g_scale, 8, _g_labels, 62 };
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include "cep.h"
+#include "cep_json.h"
+
+#ifdef ESP32
+#include <WiFi.h>
+#endif
+
+// Widest layer (inputs or outputs) the scratch buffers hold
+#ifndef CEP_INFER_MAX_WIDTH
+#define CEP_INFER_MAX_WIDTH 128
+#endif
+
+// Request body limit for CepInferServer
+#ifndef CEP_INFER_BODY
+#define CEP_INFER_BODY 1024
+#endif
+
+enum CepActivation : uint8_t {
+    CEP_ACT_NONE,
+    CEP_ACT_RELU,
+};
+
+// One dense layer. All pointers PROGMEM.
+struct CepDenseLayer {
+    uint16_t       inputs;
+    uint16_t       outputs;
+    const int8_t*  weights;      // outputs x inputs, row-major
+    const int32_t* bias;         // outputs, in accumulator scale
+    int32_t        multiplier;   // requantisation, see the file comment
+    uint8_t        shift;
+    CepActivation  activation;
+};
+
+// A whole network. Plain aggregate in flash, like CepChipsetDescriptor.
+struct CepModel {
+    const char*          id;            // model id, advertised in CEP
+    const CepDenseLayer* layers;
+    uint8_t              numLayers;
+    const int32_t*       inputOffset;   // per input; nullptr = 0
+    const int16_t*       inputScale;    // per input; nullptr = 1
+    uint8_t              inputShift;    // q = clamp(((x - offset) * scale) >> shift)
+    const char* const*   labels;        // one per output, or nullptr
+    uint16_t             outputScaleMilli;   // float value of one output step x 1000
+};
+
+inline int8_t cepSat8(int32_t v) {
+    return v > 127 ? 127 : (v < -128 ? -128 : (int8_t)v);
+}
+
+class CepInference {
+public:
+    explicit CepInference(const CepModel* model) : _macs(0), _lastUs(0) {
+        memcpy_P(&_m, model, sizeof(_m));
+        _info.model     = _m.id;
+        _info.opsPerSec = 0;
+        _info.port      = 0;
+        _info.inputs    = 0;
+        _info.outputs   = 0;
+        _valid = _m.numLayers > 0;
+        uint16_t prev = 0;
+        for (uint8_t i = 0; i < _m.numLayers && _valid; i++) {
+            CepDenseLayer l;
+            memcpy_P(&l, &_m.layers[i], sizeof(l));
+            if (i == 0) _info.inputs = l.inputs;
+            else if (l.inputs != prev) _valid = false;   // layers must chain
+            if (l.inputs > CEP_INFER_MAX_WIDTH || l.outputs > CEP_INFER_MAX_WIDTH) _valid = false;
+            _macs += (uint32_t)l.inputs * l.outputs;
+            prev = l.outputs;
+        }
+        _info.outputs = prev;
+    }
+
+    bool     valid() const   { return _valid; }
+    uint16_t inputs() const  { return _info.inputs; }
+    uint16_t outputs() const { return _info.outputs; }
+    uint32_t macs() const    { return _macs; }         // per inference
+    uint32_t lastUs() const  { return _lastUs; }       // duration of the last run
+
+    // For cep.setInference(); opsPerSec is filled in by benchmark()
+    CepInferenceInfo&       info()       { return _info; }
+    const CepInferenceInfo& info() const { return _info; }
+
+    // PROGMEM label of output i, or nullptr
+    const char* label(int16_t i) const {
+        if (!_m.labels || i < 0 || i >= _info.outputs) return nullptr;
+        return (const char*)pgm_read_ptr(&_m.labels[i]);
+    }
+
+    uint16_t outputScaleMilli() const { return _m.outputScaleMilli; }
+
+    // Run on an already quantised input. Writes the int8 outputs to scores
+    // (outputs() entries) if given; returns the index of the largest, or -1.
+    int16_t infer(const int8_t* input, int8_t* scores = nullptr) {
+        if (!_valid) return -1;
+        uint32_t start = micros();
+        memcpy(_a, input, _info.inputs);
+        int8_t* in  = _a;
+        int8_t* out = _b;
+        for (uint8_t i = 0; i < _m.numLayers; i++) {
+            CepDenseLayer l;
+            memcpy_P(&l, &_m.layers[i], sizeof(l));
+            _dense(l, in, out);
+            int8_t* t = in; in = out; out = t;
+        }
+        _lastUs = micros() - start;
+
+        int16_t best = 0;
+        for (uint16_t o = 0; o < _info.outputs; o++) {
+            if (in[o] > in[best]) best = (int16_t)o;
+        }
+        if (scores) memcpy(scores, in, _info.outputs);
+        return best;
+    }
+
+    // Quantise int32 features (n must equal inputs()) with the model's input
+    // offset / scale, then run
+    int16_t inferFeatures(const int32_t* x, uint16_t n, int8_t* scores = nullptr) {
+        if (!_valid || n != _info.inputs) return -1;
+        int8_t q[CEP_INFER_MAX_WIDTH];
+        for (uint16_t i = 0; i < n; i++) {
+            int64_t off   = _m.inputOffset ? (int32_t)pgm_read_dword(&_m.inputOffset[i]) : 0;
+            int64_t scale = _m.inputScale ? (int16_t)pgm_read_word(&_m.inputScale[i]) : 1;
+            q[i] = cepSat8((int32_t)(((x[i] - off) * scale) >> _m.inputShift));
+        }
+        return infer(q, scores);
+    }
+
+    // Time runs inferences on a zero input; sets and returns info().opsPerSec
+    uint32_t benchmark(uint16_t runs = 32) {
+        if (!_valid || !runs) return 0;
+        int8_t zero[CEP_INFER_MAX_WIDTH];
+        memset(zero, 0, sizeof(zero));
+        uint32_t start = micros();
+        for (uint16_t r = 0; r < runs; r++) infer(zero);
+        uint32_t us = micros() - start;
+        if (!us) us = 1;
+        _info.opsPerSec = (uint32_t)((uint64_t)_macs * 2 * runs * 1000000ULL / us);
+        return _info.opsPerSec;
+    }
+
+    // {"bundleId":"gesture-v1","output":"wave","class":2,"scores":[..],
+    //  "score_scale_milli":62,"elapsedUs":180}
+    size_t writeResult(Print& out, int16_t cls, const int8_t* scores,
+                       CepFormat fmt = CEP_FORMAT_JSON) const {
+        CepJsonWriter w(out, fmt);
+        w.beginObject();
+        w.member(F("bundleId"), (const __FlashStringHelper*)_m.id);
+        const char* name = label(cls);
+        if (name) w.member(F("output"), (const __FlashStringHelper*)name);
+        else      w.member(F("output"), (int)cls);
+        w.member(F("class"), (int)cls);
+        if (scores) {
+            w.beginArray(F("scores"));
+            for (uint16_t o = 0; o < _info.outputs; o++) w.value((int)scores[o]);
+            w.endArray();
+        }
+        w.member(F("score_scale_milli"), (unsigned int)_m.outputScaleMilli);
+        w.member(F("elapsedUs"), (unsigned long)_lastUs);
+        w.endObject();
+        return w.bytes();
+    }
+
+private:
+    CepModel         _m;       // SRAM copy of the flash header
+    CepInferenceInfo _info;
+    uint32_t         _macs;
+    uint32_t         _lastUs;
+    bool             _valid;
+    int8_t           _a[CEP_INFER_MAX_WIDTH];   // ping-pong activations
+    int8_t           _b[CEP_INFER_MAX_WIDTH];
+
+    static void _dense(const CepDenseLayer& l, const int8_t* in, int8_t* out) {
+        const int8_t* row = l.weights;
+        for (uint16_t o = 0; o < l.outputs; o++, row += l.inputs) {
+            int32_t acc = l.bias ? (int32_t)pgm_read_dword(&l.bias[o]) : 0;
+            for (uint16_t i = 0; i < l.inputs; i++) {
+                acc += (int32_t)(int8_t)pgm_read_byte(&row[i]) * in[i];
+            }
+            int32_t v = (int32_t)(((int64_t)acc * l.multiplier) >> l.shift);
+            if (l.activation == CEP_ACT_RELU && v < 0) v = 0;
+            out[o] = cepSat8(v);
+        }
+    }
+};
+
+// ── LAN endpoint (ESP32) ──────────────────────────────────────────────────────
+// POST /infer with {"input":[x0, x1, ...]}: int32 features in the model's
+// input order, quantised on the device. Answers with writeResult(). One
+// connection at a time; poll() never blocks on a slow client.
+
+#ifdef ESP32
+class CepInferServer {
+public:
+    CepInferServer(CepInference& engine, uint16_t port = 8080, uint32_t timeoutMs = 2000)
+        : _engine(engine), _server(port), _port(port), _timeoutMs(timeoutMs) {
+        _reset();
+    }
+
+    // Start listening and advertise the port in the engine's CEP info
+    void begin() {
+        _server.begin();
+        _engine.info().port = _port;
+    }
+
+    void poll() {
+        if (!_client) {
+            _client = _server.available();
+            if (!_client) return;
+            _reset();
+            _startMs = millis();
+        }
+        if (millis() - _startMs > _timeoutMs || !_client.connected()) {
+            _client.stop();
+            return;
+        }
+        while (_client.available()) {
+            char c = (char)_client.read();
+            if (_inHeaders) {
+                if (c == '\r') continue;
+                if (c != '\n') {
+                    if (_lineLen < sizeof(_line) - 1) _line[_lineLen++] = c;
+                    continue;
+                }
+                _line[_lineLen] = '\0';
+                if (_lineLen == 0) {
+                    _inHeaders = false;
+                    if (!_isPost)                         return _finish(404);
+                    if (_contentLength == 0)              return _finish(400);
+                    if (_contentLength >= CEP_INFER_BODY) return _finish(413);
+                } else {
+                    _header();
+                }
+                _lineLen = 0;
+                continue;
+            }
+            _body[_bodyLen++] = c;
+            if (_bodyLen == _contentLength) {
+                _body[_bodyLen] = '\0';
+                return _respond();
+            }
+        }
+    }
+
+private:
+    CepInference& _engine;
+    WiFiServer    _server;
+    WiFiClient    _client;
+    uint16_t      _port;
+    uint32_t      _timeoutMs;
+    uint32_t      _startMs;
+    bool          _inHeaders;
+    bool          _isPost;
+    char          _line[96];
+    uint8_t       _lineLen;
+    uint16_t      _contentLength;
+    uint16_t      _bodyLen;
+    char          _body[CEP_INFER_BODY];
+
+    void _reset() {
+        _inHeaders     = true;
+        _isPost        = false;
+        _lineLen       = 0;
+        _contentLength = 0;
+        _bodyLen       = 0;
+    }
+
+    void _header() {
+        if (strncmp(_line, "POST /infer ", 12) == 0) {
+            _isPost = true;
+        } else if (strncasecmp(_line, "Content-Length:", 15) == 0) {
+            _contentLength = (uint16_t)atoi(_line + 15);
+        }
+    }
+
+    // Parse "input":[...] into int32 features and run the model
+    void _respond() {
+        int32_t x[CEP_INFER_MAX_WIDTH];
+        uint16_t n = 0;
+        const char* p = strstr(_body, "\"input\"");
+        p = p ? strchr(p, '[') : nullptr;
+        if (!p) return _finish(400);
+        p++;
+        while (*p && *p != ']') {
+            char* end;
+            long v = strtol(p, &end, 10);
+            if (end == p || n >= CEP_INFER_MAX_WIDTH) return _finish(400);
+            x[n++] = (int32_t)v;
+            p = end;
+            while (*p == ' ' || *p == ',' || *p == '\n' || *p == '\r' || *p == '\t') p++;
+        }
+        if (*p != ']' || n != _engine.inputs()) return _finish(400);
+
+        int8_t  scores[CEP_INFER_MAX_WIDTH];
+        int16_t cls = _engine.inferFeatures(x, n, scores);
+        _client.print(F("HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nConnection: close\r\n\r\n"));
+        _engine.writeResult(_client, cls, scores);
+        _client.stop();
+    }
+
+    void _finish(int status) {
+        _client.print(F("HTTP/1.1 "));
+        _client.print(status);
+        _client.print(status == 404 ? F(" Not Found") : status == 413 ? F(" Payload Too Large")
+                                                                      : F(" Bad Request"));
+        _client.print(F("\r\nContent-Length: 0\r\nConnection: close\r\n\r\n"));
+        _client.stop();
+    }
+};
+#endif
@@ -0,0 +1,522 @@
+/*
+ * cep_json.h  —  Minimal streaming JSON / CBOR emitter used by cep.h
+ *
+ * Writes straight to a Print sink and keeps only a few bytes of state:
+ * a nesting depth and one "has items" bit per level for comma placement.
+ * Never allocates.
+ *
+ * The same calls can produce CBOR (RFC 8949) instead of JSON for ble/lora
+ * transports: containers become indefinite-length maps/arrays, well-known
+ * keys (CEP_CBOR_KEYS) become small integers, well-known values of
+ * enumeration fields (CEP_CBOR_VALUES) become small integers too, and "0x.."
+ * addresses become plain unsigned integers. server/lib/cepRegistry.js maps
+ * them back.
+ *
+ * Usage:
+ *   CepJsonWriter w(Serial);
+ *   w.beginObject();
+ *   w.member("type", "sensor");
+ *   w.key("provides"); w.beginArray(); w.value("temperature"); w.endArray();
+ *   w.endObject();
+ *
+ * Keys and string values may also be flash strings (F("...") or PROGMEM
+ * arrays cast to __FlashStringHelper*); they are escaped and emitted straight
+ * from flash without an SRAM copy.
+ *
+ * Nesting is limited to CepJsonWriter::MAX_DEPTH levels.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+
+// ── Print sinks ───────────────────────────────────────────────────────────────
+
+// Writes into a caller-supplied buffer. Output past the buffer is counted but
+// dropped, so total() reports the size needed even when truncated.
+class CepBufferPrint : public Print {
+public:
+    CepBufferPrint(char* buf, size_t cap) : _buf(buf), _cap(cap), _len(0) {}
+
+    size_t write(uint8_t c) override {
+        if (_len + 1 < _cap) _buf[_len] = (char)c;
+        _len++;
+        return 1;
+    }
+
+    size_t write(const uint8_t* data, size_t n) override {
+        for (size_t i = 0; i < n; i++) write(data[i]);
+        return n;
+    }
+
+    // NUL-terminate whatever fits. Safe to call with cap == 0.
+    void terminate() {
+        if (_cap == 0) return;
+        _buf[_len < _cap ? _len : _cap - 1] = '\0';
+    }
+
+    size_t total() const { return _len; }
+
+private:
+    char*  _buf;
+    size_t _cap;
+    size_t _len;
+};
+
+// 32-bit FNV-1a over every byte passing through, optionally forwarding to a
+// downstream sink. With no downstream it is a zero-cost "measure and hash" pass.
+class CepHashPrint : public Print {
+public:
+    static const uint32_t FNV_OFFSET = 2166136261UL;
+    static const uint32_t FNV_PRIME  = 16777619UL;
+
+    explicit CepHashPrint(Print* next = nullptr)
+        : _next(next), _hash(FNV_OFFSET), _len(0) {}
+
+    size_t write(uint8_t c) override {
+        _hash = (_hash ^ c) * FNV_PRIME;
+        _len++;
+        return _next ? _next->write(c) : 1;
+    }
+
+    size_t write(const uint8_t* data, size_t n) override {
+        for (size_t i = 0; i < n; i++) _hash = (_hash ^ data[i]) * FNV_PRIME;
+        _len += n;
+        return _next ? _next->write(data, n) : n;
+    }
+
+    uint32_t hash() const { return _hash; }
+    size_t total() const  { return _len; }
+
+private:
+    Print*   _next;
+    uint32_t _hash;
+    size_t   _len;
+};
+
+// Hashes each top-level element of a document separately (FNV-1a, as
+// CepHashPrint), for delta updates. The producer calls mark() before each
+// element and close() after the last; an element that emits nothing is not
+// counted. Bytes outside elements go to a single header hash. Elements past
+// cap are counted but not hashed (overflowed()).
+//
+// With forwardOnly(i) set, only the bytes of element i reach the downstream
+// sink, minus the leading JSON comma, so one element can be cut out of a
+// full document pass.
+class CepSectionPrint : public Print {
+public:
+    static const uint8_t HEADER = 0xFF;
+
+    CepSectionPrint(uint32_t* hashes, uint8_t cap, Print* next = nullptr)
+        : _next(next), _hashes(hashes), _header(CepHashPrint::FNV_OFFSET),
+          _scratch(0), _cap(cap), _count(0), _current(HEADER), _only(-1),
+          _pending(false), _first(false), _json(false), _forwarded(0) {}
+
+    void forwardOnly(uint8_t index, bool json) {
+        _only = index;
+        _json = json;
+    }
+
+    void mark()  { _pending = true; }
+    void close() { _pending = false; _current = HEADER; }
+
+    size_t write(uint8_t c) override {
+        if (_pending) {
+            _pending = false;
+            _first   = true;
+            _current = _count < HEADER - 1 ? _count++ : (uint8_t)(HEADER - 1);
+            if (_current < _cap) _hashes[_current] = CepHashPrint::FNV_OFFSET;
+        }
+        uint32_t& h = _current == HEADER ? _header
+                    : _current < _cap    ? _hashes[_current]
+                    :                      _scratch;
+        h = (h ^ c) * CepHashPrint::FNV_PRIME;
+
+        bool first = _first;
+        _first = false;
+        if (!_next) return 1;
+        if (_only >= 0) {
+            if (_current != _only) return 1;
+            if (first && _json && c == ',') return 1;
+        }
+        _forwarded++;
+        return _next->write(c);
+    }
+
+    size_t write(const uint8_t* data, size_t n) override {
+        for (size_t i = 0; i < n; i++) write(data[i]);
+        return n;
+    }
+
+    uint8_t  count() const      { return _count; }
+    bool     overflowed() const { return _count > _cap; }
+    uint32_t headerHash() const { return _header; }
+    size_t   forwarded() const  { return _forwarded; }
+
+private:
+    Print*    _next;
+    uint32_t* _hashes;
+    uint32_t  _header;
+    uint32_t  _scratch;
+    uint8_t   _cap;
+    uint8_t   _count;
+    uint8_t   _current;
+    int16_t   _only;
+    bool      _pending;
+    bool      _first;
+    bool      _json;
+    size_t    _forwarded;
+};
+
+// ── Scratch arena ─────────────────────────────────────────────────────────────
+
+// Bump allocator over caller-owned memory (static, or RTC/PSRAM), for the
+// scratch a plugin needs while it describes itself (see
+// CepJsonWriter::arena()). CEP releases everything taken during a build at
+// the end of that build by rewinding to a mark, so nothing is ever freed
+// piecemeal and the global heap is never touched.
+//
+//   static CepStaticArena<512> scratch;
+//   cep.setArena(&scratch);
+class CepArena {
+public:
+    CepArena(void* buf, size_t cap)
+        : _buf((uint8_t*)buf), _cap(cap), _used(0), _peak(0), _failures(0) {}
+
+    // n bytes aligned to `align` (a power of two), or nullptr when the arena
+    // is exhausted
+    void* alloc(size_t n, size_t align = sizeof(void*)) {
+        size_t at = (_used + align - 1) & ~(align - 1);
+        if (at > _cap || n > _cap - at) {
+            _failures++;
+            return nullptr;
+        }
+        _used = at + n;
+        if (_used > _peak) _peak = _used;
+        return _buf + at;
+    }
+
+    // mark()/release(): give back everything allocated since the mark, O(1)
+    size_t mark() const          { return _used; }
+    void   release(size_t mark)  { if (mark < _used) _used = mark; }
+    void   reset()               { _used = 0; }
+
+    size_t   capacity() const    { return _cap; }
+    size_t   used() const        { return _used; }
+    size_t   peak() const        { return _peak; }       // high-water mark, for sizing
+    uint32_t failures() const    { return _failures; }   // allocations refused
+
+private:
+    uint8_t* _buf;
+    size_t   _cap;
+    size_t   _used;
+    size_t   _peak;
+    uint32_t _failures;
+};
+
+// A CepArena with its own storage
+template <size_t N>
+class CepStaticArena : public CepArena {
+public:
+    CepStaticArena() : CepArena(_storage, N) {}
+
+private:
+    alignas(8) uint8_t _storage[N];
+};
+
+// ── CBOR key table ────────────────────────────────────────────────────────────
+
+enum CepFormat : uint8_t {
+    CEP_FORMAT_JSON,
+    CEP_FORMAT_CBOR,
+};
+
+// Well-known keys, NUL-separated; a key's CBOR encoding is its index here.
+// The first 24 take a single byte. APPEND ONLY — the server keeps the same
+// list (CEP_CBOR_KEYS in server/lib/cepRegistry.js).
+static const char CEP_CBOR_KEYS[] PROGMEM =
+    "device\0" "capabilities\0" "id\0" "class\0" "transport\0" "model\0"
+    "firmware\0" "type\0" "mhz\0" "ram_kb\0" "flash_kb\0" "buses\0"
+    "sda\0" "scl\0" "freq_hz\0" "devices_found\0" "chipset\0" "bus\0"
+    "bus_id\0" "address\0" "provides\0" "digital_out\0" "digital_in\0" "pins\0"
+    "resolution\0" "channels\0" "interfaces\0" "kind\0" "mac\0" "mux\0"
+    "mux_channel\0" "width_px\0" "height_px\0" "color\0" "sensors\0" "t0_us\0"
+    "samples\0" "inference\0" "ops_per_sec\0" "inputs\0" "outputs\0" "port\0"
+    "mosi\0" "miso\0" "sck\0" "cs\0" "ports\0" "rx\0" "tx\0" "baud\0"
+    "uptime_s\0" "scans\0" "scan_us\0" "scan_max_us\0" "i2c_probes\0" "i2c_nacks\0"
+    "builds\0" "build_us\0" "build_max_us\0" "bytes_out\0" "heap_peak_b\0"
+    "heap_min_free_b\0" "heap_max_block_b\0" "reg_ok\0" "reg_failures\0" "reg_ms\0"
+    "reg_max_ms\0" "bundleId\0" "features\0" "window\0" "period_us\0" "mean\0"
+    "std\0" "rms\0" "fft\0" "first\0" "delta\0";
+
+// Well-known values, integer-encoded only under the enumeration keys type,
+// class, transport, bus, kind and provides. APPEND ONLY, as above.
+static const char CEP_CBOR_VALUES[] PROGMEM =
+    "compute\0" "i2c\0" "spi\0" "uart\0" "sensor\0" "display\0" "gpio\0" "adc\0"
+    "network\0" "microcontroller\0" "serial\0" "usb\0" "ble\0" "lora\0" "wifi\0"
+    "ethernet\0" "temperature\0" "humidity\0" "pressure\0" "acceleration\0"
+    "gyroscope\0" "computer\0" "sensor-node\0" "neopixel\0" "telemetry\0";
+
+// ── Writer ────────────────────────────────────────────────────────────────────
+
+class CepJsonWriter {
+public:
+    static const uint8_t MAX_DEPTH = 31;
+
+    explicit CepJsonWriter(Print& out, CepFormat fmt = CEP_FORMAT_JSON)
+        : _out(out), _bytes(0), _fmt(fmt), _depth(0), _hasItems(0), _afterKey(false),
+          _enumCtx(false), _arena(nullptr) {}
+
+    CepFormat format() const { return _fmt; }
+
+    // Scratch for whoever writes through this writer, released when the
+    // document is done. nullptr when the owner has no arena: allocate on the
+    // stack or skip the optional output then, never from the heap.
+    CepArena* arena() const         { return _arena; }
+    void      setArena(CepArena* a) { _arena = a; }
+
+    // ── Containers ──────────────────────────────────────────────────────────
+
+    void beginObject() { _open('{', 0xBF); }
+    void endObject()   { _close('}'); }
+    void beginArray()  { _open('[', 0x9F); }
+    void endArray()    { _close(']'); }
+
+    void beginObject(const char* k) { key(k); beginObject(); }
+    void beginArray(const char* k)  { key(k); beginArray(); }
+    void beginObject(const __FlashStringHelper* k) { key(k); beginObject(); }
+    void beginArray(const __FlashStringHelper* k)  { key(k); beginArray(); }
+
+    // ── Keys and scalar values ──────────────────────────────────────────────
+
+    void key(const char* k)                { _key(k, false); }
+    void key(const __FlashStringHelper* k) { _key((const char*)k, true); }
+
+    void value(const char* s)                { _separator(); _stringValue(s, false); }
+    void value(const __FlashStringHelper* s) { _separator(); _stringValue((const char*)s, true); }
+
+    void value(bool b) {
+        _separator();
+        if (_fmt == CEP_FORMAT_CBOR) _put(b ? 0xF5 : 0xF4);
+        else                         _raw(b ? "true" : "false");
+    }
+
+    void value(int v)           { value((long)v); }
+    void value(unsigned int v)  { value((unsigned long)v); }
+
+    void value(long v) {
+        _separator();
+        if (_fmt == CEP_FORMAT_CBOR) {
+            if (v < 0) _cborHead(1, (uint32_t)(-1 - v));
+            else       _cborHead(0, (uint32_t)v);
+        } else {
+            _bytes += _out.print(v);
+        }
+    }
+
+    void value(unsigned long v) {
+        _separator();
+        if (_fmt == CEP_FORMAT_CBOR) _cborHead(0, (uint32_t)v);
+        else                         _bytes += _out.print(v);
+    }
+
+    // I2C-style address: "0x3c" in JSON, a plain unsigned integer in CBOR
+    void hex8(uint8_t v) {
+        static const char digits[] = "0123456789abcdef";
+        _separator();
+        if (_fmt == CEP_FORMAT_CBOR) {
+            _cborHead(0, v);
+            return;
+        }
+        _put('"'); _put('0'); _put('x');
+        _put(digits[v >> 4]); _put(digits[v & 0x0f]);
+        _put('"');
+    }
+
+    void intArray(const uint8_t* v, size_t n) {
+        beginArray();
+        for (size_t i = 0; i < n; i++) value((unsigned int)v[i]);
+        endArray();
+    }
+
+    // Same, for a PROGMEM array
+    void intArrayP(const uint8_t* v, size_t n) {
+        beginArray();
+        for (size_t i = 0; i < n; i++) value((unsigned int)pgm_read_byte(&v[i]));
+        endArray();
+    }
+
+    // ── key/value shorthands ────────────────────────────────────────────────
+
+    template <typename K, typename T>
+    void member(K k, T v) { key(k); value(v); }
+
+    template <typename K>
+    void memberHex8(K k, uint8_t v) { key(k); hex8(v); }
+
+    template <typename K>
+    void memberIntArray(K k, const uint8_t* v, size_t n) { key(k); intArray(v, n); }
+
+    template <typename K>
+    void memberIntArrayP(K k, const uint8_t* v, size_t n) { key(k); intArrayP(v, n); }
+
+    // The caller writes exactly one complete value straight to the sink next
+    // (e.g. an element cut out of another document by CepSectionPrint).
+    void valueFollows() { _separator(); }
+
+    // One complete value already encoded in this writer's format (e.g. a
+    // memoized fragment): emitted as is, in place of the calls that made it
+    void rawValue(const uint8_t* data, size_t n) {
+        _separator();
+        _bytes += _out.write(data, n);
+    }
+
+    size_t bytes() const { return _bytes; }
+
+private:
+    Print&    _out;
+    size_t    _bytes;
+    CepFormat _fmt;
+    uint8_t   _depth;
+    uint32_t  _hasItems;   // bit d set once level d has emitted an element
+    bool      _afterKey;
+    bool      _enumCtx;    // CBOR: last key was an enumeration field
+    CepArena* _arena;
+
+    // CEP_CBOR_KEYS ids whose string values may come from CEP_CBOR_VALUES
+    static bool _isEnumKey(int id) {
+        return id == 3 /* class */ || id == 4 /* transport */ || id == 7 /* type */ ||
+               id == 17 /* bus */ || id == 20 /* provides */ || id == 27 /* kind */;
+    }
+
+    void _put(uint8_t c) { _bytes += _out.write(c); }
+
+    void _raw(const char* s) { _bytes += _out.print(s); }
+
+    // CBOR initial byte + argument, shortest form
+    void _cborHead(uint8_t major, uint32_t v) {
+        major <<= 5;
+        if (v < 24) {
+            _put((uint8_t)(major | v));
+        } else if (v <= 0xFF) {
+            _put((uint8_t)(major | 24));
+            _put((uint8_t)v);
+        } else if (v <= 0xFFFF) {
+            _put((uint8_t)(major | 25));
+            _put((uint8_t)(v >> 8));
+            _put((uint8_t)v);
+        } else {
+            _put((uint8_t)(major | 26));
+            _put((uint8_t)(v >> 24));
+            _put((uint8_t)(v >> 16));
+            _put((uint8_t)(v >> 8));
+            _put((uint8_t)v);
+        }
+    }
+
+    // Index of k in a NUL-separated PROGMEM table, or -1
+    static int _tableId(const char* table, const char* k, bool progmem) {
+        const char* entry = table;
+        for (int id = 0; pgm_read_byte(entry); id++) {
+            const char* a = entry;
+            const char* b = k;
+            for (;;) {
+                char ca = (char)pgm_read_byte(a);
+                char cb = progmem ? (char)pgm_read_byte(b) : *b;
+                if (ca != cb) break;
+                if (!ca) return id;
+                a++;
+                b++;
+            }
+            while (pgm_read_byte(entry)) entry++;
+            entry++;
+        }
+        return -1;
+    }
+
+    void _key(const char* k, bool progmem) {
+        _separator();
+        if (_fmt == CEP_FORMAT_CBOR) {
+            int id = _tableId(CEP_CBOR_KEYS, k, progmem);
+            if (id >= 0) _cborHead(0, (uint32_t)id);
+            else         _string(k, progmem);
+            _enumCtx = _isEnumKey(id);
+        } else {
+            _string(k, progmem);
+            _put(':');
+        }
+        _afterKey = true;
+    }
+
+    // Emit a comma unless this is the first element at the current level or
+    // the value directly follows its key. CBOR needs no separators.
+    void _separator() {
+        if (_afterKey) {
+            _afterKey = false;
+            return;
+        }
+        uint32_t bit = (uint32_t)1 << _depth;
+        if ((_hasItems & bit) && _fmt == CEP_FORMAT_JSON) _put(',');
+        _hasItems |= bit;
+    }
+
+    void _open(char json, uint8_t cbor) {
+        _separator();
+        _put(_fmt == CEP_FORMAT_CBOR ? cbor : (uint8_t)json);
+        if (_depth < MAX_DEPTH) _depth++;
+        _hasItems &= ~((uint32_t)1 << _depth);
+    }
+
+    void _close(char json) {
+        _enumCtx = false;
+        if (_depth > 0) _depth--;
+        _put(_fmt == CEP_FORMAT_CBOR ? (uint8_t)0xFF : (uint8_t)json);   // CBOR "break"
+    }
+
+    void _stringValue(const char* s, bool progmem) {
+        if (_fmt == CEP_FORMAT_CBOR && _enumCtx && s) {
+            int id = _tableId(CEP_CBOR_VALUES, s, progmem);
+            if (id >= 0) {
+                _cborHead(0, (uint32_t)id);
+                return;
+            }
+        }
+        _string(s, progmem);
+    }
+
+    void _string(const char* s, bool progmem) {
+        static const char digits[] = "0123456789abcdef";
+        if (!s) {
+            if (_fmt == CEP_FORMAT_CBOR) _put((uint8_t)0xF6);
+            else                         _raw("null");
+            return;
+        }
+        if (_fmt == CEP_FORMAT_CBOR) {
+            size_t n = progmem ? strlen_P(s) : strlen(s);
+            _cborHead(3, (uint32_t)n);
+            for (size_t i = 0; i < n; i++) _put((uint8_t)(progmem ? pgm_read_byte(s + i) : s[i]));
+            return;
+        }
+        _put('"');
+        for (;; s++) {
+            char c = progmem ? (char)pgm_read_byte(s) : *s;
+            if (!c) break;
+            switch (c) {
+                case '"':  _put('\\'); _put('"');  break;
+                case '\\': _put('\\'); _put('\\'); break;
+                case '\n': _put('\\'); _put('n');  break;
+                case '\r': _put('\\'); _put('r');  break;
+                case '\t': _put('\\'); _put('t');  break;
+                default:
+                    if ((uint8_t)c < 0x20) {
+                        _put('\\'); _put('u'); _put('0'); _put('0');
+                        _put(digits[(uint8_t)c >> 4]);
+                        _put(digits[c & 0x0f]);
+                    } else {
+                        _put(c);
+                    }
+            }
+        }
+        _put('"');
+    }
+};
@@ -0,0 +1,300 @@
+/*
+ * cep_probes.h  —  SPI and UART enumeration for cep.h
+ *
+ * I2C devices are found by address; SPI and UART devices are not, so each of
+ * these buses gets a CepBusProbe that CEP runs with every scan (on ESP32 each
+ * probe on its own task, concurrently with the I2C scan):
+ *
+ *   CepSpiProbe  reads an identification register (WHO_AM_I, chip id) behind
+ *                every listed chip-select pin and matches the answer against
+ *                a table of chipset plugins.
+ *   CepUartProbe tries a list of baud rates on one port, optionally sending
+ *                a query, until the expected reply arrives (autobaud).
+ *
+ * Usage:
+ *   static constexpr CepSpiId spiIds[] PROGMEM = {
+ *       { &BME280_Chip, 0xD0, 0x60, SPI_MODE0 },   // chip id, read bit set
+ *       { nullptr, 0, 0, 0 },
+ *   };
+ *   CepSpiProbe spi(SPI, 18, 19, 23, spiIds);    // SCK, MISO, MOSI
+ *   spi.addCs(5);
+ *   spi.addCs(17);
+ *
+ *   CepUartProbe gps(Serial2, 16, 17, nullptr, PSTR("$G"));   // NMEA talker
+ *
+ *   cep.addProbe(spi);
+ *   cep.addProbe(gps);
+ *
+ * Each probe adds its bus element ({"type":"spi",..} / {"type":"uart",..})
+ * and a sensor element per identified device, with bus "spi" and the chip
+ * select as "cs", or bus "uart" and the detected "baud". Descriptors are
+ * shared with I2C plugins; only the name and provides list are used.
+ *
+ * A probe owns its controller while it scans: don't use the SPI bus or the
+ * UART from elsewhere during cep.rescan(). A UART probe leaves the port open
+ * at the detected rate (or ends it when nothing answered).
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include <SPI.h>
+#include "cep.h"
+
+// Chip-select pins one SPI probe can check
+#ifndef CEP_SPI_MAX_CS
+#define CEP_SPI_MAX_CS 8
+#endif
+
+// How a part on SPI identifies itself. Lists are PROGMEM and end with a null
+// chip.
+struct CepSpiId {
+    const CepChipsetDescriptor* chip;
+    uint8_t                     reg;     // register address including the read bit
+    uint8_t                     value;   // expected answer
+    uint8_t                     mode;    // SPI_MODE0 .. SPI_MODE3
+};
+
+// Sensor element shared by both probes: the plugin's name and provides, with
+// the bus-specific location written by the caller before endObject()
+inline void cepWriteBusSensor(CepJsonWriter& w, const CepChipsetDescriptor* chip,
+                              const char* bus, uint8_t busId) {
+    w.beginObject();
+    w.member(F("type"), F("sensor"));
+    w.member(F("chipset"), (const __FlashStringHelper*)pgm_read_ptr(&chip->name));
+    w.member(F("bus"), (const __FlashStringHelper*)bus);
+    w.member(F("bus_id"), (int)busId);
+    w.beginArray(F("provides"));
+    const char* const* p = (const char* const*)pgm_read_ptr(&chip->provides);
+    for (; ; p++) {
+        const char* measure = (const char*)pgm_read_ptr(p);
+        if (!measure) break;
+        w.value((const __FlashStringHelper*)measure);
+    }
+    w.endArray();
+}
+
+// ── SPI ───────────────────────────────────────────────────────────────────────
+
+class CepSpiProbe : public CepBusProbe {
+public:
+    // ids: PROGMEM CepSpiId list. busId numbers this controller in the
+    // document when a board has several.
+    CepSpiProbe(SPIClass& spi, int8_t sck, int8_t miso, int8_t mosi, const CepSpiId* ids,
+                uint8_t busId = 0, uint32_t clockHz = 1000000)
+        : _spi(spi), _ids(ids), _clockHz(clockHz), _sck(sck), _miso(miso), _mosi(mosi),
+          _busId(busId), _numCs(0) {
+        ops = _opsTable();
+        memset(_found, 0, sizeof(_found));
+    }
+
+    // Check a chip-select pin with every scan. false when CEP_SPI_MAX_CS are
+    // listed.
+    bool addCs(uint8_t pin) {
+        if (_numCs >= CEP_SPI_MAX_CS) return false;
+        _cs[_numCs++] = pin;
+        return true;
+    }
+
+    uint8_t numCs() const       { return _numCs; }
+    uint8_t cs(uint8_t i) const { return _cs[i]; }
+
+    // Plugin identified behind chip select i by the last scan, or nullptr
+    const CepChipsetDescriptor* chipsetAt(uint8_t i) const {
+        return i < _numCs ? _found[i] : nullptr;
+    }
+
+private:
+    SPIClass&       _spi;
+    const CepSpiId* _ids;
+    uint32_t        _clockHz;
+    int8_t          _sck, _miso, _mosi;
+    uint8_t         _busId;
+    uint8_t         _numCs;
+    uint8_t         _cs[CEP_SPI_MAX_CS];
+    const CepChipsetDescriptor* _found[CEP_SPI_MAX_CS];
+
+    static const CepProbeOps* _opsTable() {
+        static const CepProbeOps table PROGMEM = { &_scan, &_element };
+        return &table;
+    }
+
+    uint8_t _read(uint8_t cs, const CepSpiId& id) {
+        _spi.beginTransaction(SPISettings(_clockHz, MSBFIRST, id.mode));
+        digitalWrite(cs, LOW);
+        _spi.transfer(id.reg);
+        uint8_t v = _spi.transfer(0);
+        digitalWrite(cs, HIGH);
+        _spi.endTransaction();
+        return v;
+    }
+
+    static void _scan(CepBusProbe& base) {
+        CepSpiProbe& p = static_cast<CepSpiProbe&>(base);
+#ifdef ESP32
+        p._spi.begin(p._sck, p._miso, p._mosi, -1);
+#else
+        p._spi.begin();
+#endif
+        // Deselect everything before the first transfer, so only one part
+        // ever drives MISO
+        for (uint8_t c = 0; c < p._numCs; c++) {
+            pinMode(p._cs[c], OUTPUT);
+            digitalWrite(p._cs[c], HIGH);
+        }
+        for (uint8_t c = 0; c < p._numCs; c++) {
+            p._found[c] = nullptr;
+            for (const CepSpiId* e = p._ids; e; e++) {
+                CepSpiId id;
+                memcpy_P(&id, e, sizeof(id));
+                if (!id.chip) break;
+                if (p._read(p._cs[c], id) == id.value) {
+                    p._found[c] = id.chip;
+                    break;
+                }
+            }
+        }
+    }
+
+    // Element 0 is the bus, then one per identified chip select
+    static bool _element(const CepBusProbe& base, uint8_t i, CepJsonWriter& w) {
+        const CepSpiProbe& p = static_cast<const CepSpiProbe&>(base);
+        if (i == 0) {
+            w.beginObject();
+            w.member(F("type"), F("spi"));
+            w.beginArray(F("buses"));
+            w.beginObject();
+            w.member(F("id"), (int)p._busId);
+            w.member(F("mosi"), (int)p._mosi);
+            w.member(F("miso"), (int)p._miso);
+            w.member(F("sck"), (int)p._sck);
+            w.member(F("freq_hz"), (unsigned long)p._clockHz);
+            w.memberIntArray(F("cs"), p._cs, p._numCs);
+            w.endObject();
+            w.endArray();
+            w.endObject();
+            return true;
+        }
+        for (uint8_t c = 0; c < p._numCs; c++) {
+            if (!p._found[c] || --i) continue;
+            cepWriteBusSensor(w, p._found[c], CEP_BUS_SPI, p._busId);
+            w.member(F("cs"), (int)p._cs[c]);
+            w.endObject();
+            return true;
+        }
+        return false;
+    }
+};
+
+// ── UART ──────────────────────────────────────────────────────────────────────
+
+// Rates tried by default, most common first
+static constexpr uint32_t CEP_UART_BAUDS[] PROGMEM = {
+    115200, 9600, 57600, 38400, 19200, 230400, 4800, 0
+};
+
+class CepUartProbe : public CepBusProbe {
+public:
+    // query: PROGMEM string sent after switching rate, or nullptr to just
+    // listen (e.g. a GPS that talks on its own). expect: PROGMEM string that
+    // must appear in the reply. chip, if given, is reported as a sensor on
+    // the port once it answers.
+    CepUartProbe(HardwareSerial& port, int8_t rx, int8_t tx, const char* query,
+                 const char* expect, const CepChipsetDescriptor* chip = nullptr,
+                 uint8_t portId = 0)
+        : _port(port), _query(query), _expect(expect), _chip(chip), _bauds(CEP_UART_BAUDS),
+          _baud(0), _timeoutMs(100), _rx(rx), _tx(tx), _portId(portId) {
+        ops = _opsTable();
+    }
+
+    // PROGMEM list of rates to try, 0-terminated
+    void setBauds(const uint32_t* bauds) { _bauds = bauds; }
+
+    // How long to wait for the reply at each rate
+    void setTimeout(uint16_t ms) { _timeoutMs = ms; }
+
+    // Rate the last scan detected, 0 = nothing answered
+    uint32_t baud() const { return _baud; }
+
+private:
+    HardwareSerial&             _port;
+    const char*                 _query;
+    const char*                 _expect;
+    const CepChipsetDescriptor* _chip;
+    const uint32_t*             _bauds;
+    uint32_t                    _baud;
+    uint16_t                    _timeoutMs;
+    int8_t                      _rx, _tx;
+    uint8_t                     _portId;
+
+    static const CepProbeOps* _opsTable() {
+        static const CepProbeOps table PROGMEM = { &_scan, &_element };
+        return &table;
+    }
+
+    // Wait for _expect at the current rate. A plain restart-on-mismatch
+    // matcher: short markers like "OK" or "$G" never need more.
+    bool _listen() {
+        const uint8_t len = (uint8_t)strlen_P(_expect);
+        uint8_t  matched  = 0;
+        uint32_t start    = millis();
+        while (millis() - start < _timeoutMs) {
+            int c = _port.read();
+            if (c < 0) {
+                delay(1);
+                continue;
+            }
+            if ((uint8_t)c == pgm_read_byte(&_expect[matched])) {
+                if (++matched == len) return true;
+            } else {
+                matched = (uint8_t)c == pgm_read_byte(&_expect[0]) ? 1 : 0;
+            }
+        }
+        return false;
+    }
+
+    static void _scan(CepBusProbe& base) {
+        CepUartProbe& p = static_cast<CepUartProbe&>(base);
+        p._baud = 0;
+        for (const uint32_t* b = p._bauds; ; b++) {
+            uint32_t baud = pgm_read_dword(b);
+            if (!baud) break;
+#ifdef ESP32
+            p._port.begin(baud, SERIAL_8N1, p._rx, p._tx);
+#else
+            p._port.begin(baud);
+#endif
+            while (p._port.read() >= 0) {}   // bytes from the previous rate
+            if (p._query) p._port.print((const __FlashStringHelper*)p._query);
+            if (p._listen()) {
+                p._baud = baud;
+                return;
+            }
+            p._port.end();
+        }
+    }
+
+    // Element 0 is the port, then the device behind it once detected
+    static bool _element(const CepBusProbe& base, uint8_t i, CepJsonWriter& w) {
+        const CepUartProbe& p = static_cast<const CepUartProbe&>(base);
+        if (i == 0) {
+            w.beginObject();
+            w.member(F("type"), F("uart"));
+            w.beginArray(F("ports"));
+            w.beginObject();
+            w.member(F("id"), (int)p._portId);
+            w.member(F("rx"), (int)p._rx);
+            w.member(F("tx"), (int)p._tx);
+            if (p._baud) w.member(F("baud"), (unsigned long)p._baud);
+            w.endObject();
+            w.endArray();
+            w.endObject();
+            return true;
+        }
+        if (i > 1 || !p._baud || !p._chip) return false;
+        cepWriteBusSensor(w, p._chip, CEP_BUS_UART, p._portId);
+        w.member(F("baud"), (unsigned long)p._baud);
+        w.endObject();
+        return true;
+    }
+};
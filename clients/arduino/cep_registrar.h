@@ -0,0 +1,478 @@
+/*
+ * cep_registrar.h  —  Non-blocking JumpNet registration for cep.h
+ *
+ * Keeps a device registered with a JumpNet node without ever stalling
+ * loop(): one keep-alive TCP connection is reused for every request, the
+ * response is read a little per poll(), and failures back off exponentially.
+ *
+ * Each interval the registrar sends the cheapest request that works (see
+ * server/routes/devices.js):
+ *   - POST /devices/heartbeat   while the document is unchanged
+ *   - PATCH /devices/:id        when cep.writeDelta() can describe the change
+ *   - POST /devices/register    otherwise, or when the server asks for it;
+ *                               streamed straight from the CEP writer
+ *   - POST /devices/:id/samples after queueSamples(), right behind whatever
+ *                               else is due, on the same connection
+ *
+ * Usage:
+ *   CEP          cep;
+ *   CepRegistrar reg(cep, "192.168.1.100", 4080);
+ *
+ *   void setup() { WiFi.begin(ssid, pass); }      // no waiting here
+ *   void loop()  { reg.poll(); ...sampling... }   // does nothing until online
+ *
+ *   cep.invalidate(); reg.kick();                 // after a hot-plug
+ *
+ *   if (cep.restoreSnapshot(snap)) reg.resume();  // woke from deep sleep:
+ *                                                 // heartbeat first, see cep.h
+ *
+ * Round trips and failures are counted in cep.telemetry() (reg_* in the
+ * telemetry capability).
+ *
+ * Blocking is bounded: a poll() makes at most one connect (only when the
+ * previous connection was dropped, capped by the connect timeout) and writes
+ * one request, which fits in the TCP send buffer; it never waits for the
+ * response. Chunked mode streams the full document in one pass and sends its
+ * hash as an HTTP trailer; with chunking off, a measuring pass supplies
+ * Content-Length and the hash header instead.
+ *
+ * Board: ESP32 (WiFi.h / WiFiClient)
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include "cep.h"
+
+// Heartbeat / delta body buffer. A delta that does not fit falls back to a
+// full registration.
+#ifndef CEP_REGISTRAR_BUFFER
+#define CEP_REGISTRAR_BUFFER 512
+#endif
+
+// Size of one HTTP chunk when streaming the full document
+#ifndef CEP_CHUNK_SIZE
+#define CEP_CHUNK_SIZE 256
+#endif
+
+// ── Chunked transfer encoding ─────────────────────────────────────────────────
+
+// Buffers writes into CEP_CHUNK_SIZE chunks ("<hex len>\r\n<data>\r\n") on
+// another Print. finish() flushes and ends the body; trailers may follow.
+class CepChunkedPrint : public Print {
+public:
+    explicit CepChunkedPrint(Print& out) : _out(out), _len(0) {}
+
+    size_t write(uint8_t c) override {
+        _buf[_len++] = c;
+        if (_len == sizeof(_buf)) flush();
+        return 1;
+    }
+
+    size_t write(const uint8_t* data, size_t n) override {
+        for (size_t i = 0; i < n; i++) write(data[i]);
+        return n;
+    }
+
+    void flush() {
+        if (_len == 0) return;
+        char head[8];
+        snprintf(head, sizeof(head), "%x\r\n", (unsigned)_len);
+        _out.print(head);
+        _out.write(_buf, _len);
+        _out.print(F("\r\n"));
+        _len = 0;
+    }
+
+    // Last chunk; the caller writes trailers (if any) and the final CRLF
+    void finish() {
+        flush();
+        _out.print(F("0\r\n"));
+    }
+
+private:
+    Print&  _out;
+    uint8_t _buf[CEP_CHUNK_SIZE];
+    size_t  _len;
+};
+
+// ── Registrar ─────────────────────────────────────────────────────────────────
+
+class CepRegistrar {
+public:
+    enum Request : uint8_t {
+        REQ_NONE,
+        REQ_REGISTER,
+        REQ_HEARTBEAT,
+        REQ_DELTA,
+        REQ_SAMPLES,
+    };
+
+    // Streams a body for POST /devices/:id/samples in the given format,
+    // e.g. through cepWriteBatch() (cep_sampling.h). Returns bytes written.
+    typedef size_t (*SamplesWriter)(Print& out, CepFormat fmt, void* ctx);
+
+    CepRegistrar(CEP& cep, const char* host, uint16_t port = 4080)
+        : _cep(cep), _host(host), _port(port),
+          _intervalMs(60000), _backoffMinMs(1000), _backoffMaxMs(300000),
+          _connectTimeoutMs(250), _responseTimeoutMs(5000),
+          _format(CEP_FORMAT_JSON), _chunked(true),
+          _pending(REQ_NONE), _registered(false), _forceFull(false),
+          _failures(0), _lastStatus(0), _due(0), _sentAt(0),
+          _samplesFn(nullptr), _samplesCtx(nullptr), _samplesQueued(false) {
+        _resetResponse();
+    }
+
+    // ── Tuning ───────────────────────────────────────────────────────────────
+
+    void setInterval(unsigned long ms) { _intervalMs = ms; }
+    void setBackoff(unsigned long minMs, unsigned long maxMs) {
+        _backoffMinMs = minMs;
+        _backoffMaxMs = maxMs;
+    }
+    void setTimeouts(unsigned long connectMs, unsigned long responseMs) {
+        _connectTimeoutMs  = connectMs;
+        _responseTimeoutMs = responseMs;
+    }
+    // Format of full documents and deltas (heartbeats are always JSON)
+    void setFormat(CepFormat fmt) { _format = fmt; _forceFull = true; }
+    void setChunked(bool on)      { _chunked = on; }
+
+    // Send on the next poll() instead of waiting for the interval
+    void kick() { _due = millis(); }
+
+    // Where queueSamples() batches come from
+    void setSamplesWriter(SamplesWriter fn, void* ctx = nullptr) {
+        _samplesFn  = fn;
+        _samplesCtx = ctx;
+    }
+
+    // Upload one samples batch once registered, after any request that is
+    // due, so both share a radio wake. Always chunked (the writer pops what
+    // it sends, so there is no measuring pass). A batch whose request fails
+    // is lost; the registrar backs off as usual.
+    void queueSamples() { _samplesQueued = _samplesFn != nullptr; }
+
+    // After a wake with a restored CepScanSnapshot: assume the server still
+    // holds the document from before the sleep, so the first request is a
+    // heartbeat (or delta) instead of the full registration. If the server
+    // has forgotten the device, its 404 triggers the full send as usual.
+    void resume() {
+        _registered = true;
+        _forceFull  = false;
+        kick();
+    }
+
+    // ── State ────────────────────────────────────────────────────────────────
+
+    bool    registered() const { return _registered; }
+    bool    busy() const       { return _pending != REQ_NONE; }
+    // HTTP status of the last completed request; 0 = none yet, -1 = failed
+    // to connect, -2 = timeout or connection lost
+    int     lastStatus() const { return _lastStatus; }
+    uint8_t failures() const   { return _failures; }
+    // millis() of the next registration request
+    unsigned long due() const  { return _due; }
+    bool    samplesQueued() const { return _samplesQueued; }
+
+    // ── Driver ───────────────────────────────────────────────────────────────
+
+    // Call from loop(). Cheap when there is nothing to do.
+    void poll() {
+        if (WiFi.status() != WL_CONNECTED) {
+            if (_pending != REQ_NONE) {   // retry once the link is back
+                _client.stop();
+                _pending = REQ_NONE;
+            }
+            return;
+        }
+
+        unsigned long now = millis();
+        if (_pending != REQ_NONE) {
+            _readResponse(now);
+        } else if ((long)(now - _due) >= 0) {
+            _send(now);
+        } else if (_samplesQueued && _registered && _failures == 0) {
+            _sendSamples(now);
+        }
+    }
+
+private:
+    CEP&        _cep;
+    const char* _host;
+    uint16_t    _port;
+    WiFiClient  _client;
+
+    unsigned long _intervalMs;
+    unsigned long _backoffMinMs;
+    unsigned long _backoffMaxMs;
+    unsigned long _connectTimeoutMs;
+    unsigned long _responseTimeoutMs;
+    CepFormat     _format;
+    bool          _chunked;
+
+    Request       _pending;       // request in flight
+    bool          _registered;    // server holds our current baseline
+    bool          _forceFull;     // next request must be a full registration
+    uint8_t       _failures;
+    int           _lastStatus;
+    unsigned long _due;           // millis() of the next request
+    unsigned long _sentAt;
+
+    SamplesWriter _samplesFn;
+    void*         _samplesCtx;
+    bool          _samplesQueued;
+
+    // Response parser
+    char  _line[48];
+    uint8_t _lineLen;
+    bool  _inBody;
+    bool  _closeAfter;
+    bool  _haveLength;
+    long  _bodyLeft;
+    int   _status;
+
+    char _body[CEP_REGISTRAR_BUFFER];
+
+    // ── Request ──────────────────────────────────────────────────────────────
+
+    void _send(unsigned long now) {
+        Request req = REQ_REGISTER;
+        size_t  len = 0;
+        if (_registered && !_forceFull) {
+            req = _cep.isDirty() ? REQ_DELTA : REQ_HEARTBEAT;
+        }
+        if (req != REQ_REGISTER) {
+            CepBufferPrint sink(_body, sizeof(_body));
+            len = req == REQ_DELTA ? _cep.writeDelta(sink) : _cep.writeHeartbeat(sink);
+            if (len == 0 || len >= sizeof(_body)) req = REQ_REGISTER;
+        }
+
+        if (!_connect(now)) return;
+
+        _resetResponse();
+        switch (req) {
+            case REQ_HEARTBEAT:
+                _requestLine(F("POST"), F("/devices/heartbeat"), nullptr);
+                _fixedBody(CEP_FORMAT_JSON, len);
+                break;
+            case REQ_DELTA: {
+                char id[32];
+                _cep.deviceId(id, sizeof(id));
+                _requestLine(F("PATCH"), F("/devices/"), id);
+                _fixedBody(_format, len);
+                break;
+            }
+            default:
+                _requestLine(F("POST"), F("/devices/register"), nullptr);
+                _fullBody();
+                break;
+        }
+        _pending = req;
+        _sentAt  = now;
+    }
+
+    void _sendSamples(unsigned long now) {
+        if (!_connect(now)) return;
+        _samplesQueued = false;
+
+        char id[32];
+        _cep.deviceId(id, sizeof(id));
+        _resetResponse();
+        _requestLine(F("POST"), F("/devices/"), id, F("/samples"));
+        _contentType(_format);
+        _client.print(F("Transfer-Encoding: chunked\r\n\r\n"));
+        CepChunkedPrint chunks(_client);
+        _samplesFn(chunks, _format, _samplesCtx);
+        chunks.finish();
+        _client.print(F("\r\n"));
+        _pending = REQ_SAMPLES;
+        _sentAt  = now;
+    }
+
+    // Reuse the keep-alive connection, or open a new one (bounded by the
+    // connect timeout). false after counting a failure.
+    bool _connect(unsigned long now) {
+        if (_client.connected()) return true;
+        _client.stop();
+        if (!_client.connect(_host, _port, (int32_t)_connectTimeoutMs)) {
+            _lastStatus = -1;
+            _fail(now);
+            return false;
+        }
+        _client.setNoDelay(true);
+        return true;
+    }
+
+    void _requestLine(const __FlashStringHelper* method,
+                      const __FlashStringHelper* path, const char* tail,
+                      const __FlashStringHelper* suffix = nullptr) {
+        _client.print(method);
+        _client.print(' ');
+        _client.print(path);
+        if (tail) _client.print(tail);
+        if (suffix) _client.print(suffix);
+        _client.print(F(" HTTP/1.1\r\nHost: "));
+        _client.print(_host);
+        _client.print(':');
+        _client.print((unsigned)_port);
+        _client.print(F("\r\nConnection: keep-alive\r\n"));
+    }
+
+    void _contentType(CepFormat fmt) {
+        _client.print(fmt == CEP_FORMAT_CBOR ? F("Content-Type: application/cbor\r\n")
+                                             : F("Content-Type: application/json\r\n"));
+    }
+
+    void _fixedBody(CepFormat fmt, size_t len) {
+        _contentType(fmt);
+        _client.print(F("Content-Length: "));
+        _client.print((unsigned long)len);
+        _client.print(F("\r\n\r\n"));
+        _client.write((const uint8_t*)_body, len);
+    }
+
+    void _fullBody() {
+        char hash[9];
+        _contentType(_format);
+        if (_chunked) {
+            // One pass: the hash is only known at the end, so it goes in a trailer
+            _client.print(F("Transfer-Encoding: chunked\r\nTrailer: X-CEP-Hash\r\n\r\n"));
+            CepChunkedPrint chunks(_client);
+            _cep.writeCapabilities(chunks, _format);
+            chunks.finish();
+            snprintf(hash, sizeof(hash), "%08lx", (unsigned long)_cep.lastHash());
+            _client.print(F("X-CEP-Hash: "));
+            _client.print(hash);
+            _client.print(F("\r\n\r\n"));
+        } else {
+            // Measuring pass for Content-Length; nothing is buffered
+            CepHashPrint measure;
+            _cep.writeCapabilities(measure, _format);
+            snprintf(hash, sizeof(hash), "%08lx", (unsigned long)measure.hash());
+            _client.print(F("X-CEP-Hash: "));
+            _client.print(hash);
+            _client.print(F("\r\nContent-Length: "));
+            _client.print((unsigned long)measure.total());
+            _client.print(F("\r\n\r\n"));
+            _cep.writeCapabilities(_client, _format);
+        }
+    }
+
+    // ── Response ─────────────────────────────────────────────────────────────
+
+    void _resetResponse() {
+        _lineLen    = 0;
+        _inBody     = false;
+        _closeAfter = false;
+        _haveLength = false;
+        _bodyLeft   = 0;
+        _status     = 0;
+    }
+
+    // Consume whatever has arrived; never waits
+    void _readResponse(unsigned long now) {
+        while (_pending != REQ_NONE && _client.available() > 0) {
+            int c = _client.read();
+            if (c < 0) break;
+            if (_inBody) {
+                if (--_bodyLeft <= 0) _finish(now);
+            } else if (c == '\n') {
+                _line[_lineLen] = '\0';
+                _headerLine(now);
+                _lineLen = 0;
+            } else if (c != '\r' && _lineLen < sizeof(_line) - 1) {
+                _line[_lineLen++] = (char)c;
+            }
+        }
+        if (_pending == REQ_NONE) return;
+
+        if (!_client.connected() && _client.available() <= 0) {
+            if (_inBody && !_haveLength) {
+                _finish(now);   // body delimited by close
+            } else {
+                _lastStatus = -2;
+                _fail(now);
+            }
+        } else if (now - _sentAt > _responseTimeoutMs) {
+            _lastStatus = -2;
+            _fail(now);
+        }
+    }
+
+    void _headerLine(unsigned long now) {
+        if (_status == 0) {
+            // "HTTP/1.1 200 OK"
+            const char* sp = strchr(_line, ' ');
+            _status = sp ? atoi(sp + 1) : -2;
+            return;
+        }
+        if (_lineLen == 0) {   // end of headers
+            if (_haveLength && _bodyLeft <= 0) {
+                _finish(now);
+            } else {
+                _inBody = true;
+                if (!_haveLength) _closeAfter = true;
+            }
+            return;
+        }
+        if (_headerIs(F("content-length:"))) {
+            _haveLength = true;
+            _bodyLeft   = atol(_line + 15);
+        } else if (_headerIs(F("connection:")) && strstr(_line, "close")) {
+            _closeAfter = true;
+        }
+    }
+
+    bool _headerIs(const __FlashStringHelper* name) {
+        const char* n = (const char*)name;
+        for (uint8_t i = 0; ; i++) {
+            char want = (char)pgm_read_byte(n + i);
+            if (!want) return true;
+            if (tolower((unsigned char)_line[i]) != want) return false;
+        }
+    }
+
+    void _finish(unsigned long now) {
+        Request req = _pending;
+        _pending    = REQ_NONE;
+        _lastStatus = _status;
+        if (_closeAfter) _client.stop();
+
+        if (_status >= 200 && _status < 300) {
+            _cep.telemetry().answered(now - _sentAt);
+            if (req == REQ_REGISTER) {
+                _registered = true;
+                _forceFull  = false;
+            }
+            if (req == REQ_DELTA) _cep.commitDelta();   // the server has the patch now
+            _failures = 0;
+            if (req != REQ_SAMPLES) _due = now + _intervalMs;
+        } else if (req == REQ_SAMPLES && _status >= 400 && _status < 500 && _status != 404) {
+            // The server refused this batch; nothing to retry
+            _cep.telemetry().answered(now - _sentAt);
+        } else if (req != REQ_REGISTER && _status >= 400 && _status < 500) {
+            // 404/409: server lost or disagrees with our baseline; 400: bad
+            // delta. Either way the full document fixes it, right away.
+            _cep.telemetry().answered(now - _sentAt);
+            _forceFull = true;
+            _due       = now;
+        } else {
+            _fail(now);
+        }
+    }
+
+    void _fail(unsigned long now) {
+        _pending = REQ_NONE;
+        _client.stop();
+        _cep.telemetry().regFailures++;
+        if (_failures < 255) _failures++;
+
+        unsigned long wait = _backoffMinMs;
+        for (uint8_t i = 1; i < _failures && wait < _backoffMaxMs; i++) wait <<= 1;
+        if (wait > _backoffMaxMs) wait = _backoffMaxMs;
+        wait += random((long)(wait / 4) + 1);   // spread out nodes that failed together
+        _due = now + wait;
+    }
+};
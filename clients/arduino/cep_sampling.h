@@ -0,0 +1,437 @@
+/*
+ * cep_sampling.h  —  Live sensor readings for CEP chipset plugins
+ *
+ * A chipset plugin that can read its device points its descriptor's sampler
+ * field at a PROGMEM CepSamplerOps (see chipsets/mpu6050_chip.h). A
+ * CepSampler binds those ops to one device found by the CEP scan, fills a
+ * lock-free ring at a fixed rate from loop() or an ESP32 task, and
+ * cepWriteBatch() streams what has accumulated as one uplink document.
+ * Nothing allocates; every sampler owns its ring storage.
+ *
+ * Usage:
+ *   CepStaticSampler<64> imu;                  // 64-sample ring
+ *   imu.attach(cep, &MPU6050_Chip);            // first MPU-6050 the scan found
+ *   imu.setRate(1000);
+ *   imu.useFifo();                             // drain the device FIFO in bursts
+ *   imu.begin();
+ *   imu.startTask();                           // ESP32; or imu.poll() in loop()
+ *
+ *   CepSampler* all[] = { &imu, &env };
+ *   cepWriteBatch(client, all, 2, 32);         // <= 32 samples per sensor
+ *
+ * Values are fixed point (int32) in the units named by each channel, e.g.
+ * "accel_x_mg" or "pressure_pa", so consumers need no per-chipset scaling.
+ *
+ * Ring discipline: exactly one producer (the sampling context) and one
+ * consumer. On 8-bit AVR both must run outside interrupt handlers (Wire
+ * cannot be used from an ISR anyway).
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include <Wire.h>
+#include "cep.h"
+
+#ifdef ESP32
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#endif
+
+// Values per sample; the MPU-6050 needs 7
+#ifndef CEP_SAMPLE_CHANNELS
+#define CEP_SAMPLE_CHANNELS 8
+#endif
+
+// Per-device state a plugin may keep (calibration, mode), in bytes
+#ifndef CEP_SAMPLER_STATE
+#define CEP_SAMPLER_STATE 48
+#endif
+
+// Largest single I2C read the Wire library buffers; FIFO drains are split
+// into reads of this size
+#ifndef CEP_I2C_CHUNK
+#  if defined(I2C_BUFFER_LENGTH)
+#    define CEP_I2C_CHUNK I2C_BUFFER_LENGTH
+#  elif defined(BUFFER_LENGTH)
+#    define CEP_I2C_CHUNK BUFFER_LENGTH
+#  else
+#    define CEP_I2C_CHUNK 32
+#  endif
+#endif
+
+// In FIFO mode, drain after about this many device samples have queued
+#ifndef CEP_FIFO_DRAIN_FRAMES
+#define CEP_FIFO_DRAIN_FRAMES 16
+#endif
+
+// ── Plugin interface ──────────────────────────────────────────────────────────
+
+struct CepSample {
+    uint32_t timestampUs;                   // micros() when the read completed
+    uint8_t  count;                         // valid entries in values
+    int32_t  values[CEP_SAMPLE_CHANNELS];
+};
+
+// ── Ring buffer ───────────────────────────────────────────────────────────────
+
+// Single-producer / single-consumer ring over caller-owned storage. The
+// capacity must be a power of two; indices run freely and wrap with a mask.
+// A full ring drops the new sample and counts an overrun.
+class CepSampleRing {
+public:
+    CepSampleRing(CepSample* buf, uint16_t capacity)
+        : _buf(buf), _mask((uint16_t)(capacity - 1)), _head(0), _tail(0), _overruns(0) {}
+
+    bool push(const CepSample& s) {
+        uint16_t h = _head;
+        if ((uint16_t)(h - _tail) > _mask) {
+            _overruns++;
+            return false;
+        }
+        _buf[h & _mask] = s;
+        _barrier();   // publish the slot before the index
+        _head = (uint16_t)(h + 1);
+        return true;
+    }
+
+    bool pop(CepSample& s) {
+        uint16_t t = _tail;
+        if (t == _head) return false;
+        _barrier();
+        s = _buf[t & _mask];
+        _barrier();   // finish reading before releasing the slot
+        _tail = (uint16_t)(t + 1);
+        return true;
+    }
+
+    uint16_t size() const     { return (uint16_t)(_head - _tail); }
+    uint16_t capacity() const { return (uint16_t)(_mask + 1); }
+    uint32_t overruns() const { return _overruns; }
+
+private:
+    CepSample*        _buf;
+    uint16_t          _mask;
+    volatile uint16_t _head;       // written by the producer only
+    volatile uint16_t _tail;       // written by the consumer only
+    volatile uint32_t _overruns;
+
+    static void _barrier() {
+#ifdef ESP32
+        __sync_synchronize();       // dual core: order the slot and index stores
+#else
+        __asm__ __volatile__("" ::: "memory");
+#endif
+    }
+};
+
+// What the sampler asks of the device at begin()
+struct CepSamplerConfig {
+    uint16_t rateHz;   // output data rate to configure, 0 = plugin default
+    bool     fifo;     // buffer in the device's FIFO, read back with drain()
+};
+
+// Plain aggregate in flash, like CepChipsetDescriptor. state points to
+// stateSize bytes owned by the sampler, zeroed before begin().
+struct CepSamplerOps {
+    const char* const* channels;   // null-terminated PROGMEM names, one per value
+    uint8_t            stateSize;  // <= CEP_SAMPLER_STATE
+    uint16_t           maxRateHz;  // fastest rate the device produces new data
+
+    // Optional: configure the device (wake, ranges, data rate, FIFO).
+    // false = no answer.
+    bool (*begin)(TwoWire& wire, uint8_t address, void* state, const CepSamplerConfig& cfg);
+
+    // Read the newest sample: fill out.values and out.count. false = bus error.
+    bool (*read)(TwoWire& wire, uint8_t address, void* state, CepSample& out);
+
+    // Optional, devices with a hardware FIFO: move every queued sample into
+    // ring, oldest first, with timestampUs reconstructed from the data rate.
+    // Returns the number moved, or -1 on a bus error or a FIFO overflow
+    // (queued data lost).
+    int16_t (*drain)(TwoWire& wire, uint8_t address, void* state, CepSampleRing& ring);
+};
+
+// ── I2C register helpers for plugins ──────────────────────────────────────────
+
+inline bool cepI2CWrite8(TwoWire& wire, uint8_t address, uint8_t reg, uint8_t value) {
+    wire.beginTransmission(address);
+    wire.write(reg);
+    wire.write(value);
+    return wire.endTransmission() == 0;
+}
+
+// Burst read of n consecutive registers starting at reg
+inline bool cepI2CRead(TwoWire& wire, uint8_t address, uint8_t reg, uint8_t* buf, uint8_t n) {
+    wire.beginTransmission(address);
+    wire.write(reg);
+    if (wire.endTransmission(false) != 0) return false;   // repeated start
+    if (wire.requestFrom(address, n) != n) return false;
+    for (uint8_t i = 0; i < n; i++) buf[i] = (uint8_t)wire.read();
+    return true;
+}
+
+// ── Sampler ───────────────────────────────────────────────────────────────────
+
+class CepSampler {
+public:
+    CepSampler(CepSample* buf, uint16_t capacity)
+        : _ring(buf, capacity), _chip(nullptr), _bus(), _busId(0), _address(0),
+          _periodUs(0), _nextUs(0), _errors(0), _ready(false) {
+        memset(&_ops, 0, sizeof(_ops));
+        _cfg.rateHz = 0;
+        _cfg.fifo   = false;
+        memset(_state, 0, sizeof(_state));
+#ifdef ESP32
+        _task = nullptr;
+#endif
+    }
+
+    // Bind to the nth device the CEP scan matched to chip. false if the
+    // device was not found or the plugin cannot sample.
+    bool attach(CEP& cep, const CepChipsetDescriptor* chip, uint8_t nth = 0) {
+        uint8_t busId, address;
+        if (!cep.locate(chip, busId, address, nth)) return false;
+        return attach(cep.scanConfig().buses[busId], busId, chip, address);
+    }
+
+    // Bind explicitly, e.g. to a device outside the scan configuration
+    bool attach(const CepI2CBus& bus, uint8_t busId, const CepChipsetDescriptor* chip,
+                uint8_t address) {
+        const CepSamplerOps* ops = (const CepSamplerOps*)pgm_read_ptr(&chip->sampler);
+        _ready = false;
+        if (!ops) return false;
+        memcpy_P(&_ops, ops, sizeof(_ops));
+        if (!_ops.read || _ops.stateSize > CEP_SAMPLER_STATE) return false;
+        _chip    = chip;
+        _bus     = bus;
+        _busId   = busId;
+        _address = address;
+        return true;
+    }
+
+    // Configure the device at the current rate and mode. Call after attach()
+    // and setRate() / useFifo(), before sampling.
+    bool begin() {
+        if (!_chip) return false;
+        memset(_state, 0, sizeof(_state));
+        _select();
+        _ready = !_ops.begin || _ops.begin(*_bus.wire, _address, _state, _cfg);
+        _release();
+        _nextUs = micros();
+        return _ready;
+    }
+
+    // Sampling rate for poll() / startTask(); capped at the device's rate.
+    // Plugins also program it as the device's output data rate in begin().
+    void setRate(uint32_t hz) {
+        if (_ops.maxRateHz && hz > _ops.maxRateHz) hz = _ops.maxRateHz;
+        _cfg.rateHz = (uint16_t)hz;
+        _periodUs   = hz ? 1000000UL / hz : 0;
+    }
+
+    // Let the device queue samples in its hardware FIFO and drain them in a
+    // few burst reads every CEP_FIFO_DRAIN_FRAMES periods, instead of one
+    // transaction per sample. false if the plugin has no FIFO support.
+    bool useFifo(bool on = true) {
+        _cfg.fifo = on && _ops.drain;
+        return _cfg.fifo == on;
+    }
+
+    bool fifo() const { return _cfg.fifo; }
+
+    // Read once into the ring (FIFO mode: everything queued). false on a bus
+    // error, a full ring, or nothing new.
+    bool sample() {
+        if (!_ready) return false;
+        if (_cfg.fifo) {
+            _select();
+            int16_t n = _ops.drain(*_bus.wire, _address, _state, _ring);
+            _release();
+            if (n < 0) _errors++;
+            return n > 0;
+        }
+        CepSample s;
+        s.count = 0;
+        _select();
+        bool ok = _ops.read(*_bus.wire, _address, _state, s);
+        _release();
+        if (!ok) {
+            _errors++;
+            return false;
+        }
+        s.timestampUs = micros();
+        return _ring.push(s);
+    }
+
+    // loop()-driven sampling: reads when the period has elapsed. Keeps the
+    // phase, but skips ahead instead of bursting after a long stall.
+    bool poll() {
+        uint32_t interval = _intervalUs();
+        if (!interval) return false;
+        uint32_t now = micros();
+        if ((int32_t)(now - _nextUs) < 0) return false;
+        _nextUs += interval;
+        if ((int32_t)(now - _nextUs) >= 0) _nextUs = now + interval;
+        return sample();
+    }
+
+    // micros() at which poll() reads next; false when it never will (no
+    // rate set, or not begun)
+    bool nextPoll(uint32_t& us) const {
+        us = _nextUs;
+        return _ready && _intervalUs() != 0;
+    }
+
+#ifdef ESP32
+    // Sample from a dedicated FreeRTOS task at the configured rate. The task
+    // owns the bus while it runs; don't touch the same TwoWire elsewhere.
+    // Periods shorter than a tick run one read per tick; FIFO mode wakes only
+    // once per drain, so 1 kHz capture needs no sub-tick timing.
+    bool startTask(BaseType_t core = 1, UBaseType_t priority = 2, uint32_t stackBytes = 2048) {
+        if (_task || !_ready || !_periodUs) return false;
+        return xTaskCreatePinnedToCore(_taskLoop, "cep_sample", stackBytes, this,
+                                       priority, &_task, core) == pdPASS;
+    }
+
+    void stopTask() {
+        if (!_task) return;
+        vTaskDelete(_task);
+        _task = nullptr;
+    }
+#endif
+
+    // ── Consumer side ────────────────────────────────────────────────────────
+
+    bool     pop(CepSample& s)  { return _ring.pop(s); }
+    uint16_t available() const  { return _ring.size(); }
+    uint32_t overruns() const   { return _ring.overruns(); }
+    uint32_t errors() const     { return _errors; }
+
+    const CepChipsetDescriptor* chipset() const { return _chip; }
+    const CepSamplerOps&        ops() const     { return _ops; }   // SRAM copy
+    uint8_t busId() const   { return _busId; }
+    uint8_t address() const { return _address; }
+
+private:
+    CepSampleRing               _ring;
+    const CepChipsetDescriptor* _chip;
+    CepSamplerOps               _ops;
+    CepSamplerConfig            _cfg;
+    CepI2CBus                   _bus;
+    uint8_t                     _busId;
+    uint8_t                     _address;
+    uint32_t                    _periodUs;
+    uint32_t                    _nextUs;
+    volatile uint32_t           _errors;
+    bool                        _ready;
+    alignas(4) uint8_t          _state[CEP_SAMPLER_STATE];
+#ifdef ESP32
+    TaskHandle_t                _task;
+
+    static void _taskLoop(void* arg) {
+        CepSampler* self = (CepSampler*)arg;
+        TickType_t ticks = pdMS_TO_TICKS(self->_intervalUs() / 1000);
+        if (ticks == 0) ticks = 1;
+        TickType_t wake = xTaskGetTickCount();
+        for (;;) {
+            self->sample();
+            vTaskDelayUntil(&wake, ticks);
+        }
+    }
+#endif
+
+    // Time between sample() calls: one period, or one drain's worth in FIFO mode
+    uint32_t _intervalUs() const {
+        return _cfg.fifo ? _periodUs * CEP_FIFO_DRAIN_FRAMES : _periodUs;
+    }
+
+    void _select() {
+        if (_bus.muxAddress) cepSelectMux(_bus, (uint8_t)(1 << _bus.muxChannel));
+    }
+
+    // Close the channel again: another mux on the controller, or the root
+    // bus, may hold a part at the same address
+    void _release() {
+        if (_bus.muxAddress) cepSelectMux(_bus, 0);
+    }
+};
+
+// Sampler with its ring storage inline; N must be a power of two
+template <uint16_t N>
+class CepStaticSampler : public CepSampler {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "ring size must be a power of two");
+
+public:
+    CepStaticSampler() : CepSampler(_storage, N) {}
+
+private:
+    CepSample _storage[N];
+};
+
+// ── Batched uplink ────────────────────────────────────────────────────────────
+
+// Stream up to maxPerSensor queued samples from each sampler as one document
+// for POST /devices/:id/samples:
+//   {"sensors":[{"chipset":"mpu6050","bus_id":0,"address":"0x68",
+//                "channels":["accel_x_mg",...],"t0_us":123456,
+//                "samples":[[0,v0,v1,...],[1000,...],...]}]}
+// Each sample row starts with its offset from t0_us in microseconds. Samples
+// are popped as they are written, so nothing is copied and the ring keeps
+// filling meanwhile. Returns the number of bytes written.
+inline size_t cepWriteBatch(Print& out, CepSampler* const* samplers, uint8_t n,
+                            uint16_t maxPerSensor, CepFormat fmt = CEP_FORMAT_JSON) {
+    CepJsonWriter w(out, fmt);
+    w.beginObject();
+    w.beginArray(F("sensors"));
+    for (uint8_t i = 0; i < n; i++) {
+        CepSampler& s = *samplers[i];
+        if (!s.chipset()) continue;
+
+        w.beginObject();
+        w.member(F("chipset"), (const __FlashStringHelper*)pgm_read_ptr(&s.chipset()->name));
+        w.member(F("bus_id"), (int)s.busId());
+        w.memberHex8(F("address"), s.address());
+        w.beginArray(F("channels"));
+        for (const char* const* c = s.ops().channels; c; c++) {
+            const char* name = (const char*)pgm_read_ptr(c);
+            if (!name) break;
+            w.value((const __FlashStringHelper*)name);
+        }
+        w.endArray();
+
+        CepSample sample;
+        uint16_t  count = 0;
+        bool      open  = false;
+        uint32_t  t0    = 0;
+        while (count < maxPerSensor && s.pop(sample)) {
+            if (!open) {
+                t0 = sample.timestampUs;
+                w.member(F("t0_us"), (unsigned long)t0);
+                w.beginArray(F("samples"));
+                open = true;
+            }
+            w.beginArray();
+            w.value((unsigned long)(sample.timestampUs - t0));
+            for (uint8_t v = 0; v < sample.count; v++) w.value((long)sample.values[v]);
+            w.endArray();
+            count++;
+        }
+        if (open) {
+            w.endArray();
+        } else {
+            w.beginArray(F("samples"));
+            w.endArray();
+        }
+        w.endObject();
+    }
+    w.endArray();
+    w.endObject();
+    return w.bytes();
+}
+
+inline size_t cepWriteBatch(Print& out, CepSampler& sampler, uint16_t maxPerSensor,
+                            CepFormat fmt = CEP_FORMAT_JSON) {
+    CepSampler* one[] = { &sampler };
+    return cepWriteBatch(out, one, 1, maxPerSensor, fmt);
+}
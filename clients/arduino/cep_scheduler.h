@@ -0,0 +1,273 @@
+/*
+ * cep_scheduler.h  —  Duty-cycled loop for battery CEP nodes
+ *
+ * A loop() that polls and delay()s keeps the CPU awake and wakes the radio
+ * for every request on its own schedule. A CepScheduler knows when each
+ * piece of work is next due — the registrar's heartbeat, loop-driven
+ * sampler reads, the sample batch flush, hot-plug bursts — runs what is due
+ * and sleeps until the next one, with the WiFi modem in power save.
+ *
+ * Network sends are coalesced: when samples are flushed, a heartbeat due
+ * within the coalesce window is pulled forward, and every heartbeat takes
+ * the queued samples along, so one radio wake carries both (over the
+ * registrar's keep-alive connection, see cep_registrar.h).
+ *
+ * Usage:
+ *   CEP          cep;
+ *   CepRegistrar reg(cep, "192.168.1.100", 4080);
+ *   CepScheduler sched(cep, reg);
+ *
+ *   CepStaticSampler<64> env;                 // loop-driven, no startTask()
+ *   env.attach(cep, &BME280_Chip); env.setRate(1); env.begin();
+ *   sched.addSampler(env);
+ *   sched.setFlush(60000, 48);                // every 60 s, or at 48 queued
+ *   sched.setHotplug(hotplug);                // with hotplug.setInterval()
+ *   sched.setSleep(CEP_SLEEP_LIGHT, 5000);    // light sleep, radio off, for gaps >= 5 s
+ *
+ *   void loop() { sched.run(); }              // work, then sleep until due
+ *
+ * Shorter gaps are idled through with delay(): the CPU idles and the modem
+ * stays associated in power save, waking only for DTIM beacons. The radio
+ * does not survive light sleep, so before one the link is shut down and
+ * afterwards it reassociates (WiFi.begin() with the stored credentials);
+ * the registrar reconnects once it is up. Choose the light sleep threshold
+ * well above the time an association takes.
+ *
+ * Deep sleep (CEP_SLEEP_DEEP) is taken only for gaps of at least its
+ * threshold with nothing queued, nothing in flight and the device
+ * registered. The scan is saved first when a snapshot is set, so setup()
+ * resumes cheaply:
+ *   RTC_DATA_ATTR CepScanSnapshot snap;
+ *   sched.setSnapshot(snap);
+ *   if (cep.restoreSnapshot(snap)) reg.resume();   // in setup()
+ * Sampling stops while the node is in deep sleep; pick the threshold above
+ * the sampler period to keep it running.
+ *
+ * While the radio has work (a request in flight, one due, a batch queued)
+ * the scheduler only idles for CEP_SCHED_POLL_MS at a time and never sleeps,
+ * so responses are read promptly and the link can come up.
+ *
+ * Board: ESP32 (WiFi.h, esp_sleep.h)
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <esp_sleep.h>
+#include <esp_wifi.h>
+#include "cep.h"
+#include "cep_registrar.h"
+#include "cep_sampling.h"
+#include "cep_hotplug.h"
+
+// Loop-driven samplers one scheduler polls
+#ifndef CEP_SCHED_SAMPLERS
+#define CEP_SCHED_SAMPLERS 4
+#endif
+
+// Idle step while the radio has work
+#ifndef CEP_SCHED_POLL_MS
+#define CEP_SCHED_POLL_MS 10
+#endif
+
+enum CepSleepMode : uint8_t {
+    CEP_SLEEP_NONE,    // run() returns at once; the caller paces loop()
+    CEP_SLEEP_IDLE,    // delay() until the next event (CPU idle, radio associated)
+    CEP_SLEEP_LIGHT,   // timer light sleep, radio off, for longer gaps, else idle
+    CEP_SLEEP_DEEP,    // deep sleep for long gaps, else light sleep
+};
+
+class CepScheduler {
+public:
+    CepScheduler(CEP& cep, CepRegistrar& reg)
+        : _cep(cep), _reg(reg), _hotplug(nullptr), _snapshot(nullptr), _numSamplers(0),
+          _flushMs(0), _highWater(0), _maxPerSensor(64), _coalesceMs(10000),
+          _mode(CEP_SLEEP_IDLE), _lightMinMs(5000), _deepMinMs(60000),
+          _lastFlush(0), _powerSave(false), _wakes(0), _sleptMs(0) {
+        _reg.setSamplesWriter(&_writeSamples, this);
+    }
+
+    // ── Configuration ────────────────────────────────────────────────────────
+
+    // Poll a begun sampler on its own period. Not for samplers running on
+    // their own task (startTask()). false when CEP_SCHED_SAMPLERS are added.
+    bool addSampler(CepSampler& s) {
+        if (_numSamplers >= CEP_SCHED_SAMPLERS) return false;
+        _samplers[_numSamplers++] = &s;
+        return true;
+    }
+
+    // Upload queued samples every periodMs (0: only with heartbeats), or as
+    // soon as one ring holds highWater samples (0: no limit); at most
+    // maxPerSensor per sensor per batch
+    void setFlush(unsigned long periodMs, uint16_t highWater = 0, uint16_t maxPerSensor = 64) {
+        _flushMs      = periodMs;
+        _highWater    = highWater;
+        _maxPerSensor = maxPerSensor;
+    }
+
+    // How far a heartbeat may be pulled forward to ride along with a flush
+    void setCoalesce(unsigned long ms) { _coalesceMs = ms; }
+
+    // Drive hot-plug bursts; give it an interval, or every run() is a burst
+    void setHotplug(CepHotplug& hotplug) { _hotplug = &hotplug; }
+
+    // Sleep between events: light sleep for gaps of at least minMs, deep
+    // sleep (CEP_SLEEP_DEEP) for gaps of at least deepMinMs
+    void setSleep(CepSleepMode mode, unsigned long minMs = 5000, unsigned long deepMinMs = 60000) {
+        _mode       = mode;
+        _lightMinMs = minMs;
+        _deepMinMs  = deepMinMs;
+    }
+
+    // Saved with cep.saveSnapshot() before every deep sleep
+    void setSnapshot(CepScanSnapshot& s) { _snapshot = &s; }
+
+    // ── State ────────────────────────────────────────────────────────────────
+
+    // Sleeps taken, and time spent in them
+    uint32_t      wakes() const   { return _wakes; }
+    unsigned long sleptMs() const { return _sleptMs; }
+
+    // ms until the next event, 0 when something is due now
+    unsigned long untilNext() {
+        unsigned long now  = millis();
+        unsigned long next = _until(now, _reg.due());
+        if (_flushMs && _queued()) next = _min(next, _until(now, _lastFlush + _flushMs));
+        if (_hotplug) next = _min(next, _until(now, _hotplug->nextDue()));
+
+        uint32_t nowUs = micros();
+        for (uint8_t i = 0; i < _numSamplers; i++) {
+            uint32_t at;
+            if (!_samplers[i]->nextPoll(at)) continue;
+            long us = (long)(at - nowUs);
+            next = _min(next, us > 0 ? (unsigned long)us / 1000 : 0);
+        }
+        return next;
+    }
+
+    // ── Driver ───────────────────────────────────────────────────────────────
+
+    // Call from loop(): runs everything that is due, then sleeps until the
+    // next event (or, with CEP_SLEEP_NONE, returns). Returns ms slept.
+    unsigned long run() {
+        _work();
+        if (_mode == CEP_SLEEP_NONE) return 0;
+        if (_radioWork()) {
+            delay(CEP_SCHED_POLL_MS);
+            return CEP_SCHED_POLL_MS;
+        }
+        unsigned long ms = untilNext();
+        if (ms == 0) return 0;
+        _sleep(ms);
+        return ms;
+    }
+
+private:
+    CEP&          _cep;
+    CepRegistrar& _reg;
+    CepHotplug*   _hotplug;
+    CepScanSnapshot* _snapshot;
+
+    CepSampler* _samplers[CEP_SCHED_SAMPLERS];
+    uint8_t     _numSamplers;
+
+    unsigned long _flushMs;
+    uint16_t      _highWater;
+    uint16_t      _maxPerSensor;
+    unsigned long _coalesceMs;
+    CepSleepMode  _mode;
+    unsigned long _lightMinMs;
+    unsigned long _deepMinMs;
+
+    unsigned long _lastFlush;   // millis() of the last queued batch
+    bool          _powerSave;   // modem power save applied to this association
+    uint32_t      _wakes;
+    unsigned long _sleptMs;
+
+    static unsigned long _until(unsigned long now, unsigned long at) {
+        long d = (long)(at - now);
+        return d > 0 ? (unsigned long)d : 0;
+    }
+
+    static unsigned long _min(unsigned long a, unsigned long b) { return a < b ? a : b; }
+
+    // Registrar hook: every sampler's queue in one batch
+    static size_t _writeSamples(Print& out, CepFormat fmt, void* ctx) {
+        CepScheduler* self = (CepScheduler*)ctx;
+        return cepWriteBatch(out, self->_samplers, self->_numSamplers, self->_maxPerSensor, fmt);
+    }
+
+    bool _queued() const {
+        for (uint8_t i = 0; i < _numSamplers; i++) {
+            if (_samplers[i]->available()) return true;
+        }
+        return false;
+    }
+
+    bool _full() const {
+        if (!_highWater) return false;
+        for (uint8_t i = 0; i < _numSamplers; i++) {
+            if (_samplers[i]->available() >= _highWater) return true;
+        }
+        return false;
+    }
+
+    void _work() {
+        for (uint8_t i = 0; i < _numSamplers; i++) _samplers[i]->poll();
+        if (_hotplug) _hotplug->poll();
+
+        unsigned long now = millis();
+        if (WiFi.status() == WL_CONNECTED) {
+            if (!_powerSave) _powerSave = esp_wifi_set_ps(WIFI_PS_MAX_MODEM) == ESP_OK;
+        } else {
+            _powerSave = false;   // applied again after the next association
+        }
+
+        // One radio wake for both: a flush pulls a near heartbeat forward,
+        // and a heartbeat takes whatever is queued
+        bool queued = _queued();
+        bool flush  = queued && ((_flushMs && now - _lastFlush >= _flushMs) || _full());
+        bool beat   = (long)(now - _reg.due()) >= 0;
+        if (flush && !beat && _until(now, _reg.due()) <= _coalesceMs) {
+            _reg.kick();
+            beat = true;
+        }
+        if ((flush || (beat && queued)) && !_reg.samplesQueued()) {
+            _reg.queueSamples();
+            _lastFlush = now;
+        }
+        _reg.poll();
+    }
+
+    // A request in flight or due, or a batch waiting for one. A registrar
+    // in backoff has none until its retry is due.
+    bool _radioWork() {
+        if (_reg.busy()) return true;
+        if ((long)(millis() - _reg.due()) >= 0) return true;
+        return _reg.samplesQueued() && _reg.failures() == 0;
+    }
+
+    void _sleep(unsigned long ms) {
+        _wakes++;
+        _sleptMs += ms;
+        if (_mode == CEP_SLEEP_DEEP && ms >= _deepMinMs && !_queued() && _reg.registered()) {
+            if (_snapshot) _cep.saveSnapshot(*_snapshot);
+            esp_sleep_enable_timer_wakeup((uint64_t)ms * 1000);
+            esp_deep_sleep_start();   // does not return: setup() runs on wake
+        }
+        if (_mode >= CEP_SLEEP_LIGHT && ms >= _lightMinMs) {
+            bool online = WiFi.status() == WL_CONNECTED;
+            if (online) WiFi.mode(WIFI_OFF);
+            esp_sleep_enable_timer_wakeup((uint64_t)ms * 1000);
+            esp_light_sleep_start();
+            if (online) {
+                WiFi.mode(WIFI_STA);
+                WiFi.begin();
+            }
+            return;
+        }
+        delay(ms);
+    }
+};
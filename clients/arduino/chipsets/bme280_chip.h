@@ -2,21 +2,168 @@
  * clients/arduino/chipsets/bme280_chip.h
  *
  * CEP chipset descriptor for Bosch BME280.
- * Include AFTER cep.h, then call cep.registerChipset(&BME280_Chip).
+ * Include AFTER cep.h, then call cep.registerChipset(&BME280_Chip)
+ * or list &BME280_Chip in cep.useChipsets<...>().
+ *
+ * Everything below is PROGMEM: on AVR the descriptor costs no SRAM.
  */
 
 #pragma once
 #include "../cep.h"
+#include "../cep_sampling.h"
+
+static constexpr char _bme280_name[] PROGMEM = "bme280";
 
 // Zero-terminated address list
-static const uint8_t _bme280_addrs[] = { 0x76, 0x77, 0x00 };
+static constexpr uint8_t _bme280_addrs[] PROGMEM = { 0x76, 0x77, 0x00 };
 
 // Null-terminated provides list
-static const char* _bme280_provides[] = { "temperature", "humidity", "pressure", nullptr };
+static constexpr char _bme280_temperature[] PROGMEM = "temperature";
+static constexpr char _bme280_humidity[]    PROGMEM = "humidity";
+static constexpr char _bme280_pressure[]    PROGMEM = "pressure";
+static constexpr const char* _bme280_provides[] PROGMEM = {
+    _bme280_temperature, _bme280_humidity, _bme280_pressure, nullptr
+};
+
+// ── Sampling ──────────────────────────────────────────────────────────────────
+// Normal mode, x1 oversampling, filter off, standby chosen from the sampler's
+// rate (fastest: a new result roughly every 10 ms). There is no FIFO; each
+// read fetches pressure, temperature and humidity in one 8-byte burst, which
+// the chip latches together so the three never mix conversions.
+// Compensation is the datasheet's integer reference code (BME280 datasheet
+// 4.2.3), so temperature comes out in 0.01 degC, pressure in Pa and humidity
+// in 1/1024 %RH (rescaled to 0.001 %RH).
+
+static constexpr char _bme280_ch_temp[]  PROGMEM = "temperature_centi_c";
+static constexpr char _bme280_ch_press[] PROGMEM = "pressure_pa";
+static constexpr char _bme280_ch_hum[]   PROGMEM = "humidity_milli_pct";
+static constexpr const char* _bme280_channels[] PROGMEM = {
+    _bme280_ch_temp, _bme280_ch_press, _bme280_ch_hum, nullptr
+};
+
+struct _Bme280Calib {
+    uint16_t T1;
+    int16_t  T2, T3;
+    uint16_t P1;
+    int16_t  P2, P3, P4, P5, P6, P7, P8, P9;
+    uint8_t  H1, H3;
+    int16_t  H2, H4, H5;
+    int8_t   H6;
+};
+
+static inline uint16_t _bme280_le16(const uint8_t* b, uint8_t i) {
+    return (uint16_t)(b[i + 1] << 8 | b[i]);
+}
+
+// Longest standby (config t_sb) that still yields a result every 1000/hz ms,
+// allowing 9.5 ms for a x1/x1/x1 conversion. Units of 0.5 ms.
+static constexpr uint16_t _bme280_sb_half_ms[] PROGMEM = { 2000, 1000, 500, 250, 125, 40, 20, 1 };
+static constexpr uint8_t  _bme280_sb_code[]    PROGMEM = {    5,    4,   3,   2,   1,  7,  6, 0 };
+
+static uint8_t _bme280_standby(uint16_t hz) {
+    uint32_t periodHalfMs = hz ? 2000UL / hz : 4000;
+    for (uint8_t i = 0; i < sizeof(_bme280_sb_code); i++) {
+        if (19U + pgm_read_word(&_bme280_sb_half_ms[i]) <= periodHalfMs) {
+            return pgm_read_byte(&_bme280_sb_code[i]);
+        }
+    }
+    return 0;
+}
+
+static bool _bme280_begin(TwoWire& wire, uint8_t address, void* state, const CepSamplerConfig& cfg) {
+    _Bme280Calib& c = *(_Bme280Calib*)state;
+    uint8_t id;
+    if (!cepI2CRead(wire, address, 0xD0, &id, 1) || id != 0x60) return false;   // 0x58 = BMP280
+
+    uint8_t b[26];
+    if (!cepI2CRead(wire, address, 0x88, b, 26)) return false;
+    c.T1 = _bme280_le16(b, 0);
+    c.T2 = (int16_t)_bme280_le16(b, 2);
+    c.T3 = (int16_t)_bme280_le16(b, 4);
+    c.P1 = _bme280_le16(b, 6);
+    c.P2 = (int16_t)_bme280_le16(b, 8);
+    c.P3 = (int16_t)_bme280_le16(b, 10);
+    c.P4 = (int16_t)_bme280_le16(b, 12);
+    c.P5 = (int16_t)_bme280_le16(b, 14);
+    c.P6 = (int16_t)_bme280_le16(b, 16);
+    c.P7 = (int16_t)_bme280_le16(b, 18);
+    c.P8 = (int16_t)_bme280_le16(b, 20);
+    c.P9 = (int16_t)_bme280_le16(b, 22);
+    c.H1 = b[25];
+
+    if (!cepI2CRead(wire, address, 0xE1, b, 7)) return false;
+    c.H2 = (int16_t)_bme280_le16(b, 0);
+    c.H3 = b[2];
+    c.H4 = (int16_t)((int8_t)b[3] * 16 | (b[4] & 0x0F));
+    c.H5 = (int16_t)((int8_t)b[5] * 16 | (b[4] >> 4));
+    c.H6 = (int8_t)b[6];
+
+    return cepI2CWrite8(wire, address, 0xF2, 0x01) &&   // ctrl_hum: humidity x1
+           cepI2CWrite8(wire, address, 0xF5,            // config: standby, no filter
+                        (uint8_t)(_bme280_standby(cfg.rateHz) << 5)) &&
+           cepI2CWrite8(wire, address, 0xF4, 0x27);     // ctrl_meas: T x1, P x1, normal mode
+}
+
+static bool _bme280_read(TwoWire& wire, uint8_t address, void* state, CepSample& out) {
+    const _Bme280Calib& c = *(const _Bme280Calib*)state;
+    uint8_t b[8];
+    if (!cepI2CRead(wire, address, 0xF7, b, 8)) return false;   // press, temp, hum in one burst
+    int32_t adcP = (int32_t)((uint32_t)b[0] << 12 | (uint32_t)b[1] << 4 | b[2] >> 4);
+    int32_t adcT = (int32_t)((uint32_t)b[3] << 12 | (uint32_t)b[4] << 4 | b[5] >> 4);
+    int32_t adcH = (int32_t)((uint32_t)b[6] << 8 | b[7]);
+
+    int32_t v1 = ((((adcT >> 3) - ((int32_t)c.T1 << 1))) * (int32_t)c.T2) >> 11;
+    int32_t v2 = (((((adcT >> 4) - (int32_t)c.T1) * ((adcT >> 4) - (int32_t)c.T1)) >> 12) *
+                  (int32_t)c.T3) >> 14;
+    int32_t tFine = v1 + v2;
+    out.values[0] = (tFine * 5 + 128) >> 8;
+
+    v1 = (tFine >> 1) - 64000;
+    v2 = (((v1 >> 2) * (v1 >> 2)) >> 11) * (int32_t)c.P6;
+    v2 = v2 + ((v1 * (int32_t)c.P5) << 1);
+    v2 = (v2 >> 2) + ((int32_t)c.P4 << 16);
+    v1 = ((((int32_t)c.P3 * (((v1 >> 2) * (v1 >> 2)) >> 13)) >> 3) + (((int32_t)c.P2 * v1) >> 1)) >> 18;
+    v1 = ((32768 + v1) * (int32_t)c.P1) >> 15;
+    uint32_t pa = 0;
+    if (v1 != 0) {
+        pa = ((uint32_t)(1048576 - adcP) - (uint32_t)(v2 >> 12)) * 3125;
+        pa = pa < 0x80000000UL ? (pa << 1) / (uint32_t)v1 : (pa / (uint32_t)v1) * 2;
+        v1 = ((int32_t)c.P9 * (int32_t)(((pa >> 3) * (pa >> 3)) >> 13)) >> 12;
+        v2 = ((int32_t)(pa >> 2) * (int32_t)c.P8) >> 13;
+        pa = (uint32_t)((int32_t)pa + ((v1 + v2 + c.P7) >> 4));
+    }
+    out.values[1] = (int32_t)pa;
+
+    int32_t h = tFine - 76800;
+    h = (((((adcH << 14) - ((int32_t)c.H4 << 20) - ((int32_t)c.H5 * h)) + 16384) >> 15) *
+         (((((((h * (int32_t)c.H6) >> 10) * (((h * (int32_t)c.H3) >> 11) + 32768)) >> 10) +
+            2097152) * (int32_t)c.H2 + 8192) >> 14));
+    h = h - (((((h >> 15) * (h >> 15)) >> 7) * (int32_t)c.H1) >> 4);
+    if (h < 0) h = 0;
+    if (h > 419430400) h = 419430400;
+    out.values[2] = ((h >> 12) * 1000) >> 10;
+
+    out.count = 3;
+    return true;
+}
+
+static_assert(sizeof(_Bme280Calib) <= CEP_SAMPLER_STATE, "CEP_SAMPLER_STATE too small for BME280");
+
+static constexpr CepSamplerOps _bme280_sampler PROGMEM = {
+    _bme280_channels,             // channels
+    sizeof(_Bme280Calib),         // stateSize
+    100,                          // maxRateHz
+    _bme280_begin,                // begin
+    _bme280_read,                 // read
+    nullptr,                      // drain: no FIFO
+};
 
-static const CepChipsetDescriptor BME280_Chip = {
-    .name          = "bme280",
-    .i2cAddresses  = _bme280_addrs,
-    .provides      = _bme280_provides,
-    .bus           = "i2c",
+static constexpr CepChipsetDescriptor BME280_Chip PROGMEM = {
+    _bme280_name,        // name
+    _bme280_addrs,       // i2cAddresses
+    _bme280_provides,    // provides
+    CEP_BUS_I2C,         // bus
+    nullptr,             // describeTo: default sensor JSON
+    &_bme280_sampler,    // sampler
+    0,                   // flags
 };
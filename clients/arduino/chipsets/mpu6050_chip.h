@@ -6,13 +6,142 @@
 
 #pragma once
 #include "../cep.h"
+#include "../cep_sampling.h"
 
-static const uint8_t _mpu6050_addrs[]   = { 0x68, 0x69, 0x00 };
-static const char*   _mpu6050_provides[] = { "acceleration", "gyroscope", "temperature", nullptr };
+static constexpr char    _mpu6050_name[]  PROGMEM = "mpu6050";
+static constexpr uint8_t _mpu6050_addrs[] PROGMEM = { 0x68, 0x69, 0x00 };
 
-static const CepChipsetDescriptor MPU6050_Chip = {
-    .name         = "mpu6050",
-    .i2cAddresses = _mpu6050_addrs,
-    .provides     = _mpu6050_provides,
-    .bus          = "i2c",
+static constexpr char _mpu6050_acceleration[] PROGMEM = "acceleration";
+static constexpr char _mpu6050_gyroscope[]    PROGMEM = "gyroscope";
+static constexpr char _mpu6050_temperature[]  PROGMEM = "temperature";
+static constexpr const char* _mpu6050_provides[] PROGMEM = {
+    _mpu6050_acceleration, _mpu6050_gyroscope, _mpu6050_temperature, nullptr
+};
+
+// ── Sampling ──────────────────────────────────────────────────────────────────
+// +-2 g / +-250 dps, 1 kHz internal rate divided down to the sampler's rate,
+// DLPF below half of it. Direct reads fetch the newest frame in one 14-byte
+// burst. In FIFO mode the chip queues every frame (1 KB, 73 frames = 73 ms at
+// 1 kHz) and drain() pulls them out in as few reads as the Wire buffer allows
+// (9 frames per read on ESP32, 2 on AVR). Values scaled to mg, 0.001 dps and
+// 0.01 degC.
+
+static constexpr char _mpu6050_ch_ax[] PROGMEM = "accel_x_mg";
+static constexpr char _mpu6050_ch_ay[] PROGMEM = "accel_y_mg";
+static constexpr char _mpu6050_ch_az[] PROGMEM = "accel_z_mg";
+static constexpr char _mpu6050_ch_t[]  PROGMEM = "temperature_centi_c";
+static constexpr char _mpu6050_ch_gx[] PROGMEM = "gyro_x_mdps";
+static constexpr char _mpu6050_ch_gy[] PROGMEM = "gyro_y_mdps";
+static constexpr char _mpu6050_ch_gz[] PROGMEM = "gyro_z_mdps";
+static constexpr const char* _mpu6050_channels[] PROGMEM = {
+    _mpu6050_ch_ax, _mpu6050_ch_ay, _mpu6050_ch_az, _mpu6050_ch_t,
+    _mpu6050_ch_gx, _mpu6050_ch_gy, _mpu6050_ch_gz, nullptr
+};
+
+static constexpr uint8_t  _MPU6050_FRAME    = 14;     // accel, temp, gyro: 7 x int16 BE
+static constexpr uint16_t _MPU6050_FIFO_MAX = 1024;
+
+static_assert(CEP_I2C_CHUNK >= _MPU6050_FRAME, "Wire buffer cannot hold one MPU-6050 frame");
+
+struct _Mpu6050State {
+    uint32_t periodUs;   // output data period, for FIFO timestamps
+};
+
+static void _mpu6050_decode(const uint8_t* b, CepSample& out) {
+    for (uint8_t i = 0; i < 7; i++) {
+        int32_t raw = (int16_t)(b[2 * i] << 8 | b[2 * i + 1]);
+        if (i < 3)       out.values[i] = raw * 1000 / 16384;    // 16384 LSB/g
+        else if (i == 3) out.values[i] = raw * 100 / 340 + 3653; // datasheet: /340 + 36.53
+        else             out.values[i] = raw * 1000 / 131;      // 131 LSB/dps
+    }
+    out.count = 7;
+}
+
+static bool _mpu6050_begin(TwoWire& wire, uint8_t address, void* state, const CepSamplerConfig& cfg) {
+    _Mpu6050State& st = *(_Mpu6050State*)state;
+    uint16_t hz  = cfg.rateHz ? cfg.rateHz : 1000;
+    uint16_t d   = 1000 / hz - 1;
+    uint8_t  div = d > 255 ? 255 : (uint8_t)d;
+    st.periodUs  = 1000UL * (div + 1);
+
+    // Widest DLPF (CONFIG 1..6: 184, 94, 44, 21, 10, 5 Hz) at or below hz / 2;
+    // 5 Hz below 20 Hz
+    uint8_t dlpf = hz >= 400 ? 1 : hz >= 200 ? 2 : hz >= 100 ? 3 : hz >= 50 ? 4 : hz >= 20 ? 5 : 6;
+
+    if (!(cepI2CWrite8(wire, address, 0x6B, 0x01) &&       // PWR_MGMT_1: wake, gyro X PLL clock
+          cepI2CWrite8(wire, address, 0x1A, dlpf) &&       // CONFIG: DLPF on -> 1 kHz internal rate
+          cepI2CWrite8(wire, address, 0x19, div) &&        // SMPLRT_DIV: 1 kHz / (1 + div)
+          cepI2CWrite8(wire, address, 0x1B, 0x00) &&       // GYRO_CONFIG: +-250 dps
+          cepI2CWrite8(wire, address, 0x1C, 0x00))) {      // ACCEL_CONFIG: +-2 g
+        return false;
+    }
+    if (!cfg.fifo) {
+        return cepI2CWrite8(wire, address, 0x23, 0x00) &&  // FIFO_EN: nothing queued
+               cepI2CWrite8(wire, address, 0x6A, 0x00);    // USER_CTRL: FIFO off
+    }
+    return cepI2CWrite8(wire, address, 0x23, 0xF8) &&      // FIFO_EN: temp, gyro xyz, accel
+           cepI2CWrite8(wire, address, 0x6A, 0x04) &&      // USER_CTRL: FIFO reset
+           cepI2CWrite8(wire, address, 0x6A, 0x40);        // USER_CTRL: FIFO on
+}
+
+static bool _mpu6050_read(TwoWire& wire, uint8_t address, void*, CepSample& out) {
+    uint8_t b[_MPU6050_FRAME];
+    if (!cepI2CRead(wire, address, 0x3B, b, _MPU6050_FRAME)) return false;   // ACCEL_XOUT_H .. GYRO_ZOUT_L
+    _mpu6050_decode(b, out);
+    return true;
+}
+
+static int16_t _mpu6050_drain(TwoWire& wire, uint8_t address, void* state, CepSampleRing& ring) {
+    const _Mpu6050State& st = *(const _Mpu6050State*)state;
+    uint8_t b[CEP_I2C_CHUNK - CEP_I2C_CHUNK % _MPU6050_FRAME];
+
+    if (!cepI2CRead(wire, address, 0x72, b, 2)) return -1;   // FIFO_COUNT_H/L
+    uint32_t now   = micros();
+    uint16_t bytes = (uint16_t)(b[0] << 8 | b[1]);
+    if (bytes > _MPU6050_FIFO_MAX - _MPU6050_FIFO_MAX % _MPU6050_FRAME) {
+        // Overflowed: the oldest bytes were overwritten, so frames no longer
+        // line up. Start over.
+        cepI2CWrite8(wire, address, 0x6A, 0x44);              // USER_CTRL: FIFO on + reset
+        return -1;
+    }
+
+    // Whole frames only; a partial one is still being written
+    uint16_t frames = bytes / _MPU6050_FRAME;
+    uint16_t done   = 0;
+    while (done < frames) {
+        uint16_t n = (uint16_t)(sizeof(b) / _MPU6050_FRAME);
+        if (n > frames - done) n = frames - done;
+        // FIFO_R_W does not auto-increment: a burst keeps popping the queue
+        if (!cepI2CRead(wire, address, 0x74, b, (uint8_t)(n * _MPU6050_FRAME))) {
+            return done ? (int16_t)done : -1;
+        }
+        for (uint16_t i = 0; i < n; i++, done++) {
+            CepSample s;
+            _mpu6050_decode(b + i * _MPU6050_FRAME, s);
+            s.timestampUs = now - (uint32_t)(frames - 1 - done) * st.periodUs;
+            ring.push(s);
+        }
+    }
+    return (int16_t)done;
+}
+
+static_assert(sizeof(_Mpu6050State) <= CEP_SAMPLER_STATE, "CEP_SAMPLER_STATE too small for MPU-6050");
+
+static constexpr CepSamplerOps _mpu6050_sampler PROGMEM = {
+    _mpu6050_channels,       // channels
+    sizeof(_Mpu6050State),   // stateSize
+    1000,                    // maxRateHz
+    _mpu6050_begin,          // begin
+    _mpu6050_read,           // read
+    _mpu6050_drain,          // drain
+};
+
+static constexpr CepChipsetDescriptor MPU6050_Chip PROGMEM = {
+    _mpu6050_name,       // name
+    _mpu6050_addrs,      // i2cAddresses
+    _mpu6050_provides,   // provides
+    CEP_BUS_I2C,         // bus
+    nullptr,             // describeTo: default sensor JSON
+    &_mpu6050_sampler,   // sampler
+    0,                   // flags
 };
@@ -1,33 +1,408 @@
 /**
  * clients/arduino/chipsets/ssd1306_chip.h
  *
- * CEP chipset descriptor for SSD1306 OLED display.
+ * CEP chipset descriptor for SSD1306 OLED display, plus a small driver:
+ * a 1 KB framebuffer that tracks which columns of which pages changed, so
+ * flush() only sends those over I2C, and a display list of text / bar / box
+ * items that redraws just the items whose content changed.
+ *
+ * Usage:
+ *   CepSsd1306 oled;                           // 1 KB SRAM: ESP32 / larger AVRs
+ *   oled.begin(cep);                           // first SSD1306 the scan found
+ *
+ *   CepDisplayList<6> ui;
+ *   int8_t label = ui.addText(0, 0, 128);      // one 8 px text line
+ *   int8_t score = ui.addBar(0, 10, 128, 6);   // 0..1000 permille
+ *   ...
+ *   ui.setText(label, "cat");                  // e.g. from a JumpNet /infer result
+ *   ui.setValue(score, 930);
+ *   ui.render(oled);                           // redraw changed items
+ *   oled.flush();                              // send changed bytes only
  */
 
 #pragma once
 #include "../cep.h"
+#include "../cep_sampling.h"
+
+static constexpr char    _ssd1306_name[]  PROGMEM = "ssd1306";
+static constexpr uint8_t _ssd1306_addrs[] PROGMEM = { 0x3C, 0x3D, 0x00 };
+
+static constexpr char        _ssd1306_display[]  PROGMEM = "display";
+static constexpr const char* _ssd1306_provides[] PROGMEM = { _ssd1306_display, nullptr };
+
+// Reports as a display capability rather than a generic sensor
+static void _ssd1306_describe(CepJsonWriter& w, uint8_t busId, uint8_t address) {
+    w.beginObject();
+    w.member(F("type"), F("display"));
+    w.member(F("chipset"), (const __FlashStringHelper*)_ssd1306_name);
+    w.member(F("bus"), (const __FlashStringHelper*)CEP_BUS_I2C);
+    w.member(F("bus_id"), (int)busId);
+    w.memberHex8(F("address"), address);
+    w.member(F("width_px"), 128);
+    w.member(F("height_px"), 64);
+    w.member(F("color"), false);
+    w.endObject();
+}
+
+static constexpr CepChipsetDescriptor SSD1306_Chip PROGMEM = {
+    _ssd1306_name,       // name
+    _ssd1306_addrs,      // i2cAddresses
+    _ssd1306_provides,   // provides
+    CEP_BUS_I2C,         // bus
+    _ssd1306_describe,   // describeTo
+    nullptr,             // sampler: display, nothing to read
+    0,                   // flags
+};
+
+// ── Driver ────────────────────────────────────────────────────────────────────
+// 128x64, horizontal addressing. The framebuffer uses the controller's own
+// layout (8 pages of 128 columns, one byte = 8 vertical pixels, LSB on top),
+// so a dirty column range of a page goes out as one contiguous write.
+
+// Classic 5x7 font, ASCII 0x20-0x7E, one byte per column
+static constexpr uint8_t _ssd1306_font[] PROGMEM = {
+    0x00,0x00,0x00,0x00,0x00, 0x00,0x00,0x5F,0x00,0x00, 0x00,0x07,0x00,0x07,0x00, 0x14,0x7F,0x14,0x7F,0x14,
+    0x24,0x2A,0x7F,0x2A,0x12, 0x23,0x13,0x08,0x64,0x62, 0x36,0x49,0x55,0x22,0x50, 0x00,0x05,0x03,0x00,0x00,
+    0x00,0x1C,0x22,0x41,0x00, 0x00,0x41,0x22,0x1C,0x00, 0x08,0x2A,0x1C,0x2A,0x08, 0x08,0x08,0x3E,0x08,0x08,
+    0x00,0x50,0x30,0x00,0x00, 0x08,0x08,0x08,0x08,0x08, 0x00,0x60,0x60,0x00,0x00, 0x20,0x10,0x08,0x04,0x02,
+    0x3E,0x51,0x49,0x45,0x3E, 0x00,0x42,0x7F,0x40,0x00, 0x42,0x61,0x51,0x49,0x46, 0x21,0x41,0x45,0x4B,0x31,
+    0x18,0x14,0x12,0x7F,0x10, 0x27,0x45,0x45,0x45,0x39, 0x3C,0x4A,0x49,0x49,0x30, 0x01,0x71,0x09,0x05,0x03,
+    0x36,0x49,0x49,0x49,0x36, 0x06,0x49,0x49,0x29,0x1E, 0x00,0x36,0x36,0x00,0x00, 0x00,0x56,0x36,0x00,0x00,
+    0x00,0x08,0x14,0x22,0x41, 0x14,0x14,0x14,0x14,0x14, 0x41,0x22,0x14,0x08,0x00, 0x02,0x01,0x51,0x09,0x06,
+    0x32,0x49,0x79,0x41,0x3E, 0x7E,0x11,0x11,0x11,0x7E, 0x7F,0x49,0x49,0x49,0x36, 0x3E,0x41,0x41,0x41,0x22,
+    0x7F,0x41,0x41,0x22,0x1C, 0x7F,0x49,0x49,0x49,0x41, 0x7F,0x09,0x09,0x01,0x01, 0x3E,0x41,0x41,0x51,0x32,
+    0x7F,0x08,0x08,0x08,0x7F, 0x00,0x41,0x7F,0x41,0x00, 0x20,0x40,0x41,0x3F,0x01, 0x7F,0x08,0x14,0x22,0x41,
+    0x7F,0x40,0x40,0x40,0x40, 0x7F,0x02,0x04,0x02,0x7F, 0x7F,0x04,0x08,0x10,0x7F, 0x3E,0x41,0x41,0x41,0x3E,
+    0x7F,0x09,0x09,0x09,0x06, 0x3E,0x41,0x51,0x21,0x5E, 0x7F,0x09,0x19,0x29,0x46, 0x46,0x49,0x49,0x49,0x31,
+    0x01,0x01,0x7F,0x01,0x01, 0x3F,0x40,0x40,0x40,0x3F, 0x1F,0x20,0x40,0x20,0x1F, 0x7F,0x20,0x18,0x20,0x7F,
+    0x63,0x14,0x08,0x14,0x63, 0x03,0x04,0x78,0x04,0x03, 0x61,0x51,0x49,0x45,0x43, 0x00,0x00,0x7F,0x41,0x41,
+    0x02,0x04,0x08,0x10,0x20, 0x41,0x41,0x7F,0x00,0x00, 0x04,0x02,0x01,0x02,0x04, 0x40,0x40,0x40,0x40,0x40,
+    0x00,0x01,0x02,0x04,0x00, 0x20,0x54,0x54,0x54,0x78, 0x7F,0x48,0x44,0x44,0x38, 0x38,0x44,0x44,0x44,0x20,
+    0x38,0x44,0x44,0x48,0x7F, 0x38,0x54,0x54,0x54,0x18, 0x08,0x7E,0x09,0x01,0x02, 0x08,0x14,0x54,0x54,0x3C,
+    0x7F,0x08,0x04,0x04,0x78, 0x00,0x44,0x7D,0x40,0x00, 0x20,0x40,0x44,0x3D,0x00, 0x00,0x7F,0x10,0x28,0x44,
+    0x00,0x41,0x7F,0x40,0x00, 0x7C,0x04,0x18,0x04,0x78, 0x7C,0x08,0x04,0x04,0x78, 0x38,0x44,0x44,0x44,0x38,
+    0x7C,0x14,0x14,0x14,0x08, 0x08,0x14,0x14,0x18,0x7C, 0x7C,0x08,0x04,0x04,0x08, 0x48,0x54,0x54,0x54,0x20,
+    0x04,0x3F,0x44,0x40,0x20, 0x3C,0x40,0x40,0x20,0x7C, 0x1C,0x20,0x40,0x20,0x1C, 0x3C,0x40,0x30,0x40,0x3C,
+    0x44,0x28,0x10,0x28,0x44, 0x0C,0x50,0x50,0x50,0x3C, 0x44,0x64,0x54,0x4C,0x44, 0x00,0x08,0x36,0x41,0x00,
+    0x00,0x00,0x7F,0x00,0x00, 0x00,0x41,0x36,0x08,0x00, 0x08,0x04,0x08,0x10,0x08,
+};
+
+// Power-up sequence for a 128x64 panel with the internal charge pump
+static constexpr uint8_t _ssd1306_init[] PROGMEM = {
+    0xAE,         // display off
+    0xD5, 0x80,   // clock divide
+    0xA8, 0x3F,   // multiplex 64
+    0xD3, 0x00,   // no display offset
+    0x40,         // start line 0
+    0x8D, 0x14,   // charge pump on
+    0x20, 0x00,   // horizontal addressing
+    0xA1, 0xC8,   // segment remap, COM scan descending: (0,0) top left
+    0xDA, 0x12,   // COM pins
+    0x81, 0xCF,   // contrast
+    0xD9, 0xF1,   // precharge
+    0xDB, 0x40,   // VCOMH deselect
+    0xA4, 0xA6,   // show RAM, not inverted
+    0xAF,         // display on
+};
+
+class CepSsd1306 {
+public:
+    static constexpr uint8_t WIDTH  = 128;
+    static constexpr uint8_t HEIGHT = 64;
+    static constexpr uint8_t PAGES  = HEIGHT / 8;
+
+    CepSsd1306() : _bus(), _address(0), _lastFlush(0), _ready(false) {
+        memset(_fb, 0, sizeof(_fb));
+        invalidate();
+    }
+
+    // Initialise the nth SSD1306 the CEP scan found
+    bool begin(CEP& cep, uint8_t nth = 0) {
+        uint8_t busId, address;
+        if (!cep.locate(&SSD1306_Chip, busId, address, nth)) return false;
+        return begin(cep.scanConfig().buses[busId], address);
+    }
+
+    bool begin(const CepI2CBus& bus, uint8_t address = 0x3C) {
+        _bus     = bus;
+        _address = address;
+        _select();
+        uint8_t cmd[sizeof(_ssd1306_init)];
+        memcpy_P(cmd, _ssd1306_init, sizeof(cmd));
+        _ready = _command(cmd, sizeof(cmd));
+        _release();
+        invalidate();   // panel RAM is undefined at power-up
+        return _ready;
+    }
+
+    // ── Drawing: framebuffer only, nothing is sent until flush() ─────────────
+
+    void clear() { fill(0, 0, WIDTH, HEIGHT, false); }
+
+    void pixel(uint8_t x, uint8_t y, bool on = true) {
+        if (x >= WIDTH || y >= HEIGHT) return;
+        _apply(y >> 3, x, (uint8_t)(1 << (y & 7)), on);
+    }
+
+    // Filled rectangle, clipped to the panel
+    void fill(uint8_t x, uint8_t y, uint8_t w, uint8_t h, bool on = true) {
+        if (x >= WIDTH || y >= HEIGHT || !w || !h) return;
+        uint8_t x1 = (uint16_t)x + w > WIDTH ? WIDTH : (uint8_t)(x + w);
+        uint8_t y1 = (uint16_t)y + h > HEIGHT ? HEIGHT : (uint8_t)(y + h);
+        for (uint8_t page = y >> 3; page <= (y1 - 1) >> 3; page++) {
+            uint8_t top  = page * 8;
+            uint8_t from = y > top ? y - top : 0;
+            uint8_t to   = y1 - top < 8 ? y1 - top : 8;
+            uint8_t mask = (uint8_t)((0xFF << from) & (0xFF >> (8 - to)));
+            for (uint8_t cx = x; cx < x1; cx++) _apply(page, cx, mask, on);
+        }
+    }
+
+    // One pixel outline
+    void box(uint8_t x, uint8_t y, uint8_t w, uint8_t h, bool on = true) {
+        if (!w || !h) return;
+        fill(x, y, w, 1, on);
+        fill(x, y + h - 1, w, 1, on);
+        fill(x, y, 1, h, on);
+        fill(x + w - 1, y, 1, h, on);
+    }
+
+    // Horizontal bar: outline with the left permille/1000 filled
+    void bar(uint8_t x, uint8_t y, uint8_t w, uint8_t h, uint16_t permille) {
+        if (w < 3 || h < 3) return;
+        if (permille > 1000) permille = 1000;
+        uint8_t inner = (uint8_t)((uint32_t)(w - 2) * permille / 1000);
+        box(x, y, w, h);
+        fill(x + 1, y + 1, inner, h - 2, true);
+        fill(x + 1 + inner, y + 1, w - 2 - inner, h - 2, false);
+    }
+
+    // 5x7 text, 6 px per character; unknown bytes draw as '?'. Returns the x
+    // after the last character.
+    uint8_t text(uint8_t x, uint8_t y, const char* s, bool on = true) {
+        while (*s && x < WIDTH) x = _char(x, y, *s++, on);
+        return x;
+    }
+
+    uint8_t text(uint8_t x, uint8_t y, const __FlashStringHelper* s, bool on = true) {
+        const char* p = (const char*)s;
+        char c;
+        while ((c = (char)pgm_read_byte(p++)) && x < WIDTH) x = _char(x, y, c, on);
+        return x;
+    }
+
+    // ── Transfer ─────────────────────────────────────────────────────────────
+
+    bool isDirty() const {
+        for (uint8_t p = 0; p < PAGES; p++) {
+            if (_lo[p] <= _hi[p]) return true;
+        }
+        return false;
+    }
 
-static const uint8_t  _ssd1306_addrs[]   = { 0x3C, 0x3D, 0x00 };
-static const char*    _ssd1306_provides[] = { "display", nullptr };
+    // Mark everything for resend (e.g. after the panel lost power)
+    void invalidate() {
+        for (uint8_t p = 0; p < PAGES; p++) {
+            _lo[p] = 0;
+            _hi[p] = WIDTH - 1;
+        }
+    }
+
+    // Send the changed column range of each changed page. A page that fails
+    // stays dirty and is retried by the next flush(). Returns true when the
+    // panel matches the framebuffer.
+    bool flush() {
+        _lastFlush = 0;
+        if (!_ready) return false;
+        _select();
+        bool ok = true;
+        for (uint8_t p = 0; p < PAGES; p++) {
+            if (_lo[p] > _hi[p]) continue;
+            uint8_t cmd[] = { 0x21, _lo[p], _hi[p], 0x22, p, p };   // column, page window
+            if (!_command(cmd, sizeof(cmd)) || !_data(&_fb[p * WIDTH + _lo[p]], _hi[p] - _lo[p] + 1)) {
+                ok = false;
+                continue;
+            }
+            _lastFlush += _hi[p] - _lo[p] + 1;
+            _lo[p] = 0xFF;
+            _hi[p] = 0;
+        }
+        _release();
+        return ok;
+    }
+
+    // Framebuffer bytes sent by the last flush()
+    uint16_t lastFlushBytes() const { return _lastFlush; }
+
+    const uint8_t* buffer() const { return _fb; }
+
+private:
+    uint8_t   _fb[WIDTH * PAGES];
+    uint8_t   _lo[PAGES];    // dirty column range per page, clean when lo > hi
+    uint8_t   _hi[PAGES];
+    CepI2CBus _bus;
+    uint8_t   _address;
+    uint16_t  _lastFlush;
+    bool      _ready;
+
+    // Set or clear mask in one byte; only a real change dirties the column
+    void _apply(uint8_t page, uint8_t x, uint8_t mask, bool on) {
+        uint8_t& b = _fb[page * WIDTH + x];
+        uint8_t  v = on ? (uint8_t)(b | mask) : (uint8_t)(b & ~mask);
+        if (v == b) return;
+        b = v;
+        if (x < _lo[page]) _lo[page] = x;
+        if (x > _hi[page]) _hi[page] = x;
+    }
+
+    uint8_t _char(uint8_t x, uint8_t y, char c, bool on) {
+        if (c < 0x20 || c > 0x7E) c = '?';
+        const uint8_t* glyph = &_ssd1306_font[(c - 0x20) * 5];
+        for (uint8_t col = 0; col < 6; col++) {
+            uint8_t bits = col < 5 ? pgm_read_byte(&glyph[col]) : 0;   // column 6: spacing
+            for (uint8_t row = 0; row < 8; row++) {
+                pixel(x + col, y + row, ((bits >> row) & 1) ? on : !on);
+            }
+        }
+        return x + 6;
+    }
+
+    void _select() {
+        if (_bus.muxAddress) cepSelectMux(_bus, (uint8_t)(1 << _bus.muxChannel));
+    }
+
+    // Close the channel after each transfer, as the scan does
+    void _release() {
+        if (_bus.muxAddress) cepSelectMux(_bus, 0);
+    }
 
-struct SSD1306ChipDescriptor : public CepChipsetDescriptor {
-    SSD1306ChipDescriptor() {
-        name         = "ssd1306";
-        i2cAddresses = _ssd1306_addrs;
-        provides     = _ssd1306_provides;
-        bus          = "i2c";
+    bool _command(const uint8_t* cmd, uint8_t n) {
+        _bus.wire->beginTransmission(_address);
+        _bus.wire->write((uint8_t)0x00);   // control byte: commands follow
+        for (uint8_t i = 0; i < n; i++) _bus.wire->write(cmd[i]);
+        return _bus.wire->endTransmission() == 0;
     }
 
-    String describe(int busId, uint8_t address) const override {
-        char hex[7];
-        snprintf(hex, sizeof(hex), "0x%02x", address);
-        String s = "{\"type\":\"display\"";
-        s += ",\"chipset\":\"ssd1306\"";
-        s += ",\"bus\":\"i2c\",\"bus_id\":" + String(busId);
-        s += ",\"address\":\"" + String(hex) + "\"";
-        s += ",\"width_px\":128,\"height_px\":64,\"color\":false}";
-        return s;
+    // GDDRAM data in transfers sized to the Wire buffer (control byte + data)
+    bool _data(const uint8_t* p, uint8_t n) {
+        while (n) {
+            uint8_t len = n < CEP_I2C_CHUNK - 1 ? n : CEP_I2C_CHUNK - 1;
+            _bus.wire->beginTransmission(_address);
+            _bus.wire->write((uint8_t)0x40);   // control byte: data follows
+            for (uint8_t i = 0; i < len; i++) _bus.wire->write(p[i]);
+            if (_bus.wire->endTransmission() != 0) return false;
+            p += len;
+            n -= len;
+        }
+        return true;
     }
 };
 
-static SSD1306ChipDescriptor SSD1306_Chip;
+// ── Display list ──────────────────────────────────────────────────────────────
+// Fixed set of items, each with its own box on screen. Setting an item only
+// marks it changed when the content differs; render() clears and redraws
+// changed boxes, so the framebuffer (and the next flush) only sees them.
+
+#ifndef CEP_DRAW_TEXT_LEN
+#define CEP_DRAW_TEXT_LEN 22   // 128 px / 6 px per character + NUL
+#endif
+
+enum CepDrawKind : uint8_t {
+    CEP_DRAW_TEXT,   // one line, clipped to the box width
+    CEP_DRAW_BAR,    // value = 0..1000 permille
+    CEP_DRAW_BOX,    // static outline
+};
+
+struct CepDrawItem {
+    CepDrawKind kind;
+    uint8_t     x, y, w, h;
+    uint16_t    value;
+    bool        changed;
+    char        text[CEP_DRAW_TEXT_LEN];
+};
+
+template <uint8_t N>
+class CepDisplayList {
+public:
+    CepDisplayList() : _count(0) {}
+
+    // Each returns the item index, or -1 when the list is full
+    int8_t addText(uint8_t x, uint8_t y, uint8_t w, const char* initial = "") {
+        int8_t i = _add(CEP_DRAW_TEXT, x, y, w, 8);
+        if (i >= 0) setText(i, initial);
+        return i;
+    }
+    int8_t addBar(uint8_t x, uint8_t y, uint8_t w, uint8_t h) { return _add(CEP_DRAW_BAR, x, y, w, h); }
+    int8_t addBox(uint8_t x, uint8_t y, uint8_t w, uint8_t h) { return _add(CEP_DRAW_BOX, x, y, w, h); }
+
+    void setText(int8_t i, const char* s) {
+        if (!_valid(i)) return;
+        CepDrawItem& it = _items[i];
+        uint8_t max = it.w / 6 < CEP_DRAW_TEXT_LEN - 1 ? it.w / 6 : CEP_DRAW_TEXT_LEN - 1;
+        char clipped[CEP_DRAW_TEXT_LEN];
+        strncpy(clipped, s, max);
+        clipped[max] = '\0';
+        if (strcmp(clipped, it.text) == 0) return;
+        memcpy(it.text, clipped, max + 1);
+        it.changed = true;
+    }
+
+    void setValue(int8_t i, uint16_t value) {
+        if (!_valid(i) || _items[i].value == value) return;
+        _items[i].value   = value;
+        _items[i].changed = true;
+    }
+
+    // Redraw everything on the next render() (e.g. after display.clear())
+    void invalidate() {
+        for (uint8_t i = 0; i < _count; i++) _items[i].changed = true;
+    }
+
+    // Draw changed items into the framebuffer; returns how many were drawn
+    uint8_t render(CepSsd1306& d) {
+        uint8_t drawn = 0;
+        for (uint8_t i = 0; i < _count; i++) {
+            CepDrawItem& it = _items[i];
+            if (!it.changed) continue;
+            switch (it.kind) {
+            case CEP_DRAW_TEXT: {
+                uint8_t end = d.text(it.x, it.y, it.text);   // glyphs paint their background
+                if (end < it.x + it.w) d.fill(end, it.y, it.x + it.w - end, it.h, false);   // old tail
+                break;
+            }
+            case CEP_DRAW_BAR:
+                d.bar(it.x, it.y, it.w, it.h, it.value);
+                break;
+            case CEP_DRAW_BOX:
+                d.box(it.x, it.y, it.w, it.h);
+                break;
+            }
+            it.changed = false;
+            drawn++;
+        }
+        return drawn;
+    }
+
+    const CepDrawItem& item(int8_t i) const { return _items[i]; }
+    uint8_t count() const { return _count; }
+
+private:
+    CepDrawItem _items[N];
+    uint8_t     _count;
+
+    bool _valid(int8_t i) const { return i >= 0 && i < _count; }
+
+    int8_t _add(CepDrawKind kind, uint8_t x, uint8_t y, uint8_t w, uint8_t h) {
+        if (_count >= N) return -1;
+        CepDrawItem& it = _items[_count];
+        it.kind    = kind;
+        it.x       = x;
+        it.y       = y;
+        it.w       = w;
+        it.h       = h;
+        it.value   = 0;
+        it.changed = true;
+        it.text[0] = '\0';
+        return (int8_t)_count++;
+    }
+};
@@ -0,0 +1,178 @@
+/*
+ * host/Arduino.h  —  Minimal Arduino core for building cep.h on a PC
+ *
+ * Just enough of Print, String, F()/PROGMEM and the timing calls for the CEP
+ * headers to compile and run on x86 with g++ or clang++, so serializer
+ * variants can be benchmarked and diffed without a board (see
+ * cep_bench_host.cpp). Flash and SRAM are the same memory here: PROGMEM is
+ * empty and pgm_read_* are plain loads.
+ *
+ * With -DESP32 the ESP object is included as well. Its heap figures come
+ * from counting operator new/delete (host.cpp), so String churn shows up in
+ * getFreeHeap() / getMinFreeHeap() as it would on the device.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <strings.h>
+#include <string>
+
+#define ARDUINO 10819
+#ifndef ARDUINO_BOARD
+#define ARDUINO_BOARD "host"
+#endif
+
+static const uint8_t SDA = 21;
+static const uint8_t SCL = 22;
+
+// ── Flash strings ─────────────────────────────────────────────────────────────
+
+#define PROGMEM
+class __FlashStringHelper;
+#define F(s)   (reinterpret_cast<const __FlashStringHelper*>(s))
+#define PSTR(s) (s)
+
+#define pgm_read_byte(p)  (*(const uint8_t*)(p))
+#define pgm_read_word(p)  (*(const uint16_t*)(p))
+#define pgm_read_dword(p) (*(const uint32_t*)(p))
+#define pgm_read_ptr(p)   (*(void* const*)(p))
+#define strlen_P  strlen
+#define memcpy_P  memcpy
+#define strcmp_P  strcmp
+#define strncmp_P strncmp
+
+// ── String ────────────────────────────────────────────────────────────────────
+
+class String {
+public:
+    String() {}
+    String(const char* s) : _s(s ? s : "") {}
+    String(const __FlashStringHelper* s) : _s((const char*)s) {}
+    String(char c) : _s(1, c) {}
+    String(int v) : _s(std::to_string(v)) {}
+    String(unsigned int v) : _s(std::to_string(v)) {}
+    String(long v) : _s(std::to_string(v)) {}
+    String(unsigned long v) : _s(std::to_string(v)) {}
+
+    unsigned int length() const { return (unsigned int)_s.size(); }
+    const char*  c_str() const  { return _s.c_str(); }
+    bool reserve(unsigned int n) { _s.reserve(n); return true; }
+
+    bool concat(const char* s, unsigned int n) { _s.append(s, n); return true; }
+    String& operator+=(const String& o) { _s += o._s; return *this; }
+    String& operator+=(const char* s)   { _s += s; return *this; }
+    String& operator+=(char c)          { _s += c; return *this; }
+    bool operator==(const String& o) const { return _s == o._s; }
+    bool operator!=(const String& o) const { return _s != o._s; }
+    char operator[](unsigned int i) const  { return _s[i]; }
+
+private:
+    std::string _s;
+};
+
+// ── Print / Stream ────────────────────────────────────────────────────────────
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* b, size_t n) {
+        size_t k = 0;
+        while (n--) k += write(*b++);
+        return k;
+    }
+    size_t write(const char* s)           { return s ? write((const uint8_t*)s, strlen(s)) : 0; }
+    size_t write(const char* s, size_t n) { return write((const uint8_t*)s, n); }
+
+    size_t print(const char* s)                { return write(s); }
+    size_t print(const __FlashStringHelper* s) { return write((const char*)s); }
+    size_t print(const String& s)              { return write(s.c_str(), s.length()); }
+    size_t print(char c)                       { return write((uint8_t)c); }
+    size_t print(int v)                        { return _num("%d", v); }
+    size_t print(unsigned int v)               { return _num("%u", v); }
+    size_t print(long v)                       { return _num("%ld", v); }
+    size_t print(unsigned long v)              { return _num("%lu", v); }
+
+    size_t println()                           { return write('\n'); }
+    template <typename T> size_t println(const T& v) { return print(v) + println(); }
+
+    size_t printf(const char* fmt, ...) __attribute__((format(printf, 2, 3))) {
+        char b[256];
+        va_list a;
+        va_start(a, fmt);
+        int n = vsnprintf(b, sizeof(b), fmt, a);
+        va_end(a);
+        if (n < 0) return 0;
+        return write(b, (size_t)n < sizeof(b) ? (size_t)n : sizeof(b) - 1);
+    }
+
+private:
+    template <typename T> size_t _num(const char* fmt, T v) {
+        char b[24];
+        int n = snprintf(b, sizeof(b), fmt, v);
+        return write(b, (size_t)n);
+    }
+};
+
+class Stream : public Print {
+public:
+    virtual int available() { return 0; }
+    virtual int read()      { return -1; }
+    virtual int peek()      { return -1; }
+};
+
+// stdout
+class HostSerial : public Stream {
+public:
+    void begin(unsigned long) {}
+    size_t write(uint8_t c) override { return putchar(c) == EOF ? 0 : 1; }
+    size_t write(const uint8_t* b, size_t n) override { return fwrite(b, 1, n, stdout); }
+    using Print::write;
+    explicit operator bool() const { return true; }
+};
+extern HostSerial Serial;
+
+// ── Time ──────────────────────────────────────────────────────────────────────
+
+unsigned long micros();
+unsigned long millis();
+void delay(unsigned long ms);               // advance simulated time, see host.cpp
+void delayMicroseconds(unsigned int us);
+inline void yield() {}
+
+// ── ESP32 ─────────────────────────────────────────────────────────────────────
+
+#ifdef ESP32
+#define ESP_ARDUINO_VERSION_MAJOR 2
+#define ESP_ARDUINO_VERSION_MINOR 0
+#define ESP_ARDUINO_VERSION_PATCH 0
+
+#define ESP_MAC_WIFI_STA 0
+inline int esp_read_mac(uint8_t* mac, int) {
+    static const uint8_t m[6] = { 0x24, 0x0a, 0xc4, 0x00, 0x00, 0x01 };
+    memcpy(mac, m, 6);
+    return 0;
+}
+
+// Heap accounting over operator new/delete. The host allocator does not
+// fragment like the device's, so getMaxAllocHeap() is simply the free heap.
+class EspClass {
+public:
+    static const uint32_t HEAP_SIZE = 320 * 1024;
+
+    uint64_t getEfuseMac()       { return 0x010000c40a24ULL; }
+    uint32_t getCpuFreqMHz()     { return 240; }
+    uint32_t getHeapSize()       { return HEAP_SIZE; }
+    uint32_t getFlashChipSize()  { return 4 * 1024 * 1024; }
+    uint32_t getFreeHeap();
+    uint32_t getMinFreeHeap();
+    uint32_t getMaxAllocHeap()   { return getFreeHeap(); }
+};
+extern EspClass ESP;
+#endif
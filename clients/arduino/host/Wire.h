@@ -0,0 +1,245 @@
+/*
+ * host/Wire.h  —  Simulated I2C bus for host builds
+ *
+ * A TwoWire that models any number of devices, TCA9548A mux trees, slow
+ * (clock-stretching) and NACKing peripherals, so cep.h can enumerate and
+ * serialise topologies no bench setup has: hundreds of sensors across
+ * cascaded muxes, flaky parts, colliding addresses.
+ *
+ *   int bme = Wire.attach(0x76);              // on the root bus
+ *   Wire.poke(bme, 0xD0, 0x60);               // chip id register
+ *   int mux = Wire.attachMux(0x70);           // TCA9548A on the root bus
+ *   int imu = Wire.attach(0x68, mux, 3);      // behind channel 3
+ *   Wire.setNack(imu, 20);                    // 20 % of address phases NACK
+ *   Wire.setStretch(imu, 150);                // +150 us per transfer
+ *
+ * Each device is a 256-byte register file with an auto-incrementing pointer
+ * (write the register number, then read or write a burst). A mux takes one
+ * byte, its channel mask; a device is reachable when every mux above it has
+ * its channel enabled. Several reachable devices on one address all ACK,
+ * all take writes, and reads see the wired-AND of their bytes, as on a real
+ * bus.
+ *
+ * Transfers advance simulated time at the configured clock (9 bit times per
+ * byte, plus start / stop and any stretch), which host micros() includes, so
+ * scan timings reflect bus cost and not just CPU. NACKs are drawn from a
+ * seeded generator (setSeed), so a failing fuzz run can be replayed.
+ */
+
+#pragma once
+
+#include "Arduino.h"
+
+#include <vector>
+
+#ifndef I2C_BUFFER_LENGTH
+#define I2C_BUFFER_LENGTH 128
+#endif
+
+// Simulated time in microseconds, advanced by buses and delay() (host.cpp)
+extern uint64_t hostSimUs;
+
+struct HostI2CDevice {
+    uint8_t  address;
+    int      mux;            // parent mux handle, -1 = root bus
+    uint8_t  channel;        // parent mux channel
+    bool     isMux;
+    bool     attached;
+    uint8_t  nackPercent;    // chance an address phase is not acknowledged
+    bool     nackData;       // ACK the address, NACK every data byte written
+    uint16_t stretchUs;      // extra time per transfer
+    uint8_t  muxMask;        // isMux: enabled channels
+    uint8_t  ptr;            // register pointer
+    uint8_t  regs[256];
+};
+
+class TwoWire : public Stream {
+public:
+    TwoWire()
+        : _clockHz(100000), _seed(1), _addr(0), _txLen(0), _rxLen(0), _rxPos(0),
+          _transfers(0), _nacks(0) {}
+
+    // ── Simulation ───────────────────────────────────────────────────────────
+
+    // A register-file device, on the root bus or behind channel of mux.
+    // Returns its handle.
+    int attach(uint8_t address, int mux = -1, uint8_t channel = 0) {
+        HostI2CDevice d;
+        memset(&d, 0, sizeof(d));
+        d.address  = address & 0x7f;
+        d.mux      = mux;
+        d.channel  = channel & 7;
+        d.attached = true;
+        _devices.push_back(d);
+        int h = (int)_devices.size() - 1;
+        _byAddress[d.address].push_back(h);
+        return h;
+    }
+
+    // A TCA9548A (all channels off at power-up)
+    int attachMux(uint8_t address, int mux = -1, uint8_t channel = 0) {
+        int h = attach(address, mux, channel);
+        _devices[h].isMux = true;
+        return h;
+    }
+
+    // Unplug (handles stay valid; re-attach with plug())
+    void detach(int h) { _devices[h].attached = false; }
+    void plug(int h)   { _devices[h].attached = true; }
+
+    void setNack(int h, uint8_t percent) { _devices[h].nackPercent = percent > 100 ? 100 : percent; }
+    void setNackData(int h, bool on)     { _devices[h].nackData = on; }
+    void setStretch(int h, uint16_t us)  { _devices[h].stretchUs = us; }
+
+    void    poke(int h, uint8_t reg, uint8_t v) { _devices[h].regs[reg] = v; }
+    uint8_t peek(int h, uint8_t reg) const      { return _devices[h].regs[reg]; }
+
+    HostI2CDevice&       device(int h)       { return _devices[h]; }
+    const HostI2CDevice& device(int h) const { return _devices[h]; }
+    int devices() const { return (int)_devices.size(); }
+
+    // True if h would ACK its address right now (plugged in, every mux above
+    // it routed). Ignores setNack().
+    bool reachable(int h) const {
+        const HostI2CDevice& d = _devices[h];
+        if (!d.attached) return false;
+        if (d.mux < 0) return true;
+        return (_devices[d.mux].muxMask & (1 << d.channel)) && reachable(d.mux);
+    }
+
+    void setSeed(uint32_t seed) { _seed = seed ? seed : 1; }
+
+    // Address phases so far (probes, writes and reads) and how many NACKed
+    uint32_t transfers() const { return _transfers; }
+    uint32_t nacks() const     { return _nacks; }
+    uint32_t clockHz() const   { return _clockHz; }
+
+    // ── TwoWire ──────────────────────────────────────────────────────────────
+
+    bool begin() { return true; }
+    bool begin(int, int, uint32_t hz = 0) {
+        if (hz) _clockHz = hz;
+        return true;
+    }
+    void setClock(uint32_t hz) { if (hz) _clockHz = hz; }
+
+    void beginTransmission(uint8_t address) {
+        _addr  = address & 0x7f;
+        _txLen = 0;
+    }
+
+    uint8_t endTransmission(bool = true) {
+        _transfers++;
+        uint16_t stretch = 0;
+        int acks = _ack(_addr, stretch);
+        _busTime(1 + (acks ? _txLen : 0), stretch);
+        if (!acks) {
+            _nacks++;
+            return 2;
+        }
+        bool dataNack = false;
+        for (int h : _byAddress[_addr]) {
+            HostI2CDevice& d = _devices[h];
+            if (!_selected(h)) continue;
+            if (d.nackData && _txLen > 0) {
+                dataNack = true;
+                continue;
+            }
+            if (d.isMux) {
+                if (_txLen > 0) d.muxMask = _tx[_txLen - 1];
+                continue;
+            }
+            if (_txLen > 0) {
+                d.ptr = _tx[0];
+                for (uint8_t i = 1; i < _txLen; i++) d.regs[d.ptr++] = _tx[i];
+            }
+        }
+        return dataNack ? 3 : 0;
+    }
+
+    size_t write(uint8_t c) override {
+        if (_txLen >= I2C_BUFFER_LENGTH) return 0;
+        _tx[_txLen++] = c;
+        return 1;
+    }
+    using Print::write;
+
+    uint8_t requestFrom(uint8_t address, uint8_t n, bool = true) {
+        _transfers++;
+        address &= 0x7f;
+        _rxLen = _rxPos = 0;
+        if (n > I2C_BUFFER_LENGTH) n = I2C_BUFFER_LENGTH;
+        uint16_t stretch = 0;
+        int acks = _ack(address, stretch);
+        _busTime(1 + (acks ? n : 0), stretch);
+        if (!acks) {
+            _nacks++;
+            return 0;
+        }
+        memset(_rx, 0xff, n);   // open drain: idle high, any device pulls low
+        for (int h : _byAddress[address]) {
+            HostI2CDevice& d = _devices[h];
+            if (!_selected(h)) continue;
+            for (uint8_t i = 0; i < n; i++) {
+                _rx[i] &= d.isMux ? d.muxMask : d.regs[(uint8_t)(d.ptr + i)];
+            }
+            if (!d.isMux) d.ptr = (uint8_t)(d.ptr + n);
+        }
+        _rxLen = n;
+        return n;
+    }
+
+    int available() override { return _rxLen - _rxPos; }
+    int read() override      { return _rxPos < _rxLen ? _rx[_rxPos++] : -1; }
+    int peek() override      { return _rxPos < _rxLen ? _rx[_rxPos] : -1; }
+
+private:
+    std::vector<HostI2CDevice> _devices;
+    std::vector<int>           _byAddress[128];
+    std::vector<int>           _acked;     // devices that ACKed the current address phase
+    uint32_t _clockHz;
+    uint32_t _seed;
+    uint8_t  _addr;
+    uint8_t  _tx[I2C_BUFFER_LENGTH];
+    uint8_t  _txLen;
+    uint8_t  _rx[I2C_BUFFER_LENGTH];
+    uint8_t  _rxLen;
+    uint8_t  _rxPos;
+    uint32_t _transfers;
+    uint32_t _nacks;
+
+    uint32_t _random() {   // xorshift32
+        _seed ^= _seed << 13;
+        _seed ^= _seed >> 17;
+        _seed ^= _seed << 5;
+        return _seed;
+    }
+
+    // Address phase: remember which reachable devices ACK, return how many
+    int _ack(uint8_t address, uint16_t& stretch) {
+        _acked.clear();
+        for (int h : _byAddress[address]) {
+            const HostI2CDevice& d = _devices[h];
+            if (!reachable(h)) continue;
+            if (d.nackPercent && _random() % 100 < d.nackPercent) continue;
+            if (d.stretchUs > stretch) stretch = d.stretchUs;
+            _acked.push_back(h);
+        }
+        return (int)_acked.size();
+    }
+
+    bool _selected(int h) const {
+        for (int a : _acked) {
+            if (a == h) return true;
+        }
+        return false;
+    }
+
+    // Start + address byte, n more bytes, stop; 9 bit times per byte
+    void _busTime(uint32_t bytes, uint16_t stretch) {
+        hostSimUs += ((uint64_t)bytes * 9 + 2) * 1000000ULL / _clockHz + stretch;
+    }
+};
+
+extern TwoWire Wire;
+extern TwoWire Wire1;
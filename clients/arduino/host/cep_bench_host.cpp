@@ -0,0 +1,50 @@
+/*
+ * host/cep_bench_host.cpp  —  cep_bench on x86 against the simulated bus
+ *
+ * Builds cep.h, the chipset plugins and cep_benchmark/cep_bench.h with the
+ * host Arduino core in this directory and prints the same CSV report as the
+ * sketch. Scan numbers include simulated bus time at the scan clock (see
+ * Wire.h); serializer numbers are CPU only and directly comparable between
+ * builds.
+ *
+ * Build and run from clients/arduino:
+ *   g++ -std=c++17 -O2 -Wall -Wextra -DESP32 -I host \
+ *       host/cep_bench_host.cpp host/host.cpp -o cep_bench
+ *   ./cep_bench [iterations] [known]
+ *
+ * "known" sets CepScanConfig::knownOnly (probe only plugin addresses).
+ * Drop -DESP32 for the plain Arduino document (no heap figures).
+ */
+
+#include <Arduino.h>
+#include <Wire.h>
+
+#include "../cep.h"
+#include "../chipsets/bme280_chip.h"
+#include "../chipsets/ssd1306_chip.h"
+#include "../chipsets/mpu6050_chip.h"
+#include "../cep_benchmark/cep_bench.h"
+
+static CEP      cep;
+static CepBench bench(cep);
+
+int main(int argc, char** argv) {
+    long iterations = argc > 1 ? atol(argv[1]) : 100;
+    if (iterations < 1 || iterations > 65535) iterations = 100;
+
+    // The same three devices the example sketch expects
+    int bme = Wire.attach(0x76);
+    Wire.poke(bme, 0xD0, 0x60);    // BME280 chip id
+    Wire.attach(0x3C);
+    int imu = Wire.attach(0x68);
+    Wire.poke(imu, 0x75, 0x68);    // MPU-6050 WHO_AM_I
+
+    cep.useChipsets<&BME280_Chip, &SSD1306_Chip, &MPU6050_Chip>();
+    CepScanConfig scan;
+    scan.knownOnly = argc > 2 && strcmp(argv[2], "known") == 0;
+    cep.setScanConfig(scan);
+
+    bench.run((uint16_t)iterations);
+    bench.report(Serial);
+    return 0;
+}
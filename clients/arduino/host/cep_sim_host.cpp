@@ -0,0 +1,395 @@
+/*
+ * host/cep_sim_host.cpp  —  Scaling sweeps and fuzzing of cep.h on the
+ *                           simulated bus (Wire.h)
+ *
+ *   ./cep_sim scale [max_devices]
+ *       Spreads 0 .. max_devices (default 512) sensors over six TCA9548A
+ *       muxes and prints one CSV row per size: buses, devices found,
+ *       JSON / CBOR size, scan time (simulated bus time at 100 kHz),
+ *       serialize time and bus transfers.
+ *
+ *   ./cep_sim fuzz [seed] [rounds]
+ *       Random topologies (nested muxes, colliding addresses, NACKing and
+ *       stretching parts, hot-plug between builds) under random scan
+ *       configurations. Each round checks that the JSON and CBOR documents
+ *       and any delta are well formed, that every build path agrees on the
+ *       size, and, on topologies without NACKs, that the scan found exactly
+ *       the reachable devices. Prints the failing seed and exits 1 on the
+ *       first mismatch.
+ *
+ * Build from clients/arduino (49 buses = the root bus + 6 muxes x 8 channels):
+ *   g++ -std=c++17 -O2 -Wall -Wextra -DESP32 -DCEP_MAX_I2C_BUSES=49 -I host \
+ *       host/cep_sim_host.cpp host/host.cpp -o cep_sim
+ *
+ * The same objects can be linked into a gateway that enumerates an attached
+ * board on its behalf; build with -DCEP_TRANSPORT='"usb"' so the document
+ * says how the board is reached.
+ */
+
+#include <Arduino.h>
+#include <Wire.h>
+
+#include "../cep.h"
+#include "../chipsets/bme280_chip.h"
+#include "../chipsets/ssd1306_chip.h"
+#include "../chipsets/mpu6050_chip.h"
+
+#include <string>
+
+// TCA9548As at 0x70-0x75: 0x76 / 0x77 are BME280 addresses, and a mux there
+// would answer for them on every channel
+static const uint8_t MUX_BASE = 0x70;
+static const uint8_t MUXES    = 6;
+
+// Addresses the plugins claim (with the ids their begin() checks), then the rest
+static const uint8_t PLUGIN_ADDRS[] = { 0x76, 0x77, 0x3C, 0x3D, 0x68, 0x69 };
+
+static uint32_t _seed = 1;
+
+static uint32_t rnd(uint32_t n) {   // xorshift32, [0, n)
+    _seed ^= _seed << 13;
+    _seed ^= _seed >> 17;
+    _seed ^= _seed << 5;
+    return n ? _seed % n : 0;
+}
+
+static uint8_t nthAddress(uint16_t k) {
+    if (k < sizeof(PLUGIN_ADDRS)) return PLUGIN_ADDRS[k];
+    uint8_t a = 0x08;
+    for (k -= sizeof(PLUGIN_ADDRS);; a++) {
+        bool skip = (a >= MUX_BASE && a < MUX_BASE + MUXES);
+        for (uint8_t p : PLUGIN_ADDRS) skip |= (a == p);
+        if (!skip && k-- == 0) return a;
+    }
+}
+
+static int attachDevice(TwoWire& wire, uint8_t addr, int mux, uint8_t channel) {
+    int h = wire.attach(addr, mux, channel);
+    if (addr == 0x76 || addr == 0x77) wire.poke(h, 0xD0, 0x60);   // BME280 chip id
+    if (addr == 0x68 || addr == 0x69) wire.poke(h, 0x75, 0x68);   // MPU-6050 WHO_AM_I
+    return h;
+}
+
+// ── Document checks ───────────────────────────────────────────────────────────
+
+class StringSink : public Print {
+public:
+    std::string s;
+    size_t write(uint8_t c) override { s += (char)c; return 1; }
+    using Print::write;
+};
+
+// Strict enough for what CepJsonWriter emits: objects, arrays, strings with
+// escapes, integers and literals; no trailing garbage
+class JsonCheck {
+public:
+    explicit JsonCheck(const std::string& s) : _s(s), _i(0) {}
+    bool ok() {
+        if (!_value(0)) return false;
+        _ws();
+        return _i == _s.size();
+    }
+
+private:
+    const std::string& _s;
+    size_t _i;
+
+    void _ws() { while (_i < _s.size() && strchr(" \t\r\n", _s[_i])) _i++; }
+    bool _eat(char c) {
+        _ws();
+        if (_i < _s.size() && _s[_i] == c) { _i++; return true; }
+        return false;
+    }
+    bool _string() {
+        if (!_eat('"')) return false;
+        while (_i < _s.size() && _s[_i] != '"') {
+            if ((uint8_t)_s[_i] < 0x20) return false;
+            if (_s[_i] == '\\' && ++_i >= _s.size()) return false;
+            _i++;
+        }
+        return _i++ < _s.size();
+    }
+    bool _number() {
+        size_t start = _i;
+        if (_i < _s.size() && _s[_i] == '-') _i++;
+        while (_i < _s.size() && (isdigit((uint8_t)_s[_i]) || _s[_i] == '.')) _i++;
+        return _i > start;
+    }
+    bool _value(int depth) {
+        if (depth > 32) return false;
+        _ws();
+        if (_i >= _s.size()) return false;
+        char c = _s[_i];
+        if (c == '{' || c == '[') {
+            char close = c == '{' ? '}' : ']';
+            _i++;
+            if (_eat(close)) return true;
+            do {
+                if (c == '{' && !(_string() && _eat(':'))) return false;
+                if (!_value(depth + 1)) return false;
+            } while (_eat(','));
+            return _eat(close);
+        }
+        if (c == '"') return _string();
+        for (const char* lit : { "true", "false", "null" }) {
+            if (_s.compare(_i, strlen(lit), lit) == 0) { _i += strlen(lit); return true; }
+        }
+        return _number();
+    }
+};
+
+// Walks what CepJsonWriter emits as CBOR: indefinite maps / arrays, definite
+// strings, integers, simple values
+class CborCheck {
+public:
+    explicit CborCheck(const std::string& s) : _s(s), _i(0) {}
+    bool ok() { return _item(0, false) == 1 && _i == _s.size(); }
+
+private:
+    const std::string& _s;
+    size_t _i;
+
+    bool _arg(uint8_t info, uint64_t& v) {
+        if (info < 24) { v = info; return true; }
+        int n = info == 24 ? 1 : info == 25 ? 2 : info == 26 ? 4 : info == 27 ? 8 : 0;
+        if (!n || _i + n > _s.size()) return false;
+        v = 0;
+        while (n--) v = (v << 8) | (uint8_t)_s[_i++];
+        return true;
+    }
+    // 1 = item, 2 = break (allowed only inside indefinite containers), 0 = error
+    int _item(int depth, bool inIndefinite) {
+        if (depth > 32 || _i >= _s.size()) return 0;
+        uint8_t ib = (uint8_t)_s[_i++], major = ib >> 5, info = ib & 31;
+        if (ib == 0xff) return inIndefinite ? 2 : 0;
+        uint64_t v;
+        if (info == 31 && (major == 4 || major == 5)) {
+            for (;;) {
+                int r = _item(depth + 1, true);
+                if (r == 2) return 1;
+                if (!r || (major == 5 && _item(depth + 1, false) != 1)) return 0;
+            }
+        }
+        if (!_arg(info, v)) return 0;
+        switch (major) {
+        case 0: case 1: case 7: return 1;
+        case 2: case 3:
+            if (_i + v > _s.size()) return 0;
+            _i += v;
+            return 1;
+        case 4: case 5:
+            for (uint64_t k = 0; k < v * (major == 5 ? 2 : 1); k++) {
+                if (_item(depth + 1, false) != 1) return 0;
+            }
+            return 1;
+        default:
+            return 0;
+        }
+    }
+};
+
+static bool fail(uint32_t seed, int round, const char* what, const std::string& doc = "") {
+    printf("FAIL seed=%lu round=%d: %s\n", (unsigned long)seed, round, what);
+    if (!doc.empty()) printf("%s\n", doc.c_str());
+    return false;
+}
+
+// ── scale ─────────────────────────────────────────────────────────────────────
+
+static void scale(long maxDevices) {
+    printf("devices,buses,found,json_bytes,cbor_bytes,scan_us,serialize_us,transfers\n");
+    for (long n = 0; n <= maxDevices; n = n ? n * 2 : 8) {
+        TwoWire wire;
+        CepScanConfig scan;
+        scan.clearBuses();
+        scan.addBus(wire, SDA, SCL);
+        int mux[MUXES];
+        for (uint8_t m = 0; m < MUXES; m++) {
+            mux[m] = wire.attachMux((uint8_t)(MUX_BASE + m));
+            scan.addMux(wire, SDA, SCL, (uint8_t)(MUX_BASE + m));
+        }
+        for (long i = 0; i < n; i++) {
+            uint8_t channel = (uint8_t)(i % (MUXES * 8));
+            attachDevice(wire, nthAddress((uint16_t)(i / (MUXES * 8))), mux[channel / 8], channel % 8);
+        }
+
+        CEP* cep = new CEP;
+        cep->useChipsets<&BME280_Chip, &SSD1306_Chip, &MPU6050_Chip>();
+        cep->setScanConfig(scan);
+
+        uint32_t xfers = wire.transfers();
+        unsigned long t = micros();
+        cep->rescan();
+        unsigned long scanUs = micros() - t;
+        xfers = wire.transfers() - xfers;
+
+        uint32_t found = 0;
+        for (uint8_t b = 0; b < scan.numBuses; b++) {
+            for (uint8_t a = 1; a < 128; a++) found += cep->found(b, a);
+        }
+
+        CepHashPrint json, cbor;
+        t = micros();
+        cep->writeCapabilities(json);
+        unsigned long serUs = micros() - t;
+        cep->writeCapabilities(cbor, CEP_FORMAT_CBOR);
+
+        printf("%ld,%u,%lu,%lu,%lu,%lu,%lu,%lu\n", n, (unsigned)scan.numBuses,
+               (unsigned long)found, (unsigned long)json.total(), (unsigned long)cbor.total(),
+               scanUs, serUs, (unsigned long)xfers);
+        delete cep;
+    }
+}
+
+// ── fuzz ──────────────────────────────────────────────────────────────────────
+
+static bool fuzzRound(uint32_t seed, int round) {
+    _seed = seed * 2654435761u + (uint32_t)round + 1;
+    TwoWire wire;
+    wire.setSeed(rnd(0xffffffff) + 1);
+
+    CepScanConfig scan;
+    scan.clearBuses();
+    scan.addBus(wire, SDA, SCL);
+    scan.clockHz   = rnd(2) ? 400000 : 100000;
+    scan.knownOnly = rnd(4) == 0;
+    if (rnd(4) == 0) {
+        scan.firstAddress = (uint8_t)(1 + rnd(0x40));
+        scan.lastAddress  = (uint8_t)(scan.firstAddress + rnd((uint32_t)(0x7e - scan.firstAddress)));
+    } else if (rnd(8) == 0) {
+        scan.firstAddress = 0x00;   // out of range: CEP clamps to 0x01-0x7F
+        scan.lastAddress  = 0xFF;
+    }
+    static const uint8_t skip[] = { 0x3D, 0x50, 0 };
+    if (rnd(4) == 0) scan.skip = skip;
+
+    // Up to three muxes on the root bus (scanned), and maybe one nested
+    // behind another (invisible to CEP, must not confuse it)
+    std::vector<int> muxes;
+    uint8_t numMux = (uint8_t)rnd(4);
+    for (uint8_t m = 0; m < numMux; m++) {
+        muxes.push_back(wire.attachMux((uint8_t)(MUX_BASE + m)));
+        scan.addMux(wire, SDA, SCL, (uint8_t)(MUX_BASE + m));
+    }
+    if (numMux && rnd(2)) {
+        muxes.push_back(wire.attachMux((uint8_t)(MUX_BASE + 7), muxes[rnd(numMux)], (uint8_t)rnd(8)));
+    }
+
+    bool flaky = rnd(3) == 0;
+    std::vector<int> devs;
+    uint32_t numDev = rnd(40);
+    for (uint32_t i = 0; i < numDev; i++) {
+        int parent = muxes.empty() || rnd(3) == 0 ? -1 : muxes[rnd((uint32_t)muxes.size())];
+        uint8_t addr = rnd(2) ? nthAddress((uint16_t)rnd(sizeof(PLUGIN_ADDRS)))
+                              : (uint8_t)(0x08 + rnd(0x68));   // may collide with a mux
+        int h = attachDevice(wire, addr, parent, (uint8_t)rnd(8));
+        if (flaky && rnd(3) == 0) wire.setNack(h, (uint8_t)(1 + rnd(60)));
+        if (rnd(5) == 0) wire.setStretch(h, (uint16_t)rnd(500));
+        if (rnd(8) == 0) wire.setNackData(h, true);
+        devs.push_back(h);
+    }
+
+    CEP cep;
+    if (rnd(2)) {
+        cep.useChipsets<&BME280_Chip, &SSD1306_Chip, &MPU6050_Chip>();
+    } else {
+        cep.registerChipset(&MPU6050_Chip);
+        cep.registerChipset(&BME280_Chip);
+    }
+    cep.setScanConfig(scan);
+
+    for (int build = 0; build < 3; build++) {
+        CepFormat fmt = rnd(3) == 0 ? CEP_FORMAT_CBOR : CEP_FORMAT_JSON;
+        StringSink doc;
+        size_t n = cep.writeCapabilities(doc, fmt);
+        if (n != doc.s.size()) return fail(seed, round, "byte count != bytes written", doc.s);
+        if (fmt == CEP_FORMAT_JSON ? !JsonCheck(doc.s).ok() : !CborCheck(doc.s).ok()) {
+            return fail(seed, round, fmt == CEP_FORMAT_JSON ? "bad JSON" : "bad CBOR",
+                        fmt == CEP_FORMAT_JSON ? doc.s : "");
+        }
+        if (cep.isDirty() || cep.contentHash() != cep.lastHash()) {
+            return fail(seed, round, "dirty right after a build");
+        }
+
+        std::vector<char> buf(n + 1 + rnd(2) * 64);
+        size_t len = cep.serializeTo(buf.data(), buf.size(), fmt);
+        if (len != n || memcmp(buf.data(), doc.s.data(), n) != 0) {
+            return fail(seed, round, "serializeTo differs from writeCapabilities");
+        }
+
+        // Scan found exactly the reachable devices (exact only without NACKs);
+        // on a mux channel, not the ones that also answer with the mux off
+        if (!flaky && build == 0) {
+            for (uint8_t b = 0; b < scan.numBuses; b++) {
+                const CepI2CBus& bus = scan.buses[b];
+                for (int m : muxes) wire.device(m).muxMask = 0;
+                std::vector<bool> upstream(128, false);
+                if (bus.muxAddress) {
+                    for (int h = 0; h < wire.devices(); h++) {
+                        if (wire.reachable(h)) upstream[wire.device(h).address & 0x7f] = true;
+                    }
+                    wire.device(muxes[bus.muxAddress - MUX_BASE]).muxMask = (uint8_t)(1 << bus.muxChannel);
+                }
+                for (uint16_t a = 1; a < 128; a++) {
+                    bool expect = false;
+                    if (a >= scan.firstAddress && a <= scan.lastAddress && a != bus.muxAddress &&
+                        !upstream[a] && (!scan.skip || (a != 0x3D && a != 0x50)) &&
+                        (!scan.knownOnly || cep.chipsetAt((uint8_t)a))) {
+                        for (int h = 0; h < wire.devices(); h++) {
+                            expect |= wire.device(h).address == a && wire.reachable(h);
+                        }
+                    }
+                    if (cep.found(b, (uint8_t)a) != expect) {
+                        char what[64];
+                        snprintf(what, sizeof(what), "bus %u address 0x%02x: found=%d expected=%d",
+                                 b, a, cep.found(b, (uint8_t)a), expect);
+                        return fail(seed, round, what, doc.s);
+                    }
+                }
+            }
+            for (int m : muxes) wire.device(m).muxMask = 0;
+        }
+
+        // Hot-plug a few devices, then try a delta against the last build
+        for (uint32_t k = rnd(3); k > 0 && !devs.empty(); k--) {
+            int h = devs[rnd((uint32_t)devs.size())];
+            if (wire.device(h).attached) wire.detach(h);
+            else                         wire.plug(h);
+        }
+        cep.invalidate();
+        if (rnd(2)) {
+            StringSink delta;
+            uint32_t base = cep.lastHash();
+            size_t d = cep.writeDelta(delta);
+            if (d != delta.s.size()) return fail(seed, round, "delta byte count", delta.s);
+            if (d && (fmt == CEP_FORMAT_JSON ? !JsonCheck(delta.s).ok() : !CborCheck(delta.s).ok())) {
+                return fail(seed, round, "bad delta", fmt == CEP_FORMAT_JSON ? delta.s : "");
+            }
+            // The baseline moves only when the patch is committed
+            if (cep.lastHash() != base) return fail(seed, round, "uncommitted delta moved the baseline");
+            if (d && rnd(2) && (!cep.commitDelta() || cep.isDirty())) {
+                return fail(seed, round, "dirty after a committed delta");
+            }
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    const char* mode = argc > 1 ? argv[1] : "scale";
+    if (strcmp(mode, "scale") == 0) {
+        scale(argc > 2 ? atol(argv[2]) : 512);
+        return 0;
+    }
+    if (strcmp(mode, "fuzz") == 0) {
+        uint32_t seed = argc > 2 ? (uint32_t)strtoul(argv[2], nullptr, 0) : 1;
+        int rounds    = argc > 3 ? atoi(argv[3]) : 1000;
+        for (int r = 0; r < rounds; r++) {
+            if (!fuzzRound(seed, r)) return 1;
+        }
+        printf("fuzz seed=%lu rounds=%d ok\n", (unsigned long)seed, rounds);
+        return 0;
+    }
+    fprintf(stderr, "usage: %s scale [max_devices] | fuzz [seed] [rounds]\n", argv[0]);
+    return 2;
+}
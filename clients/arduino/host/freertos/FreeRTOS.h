@@ -0,0 +1,24 @@
+/*
+ * host/freertos/FreeRTOS.h  —  FreeRTOS types for host builds
+ *
+ * The host core has no scheduler: task creation fails (pdFAIL), so code
+ * that can run either from a task or from loop() takes the loop() path.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+typedef void*    TaskHandle_t;
+typedef int      BaseType_t;
+typedef unsigned UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdPASS  1
+#define pdFAIL  0
+#define pdTRUE  1
+#define pdFALSE 0
+
+#define portMAX_DELAY      0xffffffffu
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms)  ((TickType_t)(ms))
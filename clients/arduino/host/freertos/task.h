@@ -0,0 +1,28 @@
+/*
+ * host/freertos/task.h  —  Task API stubs for host builds (see FreeRTOS.h)
+ */
+
+#pragma once
+
+#include "FreeRTOS.h"
+
+unsigned long millis();
+
+typedef void (*TaskFunction_t)(void*);
+
+inline BaseType_t xTaskCreatePinnedToCore(TaskFunction_t, const char*, uint32_t, void*,
+                                          UBaseType_t, TaskHandle_t* handle, BaseType_t) {
+    if (handle) *handle = nullptr;
+    return pdFAIL;
+}
+
+#define tskNO_AFFINITY 0x7FFFFFFF
+
+inline void         vTaskDelete(TaskHandle_t) {}
+inline TaskHandle_t xTaskGetCurrentTaskHandle() { return nullptr; }
+inline UBaseType_t  uxTaskPriorityGet(TaskHandle_t) { return 1; }
+inline BaseType_t   xTaskNotifyGive(TaskHandle_t) { return pdPASS; }
+inline uint32_t     ulTaskNotifyTake(BaseType_t, TickType_t) { return 0; }
+inline TickType_t   xTaskGetTickCount() { return (TickType_t)millis(); }
+inline void         vTaskDelay(TickType_t) {}
+inline void         vTaskDelayUntil(TickType_t* wake, TickType_t inc) { *wake += inc; }
@@ -0,0 +1,73 @@
+/*
+ * host/host.cpp  —  Globals and runtime for the host Arduino core
+ *
+ * Link this with any host build of the CEP headers. micros() is a monotonic
+ * clock from program start plus simulated time (bus transfers, delay()); with
+ * -DESP32, operator new/delete are counted so ESP.getFreeHeap() /
+ * getMinFreeHeap() track what the code allocates.
+ */
+
+#include "Arduino.h"
+#include "Wire.h"
+
+#include <chrono>
+#include <cstddef>
+#include <new>
+
+HostSerial Serial;
+TwoWire    Wire;
+TwoWire    Wire1;
+
+static const std::chrono::steady_clock::time_point _hostStart = std::chrono::steady_clock::now();
+
+uint64_t hostSimUs = 0;
+
+unsigned long micros() {
+    return (unsigned long)(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - _hostStart).count() + hostSimUs);
+}
+
+unsigned long millis() { return micros() / 1000; }
+
+// Waits return at once and move the clock instead
+void delay(unsigned long ms)            { hostSimUs += (uint64_t)ms * 1000; }
+void delayMicroseconds(unsigned int us) { hostSimUs += us; }
+
+#ifdef ESP32
+EspClass ESP;
+
+// Live bytes and high-water mark. Each block carries its size in a header
+// aligned like malloc's own result.
+static size_t _hostLive = 0;
+static size_t _hostPeak = 0;
+static const size_t _HOST_HDR = alignof(max_align_t);
+
+uint32_t EspClass::getFreeHeap() {
+    return _hostLive >= HEAP_SIZE ? 0 : (uint32_t)(HEAP_SIZE - _hostLive);
+}
+
+uint32_t EspClass::getMinFreeHeap() {
+    return _hostPeak >= HEAP_SIZE ? 0 : (uint32_t)(HEAP_SIZE - _hostPeak);
+}
+
+void* operator new(size_t n) {
+    uint8_t* p = (uint8_t*)malloc(n + _HOST_HDR);
+    if (!p) throw std::bad_alloc();
+    *(size_t*)p = n;
+    _hostLive += n;
+    if (_hostLive > _hostPeak) _hostPeak = _hostLive;
+    return p + _HOST_HDR;
+}
+
+void operator delete(void* p) noexcept {
+    if (!p) return;
+    uint8_t* b = (uint8_t*)p - _HOST_HDR;
+    _hostLive -= *(size_t*)b;
+    free(b);
+}
+
+void* operator new[](size_t n)              { return operator new(n); }
+void  operator delete[](void* p) noexcept   { operator delete(p); }
+void  operator delete(void* p, size_t) noexcept   { operator delete(p); }
+void  operator delete[](void* p, size_t) noexcept { operator delete(p); }
+#endif
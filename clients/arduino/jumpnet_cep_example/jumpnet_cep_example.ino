@@ -6,81 +6,92 @@
  * This sketch:
  *  1. Scans I2C, detects known chipsets
  *  2. Prints the CEP JSON to Serial
- *  3. (If WiFi creds are set) registers with a JumpNet node
+ *  3. (If WiFi creds are set) registers with a JumpNet node in the background
+ *     (cep_registrar.h), then keeps the registration alive with hash
+ *     heartbeats and small deltas
+ *  4. Samples a BME280 once a second, if one was found, and uploads the
+ *     readings together with the heartbeats; in between the board sleeps
+ *     (cep_scheduler.h)
  *
  * Board: ESP32 (any variant)
  * Required: no external libraries — cep.h is self-contained.
  */
 
 #include <WiFi.h>
-#include <HTTPClient.h>
 #include "../cep.h"
+#include "../cep_registrar.h"
+#include "../cep_scheduler.h"
 #include "../chipsets/bme280_chip.h"
 #include "../chipsets/ssd1306_chip.h"
 #include "../chipsets/mpu6050_chip.h"
 
 // ── Config ────────────────────────────────────────────────────────────────────
-const char* WIFI_SSID     = "";          // Set your SSID
-const char* WIFI_PASSWORD = "";          // Set your password
-const char* JUMPNET_URL   = "http://192.168.1.100:4080";   // Set JumpNet host
+const char* WIFI_SSID     = "";                // Set your SSID
+const char* WIFI_PASSWORD = "";                // Set your password
+const char* JUMPNET_HOST  = "192.168.1.100";   // Set JumpNet host
+const uint16_t JUMPNET_PORT = 4080;
 
 // ── Setup ─────────────────────────────────────────────────────────────────────
 
-CEP cep;
+CEP          cep;
+CepRegistrar registrar(cep, JUMPNET_HOST, JUMPNET_PORT);
+CepScheduler scheduler(cep, registrar);
+CepStaticSampler<64> env;
 
 void setup() {
     Serial.begin(115200);
     delay(500);
     Serial.println("[CEP] Starting...");
 
-    // Register chipset plugins
-    cep.registerChipset(&BME280_Chip);
-    cep.registerChipset(&SSD1306_Chip);
-    cep.registerChipset(&MPU6050_Chip);
+    // Chipset plugins, resolved at compile time (address table lives in flash)
+    cep.useChipsets<&BME280_Chip, &SSD1306_Chip, &MPU6050_Chip>();
 
-    // Build and print capability JSON
-    String json = cep.getCapabilitiesJSON();
+    // All three plugins support 400 kHz; probe only the addresses they declare
+    CepScanConfig scan;
+    scan.clockHz   = 400000;
+    scan.knownOnly = true;
+    cep.setScanConfig(scan);
+
+    // Scan / build / registration counters as a "telemetry" capability,
+    // refreshed every 5 min (GET /status aggregates them across devices)
+    cep.setTelemetry(300000);
+
+    // Print the capability document
     Serial.println("[CEP] Capability document:");
-    Serial.println(json);
+    cep.writeCapabilities(Serial);
+    Serial.println();
+
+    // Environment readings at 1 Hz, polled by the scheduler between sleeps
+    if (env.attach(cep, &BME280_Chip)) {
+        env.setRate(1);
+        if (env.begin()) scheduler.addSampler(env);
+    }
+    scheduler.setFlush(0, 48);                    // with heartbeats, or at 48 queued
+    scheduler.setSleep(CEP_SLEEP_IDLE);           // CEP_SLEEP_LIGHT on battery, without a sampler
 
-    // Optional: register with JumpNet over WiFi
+    // Optional: register with JumpNet over WiFi. WiFi.begin() returns at once;
+    // the registrar starts sending as soon as the link is up.
     if (strlen(WIFI_SSID) > 0) {
-        Serial.print("[WiFi] Connecting...");
         WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
-        int attempts = 0;
-        while (WiFi.status() != WL_CONNECTED && attempts++ < 20) {
-            delay(500);
-            Serial.print(".");
-        }
-        Serial.println();
-
-        if (WiFi.status() == WL_CONNECTED) {
-            Serial.println("[WiFi] Connected: " + WiFi.localIP().toString());
-            registerWithJumpNet(json);
-        } else {
-            Serial.println("[WiFi] Failed to connect.");
-        }
+        registrar.kick();
     }
 }
 
 void loop() {
-    // Re-register every 60s to keep the JumpNet registry fresh
-    static unsigned long lastReg = 0;
-    if (strlen(WIFI_SSID) > 0 && WiFi.status() == WL_CONNECTED &&
-        millis() - lastReg > 60000) {
-        registerWithJumpNet(cep.getCapabilitiesJSON());
-        lastReg = millis();
+    // Registers once online, then every 60 s sends a heartbeat (unchanged),
+    // a delta (small change) or the full document (server asked for it) with
+    // the queued samples right behind it, over one keep-alive connection,
+    // backing off on failures. Between events the CPU idles with the modem
+    // in power save. The I2C scan is cached; call cep.invalidate() and
+    // registrar.kick() after attaching hardware.
+    if (strlen(WIFI_SSID) > 0) {
+        static int lastStatus = 0;
+        scheduler.run();
+        if (!registrar.busy() && registrar.lastStatus() != lastStatus) {
+            lastStatus = registrar.lastStatus();
+            Serial.printf("[CEP] JumpNet → %d\n", lastStatus);
+        }
+    } else {
+        delay(1000);
     }
-    delay(1000);
-}
-
-// ── Helper ───────────────────────────────────────────────────────────────────
-
-void registerWithJumpNet(const String& json) {
-    HTTPClient http;
-    http.begin(String(JUMPNET_URL) + "/devices/register");
-    http.addHeader("Content-Type", "application/json");
-    int code = http.POST(json);
-    Serial.printf("[CEP] POST /devices/register → %d\n", code);
-    http.end();
 }
@@ -6,8 +6,13 @@
  *
  * Usage:
  *   node clients/node/test-cep.js [http://localhost:4080]
+ *
+ * The delegation steps need the server to trust devices on this host:
+ *   TRUSTED_DEVICE_NETS=127.0.0.1 node server.js
  */
 
+import { createServer } from 'node:http';
+
 const BASE = process.argv[2] ?? 'http://localhost:4080';
 
 // ── Synthetic CEP documents ────────────────────────────────────────────────────
@@ -65,14 +70,34 @@ const PICO_DOC = {
 let passed = 0;
 let failed = 0;
 
-async function req(method, path, body = null) {
-  const opts = { method, headers: { 'Content-Type': 'application/json' } };
+async function req(method, path, body = null, headers = {}) {
+  const opts = { method, headers: { 'Content-Type': 'application/json', ...headers } };
   if (body) opts.body = JSON.stringify(body);
   const res  = await fetch(`${BASE}${path}`, opts);
   const json = await res.json().catch(() => null);
   return { status: res.status, body: json };
 }
 
+// Minimal CBOR encoder for the binary registration test: Maps keep integer
+// keys (CEP_CBOR_KEYS indexes), numbers are non-negative integers.
+function cbor(v) {
+  const head = (major, n) => n < 24   ? [major << 5 | n]
+                           : n < 256  ? [major << 5 | 24, n]
+                           :            [major << 5 | 25, n >> 8, n & 0xff];
+  if (typeof v === 'number') return head(0, v);
+  if (typeof v === 'string') { const b = [...Buffer.from(v)]; return [...head(3, b.length), ...b]; }
+  if (Array.isArray(v))      return [0x9f, ...v.flatMap(cbor), 0xff];
+  return [0xbf, ...[...v].flatMap(([k, x]) => [...cbor(k), ...cbor(x)]), 0xff];
+}
+
+async function reqCbor(path, bytes) {
+  const res  = await fetch(`${BASE}${path}`, {
+    method: 'POST', headers: { 'Content-Type': 'application/cbor' }, body: Buffer.from(bytes),
+  });
+  const json = await res.json().catch(() => null);
+  return { status: res.status, body: json };
+}
+
 function assert(label, condition, detail = '') {
   if (condition) {
     console.log(`  ✓ ${label}`);
@@ -83,6 +108,41 @@ function assert(label, condition, detail = '') {
   }
 }
 
+// Server-Sent Events reader: next() resolves with { id, event, data } or
+// null after a 3 s timeout
+async function openEvents(path, headers = {}) {
+  const ctl    = new AbortController();
+  const res    = await fetch(BASE + path, { headers, signal: ctl.signal });
+  const reader = res.body.getReader();
+  const dec    = new TextDecoder();
+  let buf = '';
+  return {
+    async next() {
+      const deadline = Date.now() + 3000;
+      for (;;) {
+        const end = buf.indexOf('\n\n');
+        if (end >= 0) {
+          const block = buf.slice(0, end);
+          buf = buf.slice(end + 2);
+          const ev = {};
+          for (const line of block.split('\n')) {
+            const m = /^(id|event|data): (.*)$/.exec(line);
+            if (m) ev[m[1]] = m[1] === 'data' ? JSON.parse(m[2]) : m[1] === 'id' ? Number(m[2]) : m[2];
+          }
+          if (ev.event) return ev;
+          continue;   // comment / ping
+        }
+        const left = deadline - Date.now();
+        if (left <= 0) return null;
+        const chunk = await Promise.race([reader.read(), new Promise(ok => setTimeout(ok, left, null))]);
+        if (!chunk || chunk.done) return null;
+        buf += dec.decode(chunk.value, { stream: true });
+      }
+    },
+    close() { ctl.abort(); },
+  };
+}
+
 // ── Tests ─────────────────────────────────────────────────────────────────────
 
 async function run() {
@@ -161,6 +221,290 @@ async function run() {
   r = await req('POST', '/devices/register', { capabilities: [] });
   assert('status 400',           r.status === 400);
 
+  // 12. Binary registration (CEP_FORMAT_CBOR)
+  console.log('\n12. POST /devices/register (application/cbor)');
+  const CBOR_DOC = new Map([
+    [0, new Map([[2, 'cb:or:00:00:00:01'], [3, 9], [4, 10], [5, 'Nano']])],
+    [1, [new Map([[7, 4], [16, 'bme280'], [17, 1], [18, 0], [19, 0x77], [20, [16, 17]]])]],
+  ]);
+  r = await reqCbor('/devices/register', cbor(CBOR_DOC));
+  assert('status 201',           r.status === 201);
+  r = await req('GET', '/devices/' + encodeURIComponent('cb:or:00:00:00:01'));
+  const cborSensor = r.body?.capabilities?.[0];
+  assert('class expanded',       r.body?.device?.class === 'microcontroller');
+  assert('address as hex',       cborSensor?.address === '0x77', `got ${cborSensor?.address}`);
+  assert('provides expanded',    cborSensor?.provides?.join() === 'temperature,humidity');
+  r = await reqCbor('/devices/register', [0xbf, 0x00]);
+  assert('truncated CBOR → 400', r.status === 400);
+
+  // 13. Heartbeat (hash from X-CEP-Hash at registration)
+  console.log('\n13. POST /devices/heartbeat');
+  r = await req('POST', '/devices/register', PICO_DOC, { 'X-CEP-Hash': '1a2b3c4d' });
+  assert('register with hash 201', r.status === 201);
+  r = await req('POST', '/devices/heartbeat', { id: PICO_DOC.device.id, hash: '1a2b3c4d' });
+  assert('same hash → 200',      r.status === 200 && r.body?.status === 'unchanged');
+  r = await req('POST', '/devices/heartbeat', { id: PICO_DOC.device.id, hash: 'deadbeef' });
+  assert('other hash → 409',     r.status === 409 && r.body?.status === 'send_full');
+  r = await req('POST', '/devices/heartbeat', { id: 'no:such:device', hash: '1a2b3c4d' });
+  assert('unknown id → 404',     r.status === 404);
+
+  // 14. Delta update (JSON Patch against the hashed document)
+  console.log('\n14. PATCH /devices/:id');
+  const picoPath = '/devices/' + encodeURIComponent(PICO_DOC.device.id);
+  const ops = [{ op: 'replace', path: '/capabilities/1/buses/0/devices_found', value: ['0x68', '0x76'] }];
+  r = await req('PATCH', picoPath, { base: 'deadbeef', hash: '5e6f7a8b', ops });
+  assert('stale base → 409',     r.status === 409);
+  r = await req('PATCH', picoPath, { base: '1a2b3c4d', hash: '5e6f7a8b', ops });
+  assert('status 200',           r.status === 200 && r.body?.status === 'patched');
+  r = await req('GET', picoPath);
+  assert('field updated',        r.body?.capabilities?.[1]?.buses?.[0]?.devices_found?.length === 2);
+  r = await req('POST', '/devices/heartbeat', { id: PICO_DOC.device.id, hash: '5e6f7a8b' });
+  assert('new hash is current',  r.status === 200);
+  r = await req('PATCH', picoPath, { base: '5e6f7a8b', hash: '00000000',
+                                     ops: [{ op: 'replace', path: '/device/id', value: 'evil' }] });
+  assert('id change → 400',      r.status === 400);
+
+  // 15. Batched samples (cep_sampling.h cepWriteBatch)
+  console.log('\n15. POST/GET /devices/:id/samples');
+  const batch = { sensors: [{ chipset: 'mpu6050', bus_id: 0, address: '0x68',
+                              channels: ['accel_x_mg', 'accel_y_mg'], t0_us: 5000,
+                              samples: [[0, 1000, -20], [1000, 998, -18], [2000, 1001, -21]] }] };
+  r = await req('POST', picoPath + '/samples', batch);
+  assert('status 202',           r.status === 202 && r.body?.samples === 3);
+  r = await req('GET', picoPath + '/samples?limit=2');
+  const imuRows = r.body?.sensors?.[0]?.samples;
+  assert('latest 2 rows',        imuRows?.length === 2);
+  assert('absolute t_us',        imuRows?.[1]?.[0] === 7000, `got ${imuRows?.[1]?.[0]}`);
+  r = await req('POST', picoPath + '/samples', { sensors: [{ channels: ['a'], t0_us: 0, samples: [[0]] }] });
+  assert('short row → 400',      r.status === 400);
+  const many = Array.from({ length: 32 }, (_, i) => ({ chipset: 'ads1115', bus_id: 1, address: `0x${i}`,
+                                                        channels: ['a'], t0_us: 0, samples: [] }));
+  r = await req('POST', picoPath + '/samples', { sensors: many });
+  assert('too many sensors → 400', r.status === 400);
+  r = await req('GET', picoPath + '/samples');
+  assert('none of them stored',  r.body?.sensors?.length === 1);
+  r = await req('POST', '/devices/no-such-device/samples', batch);
+  assert('unknown device → 404', r.status === 404);
+
+  // 16. Feature vector for /infer (cep_features.h); only validation is
+  //     checked here, a valid body goes on to the inference runtime
+  console.log('\n16. POST /infer with device features');
+  r = await req('POST', '/infer', { features: { channels: ['accel_x_mg', 'accel_y_mg'], mean: [1] } });
+  assert('short mean → 400',     r.status === 400);
+  r = await req('POST', '/infer', { features: { channels: ['accel_x_mg'] } });
+  assert('no features → 400',    r.status === 400);
+  r = await req('POST', '/infer', { features: { channels: ['a'], fft: [[1, 'x']] } });
+  assert('bad fft row → 400',    r.status === 400);
+  // CEP_FORMAT_CBOR: features (68) { channels (25): ["a", "b"], mean (71): [1] }
+  r = await reqCbor('/infer', cbor(new Map([[68, new Map([[25, ['a', 'b']], [71, [1]]])]])));
+  assert('CBOR decoded → 400',   r.status === 400 && /features\.mean/.test(r.body?.error), `got ${r.body?.error}`);
+  r = await reqCbor('/infer', [0xbf, 0x18]);
+  assert('truncated CBOR → 400', r.status === 400);
+
+  // 17. /infer routed to a device that runs the model (cep_inference.h). A
+  //     local HTTP server stands in for the ESP32, so only when BASE is local.
+  //     A forwarded address must not redirect the request.
+  if (/^https?:\/\/(localhost|127\.0\.0\.1)[:/]/.test(BASE)) {
+    console.log('\n17. POST /infer delegated to an on-device model');
+    let seenInput = null;
+    const fake = createServer((rq, rs) => {
+      let data = '';
+      rq.on('data', c => { data += c; });
+      rq.on('end', () => {
+        seenInput = JSON.parse(data).input;
+        rs.setHeader('Content-Type', 'application/json');
+        rs.end(JSON.stringify({ bundleId: 'gesture-v1', output: 'wave', class: 1,
+                                scores: [-20, 40], score_scale_milli: 62, elapsedUs: 180 }));
+      });
+    });
+    await new Promise(ok => fake.listen(0, '127.0.0.1', ok));
+    const MCU_DOC = {
+      device: { id: 'mcu-infer-1', class: 'microcontroller', transport: 'network' },
+      capabilities: [{ type: 'compute', mhz: 240,
+                       inference: { model: 'gesture-v1', ops_per_sec: 2000000, inputs: 4, outputs: 2,
+                                    port: fake.address().port } }],
+    };
+    r = await req('POST', '/devices/register', MCU_DOC, { 'X-Forwarded-For': '203.0.113.9' });
+    assert('register 201',         r.status === 201);
+    r = await req('POST', '/infer', { bundleId: 'gesture-v1',
+                                      features: { channels: ['a', 'b'], mean: [1, 2], std: [3, 4] } });
+    assert('status 200',           r.status === 200, `got ${r.status}`);
+    assert('answered by device',   r.body?._delegatedTo === 'mcu-infer-1' && r.body?.output === 'wave');
+    assert('features flattened',   seenInput?.join() === '1,2,3,4', `got ${seenInput}`);
+    assert('confidence from scores', r.body?.confidenceScore > 0.9 && r.body?.confidenceScore < 1);
+    // The same request as CBOR: bundleId (67), features (68), channels (25), mean (71), std (72)
+    seenInput = null;
+    r = await reqCbor('/infer', cbor(new Map([
+      [67, 'gesture-v1'],
+      [68, new Map([[25, ['a', 'b']], [71, [1, 2]], [72, [3, 4]]])],
+    ])));
+    assert('CBOR answered by device', r.status === 200 && r.body?._delegatedTo === 'mcu-infer-1',
+           `got ${r.status}`);
+    assert('CBOR features flattened', seenInput?.join() === '1,2,3,4', `got ${seenInput}`);
+    await req('DELETE', '/devices/mcu-infer-1');
+    fake.close();
+  }
+
+  // 18. Identical capability lists are stored once
+  console.log('\n18. Shared capability documents');
+  r = await req('GET', '/devices');
+  const docsBefore = r.body?.registry?.documents;
+  assert('registry stats',       Number.isInteger(docsBefore));
+  const TWIN_CAPS = [{ type: 'sensor', chipset: 'bme280', bus: 'i2c', bus_id: 0, address: '0x77',
+                       provides: ['temperature', 'humidity', 'pressure'] }];
+  for (const id of ['twin-a', 'twin-b']) {
+    await req('POST', '/devices/register',
+              { device: { id, class: 'microcontroller', transport: 'network' }, capabilities: TWIN_CAPS });
+  }
+  r = await req('GET', '/devices');
+  assert('one document for two devices', r.body?.registry?.documents === docsBefore + 1,
+         `got ${r.body?.registry?.documents - docsBefore}`);
+  r = await req('GET', '/devices/twin-b');
+  assert('twin reads back',      r.body?.capabilities?.[0]?.address === '0x77');
+  await req('DELETE', '/devices/twin-a');
+  await req('DELETE', '/devices/twin-b');
+  r = await req('GET', '/devices');
+  assert('released on delete',   r.body?.registry?.documents === docsBefore);
+
+  // 19. Gateway batch registration, as a JSON array and as NDJSON
+  console.log('\n19. POST /devices/register/batch');
+  const board = i => ({ device: { id: `gw-board-${i}`, class: 'microcontroller', transport: 'serial' },
+                        capabilities: [{ type: 'gpio', digital_out: [13] }] });
+  r = await req('POST', '/devices/register/batch',
+                [board(0), { hash: 'A1B2C3D4', document: board(1) }, { device: {} }]);
+  assert('status 201',           r.status === 201, `got ${r.status}`);
+  assert('2 registered',         r.body?.registered === 2);
+  assert('bad item reported',    r.body?.errors?.[0]?.index === 2);
+  r = await req('POST', '/devices/heartbeat', { id: 'gw-board-1', hash: 'a1b2c3d4' });
+  assert('hash kept',            r.status === 200, `got ${r.status}`);
+  const ndjson = [board(2), board(3), board(4)].map(d => JSON.stringify(d)).join('\n') + '\n{oops\n';
+  const nd = await fetch(BASE + '/devices/register/batch', {
+    method: 'POST', headers: { 'Content-Type': 'application/x-ndjson' }, body: ndjson,
+  });
+  const ndBody = await nd.json().catch(() => null);
+  assert('ndjson 201',           nd.status === 201, `got ${nd.status}`);
+  assert('3 from ndjson',        ndBody?.registered === 3);
+  assert('bad line reported',    ndBody?.errors?.[0]?.index === 3);
+  r = await req('GET', '/devices/gw-board-4');
+  assert('ndjson device stored', r.status === 200);
+  // An oversized last line (valid JSON padded with whitespace, no newline)
+  const huge = JSON.stringify(board(5)) + '\n' + JSON.stringify(board(6)) + ' '.repeat(300 * 1024);
+  const big  = await fetch(BASE + '/devices/register/batch', {
+    method: 'POST', headers: { 'Content-Type': 'application/x-ndjson' }, body: huge,
+  });
+  assert('oversized line 413',   big.status === 413, `got ${big.status}`);
+  await big.text();
+  await new Promise(ok => setTimeout(ok, 100));   // let the server see the end of the body
+  r = await req('GET', '/devices/gw-board-6');
+  assert('rejected line not stored', r.status === 404, `got ${r.status}`);
+  for (let i = 0; i < 7; i++) await req('DELETE', '/devices/gw-board-' + i);
+
+  // 20. Change stream: snapshot, then add / update / remove as they happen
+  console.log('\n20. GET /devices/events');
+  const stream = await openEvents('/devices/events?provides=humidity');
+  let ev = await stream.next();
+  assert('snapshot first',       ev?.event === 'snapshot' && Array.isArray(ev.data?.devices));
+  const SSE_DOC = { device: { id: 'sse-node', class: 'microcontroller', transport: 'network' },
+                    capabilities: [{ type: 'sensor', chipset: 'bme280', provides: ['humidity'] }] };
+  await req('POST', '/devices/register', { device: { id: 'sse-other' }, capabilities: [{ type: 'gpio' }] });
+  await req('POST', '/devices/register', SSE_DOC, { 'X-CEP-Hash': '0000aaaa' });
+  ev = await stream.next();
+  assert('add event (filtered)', ev?.event === 'add' && ev.data?.id === 'sse-node', `got ${ev?.event} ${ev?.data?.id}`);
+  await req('PATCH', '/devices/sse-node', { base: '0000aaaa', hash: '0000bbbb',
+    ops: [{ op: 'replace', path: '/capabilities/0/chipset', value: 'bme680' }] });
+  ev = await stream.next();
+  assert('update carries delta', ev?.event === 'update' && ev.data?.ops?.length === 1 &&
+                                 ev.data?.base === '0000aaaa');
+  await req('DELETE', '/devices/sse-node');
+  await req('DELETE', '/devices/sse-other');
+  ev = await stream.next();
+  assert('remove event',         ev?.event === 'remove' && ev.data?.id === 'sse-node');
+  const lastId = ev?.id;
+  stream.close();
+  const again = await openEvents('/devices/events', { 'Last-Event-ID': String(lastId) });
+  ev = await again.next();
+  assert('replay after reconnect', ev?.event === 'remove' && ev.data?.id === 'sse-other',
+         `got ${ev?.event} ${ev?.data?.id}`);
+  again.close();
+
+  // 21. /train spread across registered GPU nodes, with failover. Local
+  //     HTTP servers stand in for the helpers, so only when BASE is local.
+  //     A forwarded address must not redirect the work.
+  if (/^https?:\/\/(localhost|127\.0\.0\.1)[:/]/.test(BASE)) {
+    console.log('\n21. POST /train delegated across GPU helpers');
+    const helpers = ['gpu-a', 'gpu-b'].map(name => {
+      const h = { name, hits: 0, probes: 0, marked: true, failing: false };
+      h.server = createServer((rq, rs) => {
+        if (rq.url === '/capabilities') h.probes++;
+        h.hits++;
+        h.marked &&= rq.headers['x-jumpnet-delegated'] === '1';
+        rq.resume();
+        rq.on('end', () => setTimeout(() => {
+          rs.statusCode = h.failing ? 503 : 200;
+          rs.setHeader('Content-Type', 'application/json');
+          rs.end(JSON.stringify({ jobId: `${name}-job` }));
+        }, 100));
+      });
+      return h;
+    });
+    for (const h of helpers) {
+      await new Promise(ok => h.server.listen(0, '127.0.0.1', ok));
+      r = await req('POST', '/devices/register', {
+        device: { id: h.name, class: 'single_board_computer', transport: 'network' },
+        capabilities: [{ type: 'compute', mhz: 3000, ram_kb: 16777216, gpu: 'available',
+                         port: h.server.address().port }],
+      }, { 'X-Forwarded-For': '203.0.113.9' });
+      assert(`register ${h.name}`, r.status === 201);
+    }
+    const [ra, rb] = await Promise.all([req('POST', '/train', { datasetId: 'x' }),
+                                        req('POST', '/train', { datasetId: 'y' })]);
+    const by = [ra.body?._delegatedTo, rb.body?._delegatedTo];
+    assert('both delegated',       ra.status === 200 && rb.status === 200, `got ${ra.status} ${rb.status}`);
+    assert('spread across helpers', by[0] && by[1] && by[0] !== by[1], `got ${by}`);
+    assert('no capability probes', helpers.every(h => h.probes === 0));
+    assert('marked as delegated',  helpers.every(h => h.marked));
+    helpers[0].failing = true;
+    helpers[1].failing = false;
+    r = await req('POST', '/train', { datasetId: 'z' });
+    assert('fails over',           r.status === 200 && r.body?.jobId === 'gpu-b-job',
+           `got ${r.status} ${r.body?.jobId}`);
+    const hitsA = helpers[0].hits;
+    r = await req('POST', '/train', { datasetId: 'z' });
+    assert('failed helper skipped', r.body?.jobId === 'gpu-b-job' && helpers[0].hits === hitsA);
+    const hitsB = helpers[1].hits;
+    r = await req('POST', '/infer', { features: { channels: ['a'] } });
+    assert('bad features not delegated', r.status === 400 && helpers[1].hits === hitsB,
+           `got ${r.status}, ${helpers[1].hits - hitsB} forwarded`);
+    for (const h of helpers) {
+      await req('DELETE', `/devices/${h.name}`);
+      h.server.close();
+    }
+  }
+
+  // 22. Fleet telemetry in /status
+  console.log('\n22. GET /status fleet telemetry');
+  const telemetry = (id, t) => ({
+    device: { id, class: 'microcontroller', transport: 'network' },
+    capabilities: [{ type: 'compute', mhz: 240 }, { type: 'telemetry', ...t }],
+  });
+  r = await req('GET', '/status');
+  const before = r.body?.fleet;
+  assert('fleet block',          Number.isInteger(before?.reporting) && before?.totals !== undefined);
+  await req('POST', '/devices/register', telemetry('tele-a', { scan_us: 9000, i2c_nacks: 120, reg_ok: 9,
+                                                                reg_failures: 1, heap_max_block_b: 90000 }));
+  await req('POST', '/devices/register', telemetry('tele-b', { scan_us: 250000, i2c_nacks: 126, reg_ok: 5,
+                                                                reg_failures: 5, heap_max_block_b: 4000 }));
+  r = await req('GET', '/status');
+  const fleet = r.body?.fleet;
+  assert('two more reporting',   fleet?.reporting === before.reporting + 2, `got ${fleet?.reporting}`);
+  assert('totals summed',        fleet?.totals?.i2c_nacks === before.totals.i2c_nacks + 246);
+  assert('slowest scan named',   fleet?.metrics?.scan_us?.worst === 'tele-b' &&
+                                 fleet.metrics.scan_us.max === 250000);
+  assert('smallest block named', fleet?.metrics?.heap_max_block_b?.worst === 'tele-b');
+  assert('failure rate derived', fleet?.metrics?.reg_failure_rate?.max === 0.5);
+  await req('DELETE', '/devices/tele-a');
+  await req('DELETE', '/devices/tele-b');
+
   // ── Summary ──────────────────────────────────────────────────────────────
   console.log(`\n${'─'.repeat(40)}`);
   console.log(`Passed: ${passed}   Failed: ${failed}`);
@@ -0,0 +1,149 @@
+/**
+ * server/lib/cbor.js
+ *
+ * Minimal CBOR (RFC 8949) decoder — enough for CEP documents sent by
+ * clients/arduino/cep.h in CEP_FORMAT_CBOR mode, with no npm dependency.
+ *
+ * Supports unsigned/negative integers, byte and text strings, arrays and
+ * maps (definite and indefinite length), tags (the tag is dropped, the value
+ * kept), false/true/null/undefined and half/single/double floats.
+ * Integer map keys can be renamed while decoding (opts.mapKey), which keeps
+ * the wire order — plain objects would otherwise hoist integer keys first.
+ */
+
+const BREAK = Symbol('break');
+
+/**
+ * Decode a single CBOR data item.
+ *
+ * @param {Buffer|Uint8Array} buf
+ * @param {object}   [opts]
+ * @param {(key: *) => *} [opts.mapKey]  translate each map key
+ * @returns {*}  decoded value; maps become plain objects
+ * @throws {Error} on malformed or truncated input, or trailing bytes
+ */
+export function decodeCbor(buf, opts = {}) {
+  const mapKey = opts.mapKey ?? (k => k);
+  const bytes = buf instanceof Uint8Array ? buf : new Uint8Array(buf);
+  const view  = new DataView(bytes.buffer, bytes.byteOffset, bytes.byteLength);
+  let pos = 0;
+
+  function need(n) {
+    if (pos + n > bytes.length) throw new Error('CBOR: unexpected end of input');
+  }
+
+  function readArg(info) {
+    if (info < 24) return info;
+    switch (info) {
+      case 24: need(1); return bytes[pos++];
+      case 25: need(2); pos += 2; return view.getUint16(pos - 2);
+      case 26: need(4); pos += 4; return view.getUint32(pos - 4);
+      case 27: {
+        need(8);
+        const v = view.getBigUint64(pos);
+        pos += 8;
+        return v <= BigInt(Number.MAX_SAFE_INTEGER) ? Number(v) : v;
+      }
+      case 31: return -1;   // indefinite length
+      default: throw new Error(`CBOR: reserved additional info ${info}`);
+    }
+  }
+
+  function readChunks(major, len) {
+    if (len >= 0) {
+      need(len);
+      const chunk = bytes.subarray(pos, pos + len);
+      pos += len;
+      return chunk;
+    }
+    const parts = [];
+    for (;;) {
+      const item = readItem();
+      if (item === BREAK) break;
+      parts.push(major === 3 ? Buffer.from(item, 'utf8') : item);
+    }
+    return Buffer.concat(parts);
+  }
+
+  function readItem() {
+    need(1);
+    const initial = bytes[pos++];
+    const major   = initial >> 5;
+    const info    = initial & 0x1f;
+
+    if (initial === 0xff) return BREAK;
+
+    switch (major) {
+      case 0: return readArg(info);
+      case 1: {
+        const n = readArg(info);
+        return typeof n === 'bigint' ? -1n - n : -1 - n;
+      }
+      case 2: return Buffer.from(readChunks(2, readArg(info)));
+      case 3: return Buffer.from(readChunks(3, readArg(info))).toString('utf8');
+      case 4: {
+        const len = readArg(info);
+        const arr = [];
+        if (len >= 0) {
+          for (let i = 0; i < len; i++) arr.push(readItem());
+        } else {
+          for (let item; (item = readItem()) !== BREAK;) arr.push(item);
+        }
+        return arr;
+      }
+      case 5: {
+        const len = readArg(info);
+        const obj = {};
+        for (let i = 0; len < 0 || i < len; i++) {
+          const k = readItem();
+          if (k === BREAK) {
+            if (len < 0) break;
+            throw new Error('CBOR: unexpected break in map');
+          }
+          // defineProperty so a "__proto__" key cannot reach the prototype
+          Object.defineProperty(obj, mapKey(k), {
+            value: readItem(), enumerable: true, writable: true, configurable: true,
+          });
+        }
+        return obj;
+      }
+      case 6:
+        readArg(info);
+        return readItem();
+      case 7:
+        switch (info) {
+          case 20: return false;
+          case 21: return true;
+          case 22: return null;
+          case 23: return undefined;
+          case 25: {
+            need(2);
+            const h = view.getUint16(pos);
+            pos += 2;
+            return halfToFloat(h);
+          }
+          case 26: need(4); pos += 4; return view.getFloat32(pos - 4);
+          case 27: need(8); pos += 8; return view.getFloat64(pos - 8);
+          default:
+            if (info < 24) return undefined;   // unassigned simple value
+            if (info === 24) { need(1); pos++; return undefined; }
+            throw new Error(`CBOR: unsupported simple value ${info}`);
+        }
+    }
+    throw new Error(`CBOR: bad major type ${major}`);
+  }
+
+  const value = readItem();
+  if (value === BREAK) throw new Error('CBOR: unexpected break');
+  if (pos !== bytes.length) throw new Error('CBOR: trailing bytes after data item');
+  return value;
+}
+
+function halfToFloat(h) {
+  const exp  = (h >> 10) & 0x1f;
+  const mant = h & 0x3ff;
+  const sign = h & 0x8000 ? -1 : 1;
+  if (exp === 0)  return sign * 2 ** -14 * (mant / 1024);
+  if (exp === 31) return mant ? NaN : sign * Infinity;
+  return sign * 2 ** (exp - 15) * (1 + mant / 1024);
+}
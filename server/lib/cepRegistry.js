@@ -4,6 +4,11 @@
  * In-memory registry of CEP device documents received via POST /devices/register.
  * Each entry is the full CEP JSON as defined in schemas/cep.schema.json.
  *
+ * Memory stays bounded under churn: devices expire DEVICE_TTL_MS after they
+ * were last seen, the registry holds at most DEVICE_MAX devices (least
+ * recently seen evicted first), and identical capability lists are stored
+ * once. onDeviceEvicted() hooks per-device state kept elsewhere.
+ *
  * On JumpNet nodes with persistent storage, swap the Map for a JSON file or
  * SQLite (e.g. better-sqlite3) backing — the API surface stays the same.
  */
@@ -13,34 +18,427 @@
  * @property {object}   device        — device identity block
  * @property {object[]} capabilities  — capability array
  * @property {string}   _registeredAt — ISO timestamp of registration
+ * @property {string}   _lastSeen     — ISO timestamp of the last register/heartbeat/patch
  * @property {string}   _ip           — originating IP if available
+ * @property {string}   _addr         — socket address the device last reached
+ *                                      us from (never a forwarded header), or
+ *                                      null; delegation connects only here
+ * @property {string}   _hash         — device-reported content hash (cep.h
+ *                                      lastHash(), 8 hex digits), or null
  */
 
+import { createHash } from 'node:crypto';
+import { decodeCbor } from './cbor.js';
+
 /** @type {Map<string, CepDevice>} keyed by device.id */
 const _registry = new Map();
 
+// ── Limits ────────────────────────────────────────────────────────────────────
+// A device that stops registering, heartbeating or patching for DEVICE_TTL_MS
+// is dropped (default: three missed 60 s cep_registrar.h heartbeats; 0 keeps
+// devices forever). DEVICE_MAX caps the registry; past it the least recently
+// seen device is evicted (0 = no cap).
+
+const TTL_MS      = parseInt(process.env.DEVICE_TTL_MS ?? '180000');
+const MAX_DEVICES = parseInt(process.env.DEVICE_MAX ?? '10000');
+
+// Expiry runs on a timer wheel: one timer for the whole registry, ticking
+// through WHEEL_SLOTS buckets that together span at least one TTL. A device
+// sits in the bucket of its deadline and moves when it is seen again.
+const WHEEL_SLOTS = 64;
+const TICK_MS     = Math.max(1000, Math.ceil(TTL_MS / WHEEL_SLOTS));
+
+/** @type {Set<string>[]} */
+const _wheel    = Array.from({ length: WHEEL_SLOTS }, () => new Set());
+/** @type {Map<string, number>} id → expiry deadline (ms); iteration order = least recently seen first */
+const _deadline = new Map();
+let _wheelTick  = Math.floor(Date.now() / TICK_MS);   // every tick before this has been swept
+let _sweeper    = null;
+
+const _evictListeners  = [];
+const _changeListeners = [];
+const _stats = { expired: 0, evicted: 0 };
+
+const slotOf = deadline => Math.floor(deadline / TICK_MS) % WHEEL_SLOTS;
+
+// Mark a device as seen now: new deadline, most recently used
+function touch(id) {
+  const old = _deadline.get(id);
+  if (old !== undefined) {
+    _wheel[slotOf(old)].delete(id);
+    _deadline.delete(id);
+  }
+  const deadline = Date.now() + TTL_MS;
+  _deadline.set(id, deadline);
+  if (TTL_MS > 0) {
+    _wheel[slotOf(deadline)].add(id);
+    _sweeper ??= setInterval(sweep, TICK_MS).unref();
+  }
+}
+
+// Expire every device whose deadline fell in a tick that has fully passed
+function sweep() {
+  const now  = Date.now();
+  const last = Math.floor(now / TICK_MS);
+  const from = Math.max(_wheelTick, last - WHEEL_SLOTS);
+  for (let t = from; t < last; t++) {
+    for (const id of _wheel[t % WHEEL_SLOTS]) {
+      if (_deadline.get(id) <= now) drop(id, 'expired');
+    }
+  }
+  _wheelTick = last;
+}
+
+function drop(id, reason) {
+  store(id, null);
+  _stats[reason]++;
+  for (const fn of _evictListeners) fn(id, reason);
+  emit({ event: 'remove', id, reason });
+}
+
+function emit(change) {
+  for (const fn of _changeListeners) fn(change);
+}
+
+// ── Shared documents ──────────────────────────────────────────────────────────
+// Boards built from the same firmware and wiring send identical capability
+// lists; each distinct list is stored once, with the index keys derived from
+// it, and shared by every device that sent it. Stored capabilities are
+// therefore read-only.
+
+/** @type {Map<string, { capabilities: object[], types: Set<string>, provides: Set<string>, refs: number }>} */
+const _documents = new Map();
+
+function documentKey(capabilities) {
+  return createHash('sha1').update(JSON.stringify(capabilities ?? [])).digest('base64');
+}
+
+function intern(capabilities) {
+  const key = documentKey(capabilities);
+  let doc = _documents.get(key);
+  if (!doc) {
+    const types = new Set(), provides = new Set();
+    for (const c of Array.isArray(capabilities) ? capabilities : []) {
+      if (typeof c?.type === 'string') types.add(c.type);
+      if (Array.isArray(c?.provides)) {
+        for (const m of c.provides) if (typeof m === 'string') provides.add(m);
+      }
+    }
+    doc = { key, capabilities, types, provides, refs: 0 };
+    _documents.set(key, doc);
+  }
+  doc.refs++;
+  return doc;
+}
+
+function release(doc) {
+  if (doc && --doc.refs === 0) _documents.delete(doc.key);
+}
+
+// ── Indexes ───────────────────────────────────────────────────────────────────
+// Kept in step with _registry by every write, so reads never walk documents:
+// capability type → device ids, measurement (capabilities[].provides) →
+// device ids, and one summary row per device.
+
+/** @type {Map<string, Set<string>>} */
+const _byType     = new Map();
+/** @type {Map<string, Set<string>>} */
+const _byProvides = new Map();
+/** @type {Map<string, object>} shared document each device points at */
+const _docOf      = new Map();
+/** @type {Map<string, object>} summary() rows, updated in place by heartbeats */
+const _rows       = new Map();
+/** @type {object|null} last summary(), dropped when a device is added, changed or removed */
+let _summary = null;
+
+// Move id between index buckets, touching only the keys that changed so the
+// untouched buckets keep their registration order
+function refile(index, id, before, after) {
+  for (const k of before) {
+    if (after.has(k)) continue;
+    const ids = index.get(k);
+    ids.delete(id);
+    if (ids.size === 0) index.delete(k);
+  }
+  for (const k of after) {
+    if (before.has(k)) continue;
+    let ids = index.get(k);
+    if (!ids) index.set(k, ids = new Set());
+    ids.add(id);
+  }
+}
+
+const NO_KEYS = { types: new Set(), provides: new Set() };
+
+function summaryRow(d) {
+  return {
+    id:           d.device.id,
+    class:        d.device.class,
+    model:        d.device.model ?? null,
+    transport:    d.device.transport,
+    capabilities: d.capabilities?.map(c => c.type) ?? [],
+    registeredAt: d._registeredAt,
+    lastSeen:     d._lastSeen,
+    ip:           d._ip,
+  };
+}
+
+// Store (entry) or drop (null) a device and bring every index, the expiry
+// wheel and the LRU order up to date. A stored entry counts as seen now.
+function store(id, entry) {
+  const before = _docOf.get(id);
+  const after  = entry ? intern(entry.capabilities) : null;
+  if (after) entry.capabilities = after.capabilities;
+  refile(_byType, id, (before ?? NO_KEYS).types, (after ?? NO_KEYS).types);
+  refile(_byProvides, id, (before ?? NO_KEYS).provides, (after ?? NO_KEYS).provides);
+  release(before);
+  if (entry) {
+    _registry.set(id, entry);
+    _docOf.set(id, after);
+    _rows.set(id, summaryRow(entry));
+    touch(id);
+  } else {
+    _registry.delete(id);
+    _docOf.delete(id);
+    _rows.delete(id);
+    const deadline = _deadline.get(id);
+    if (deadline !== undefined) _wheel[slotOf(deadline)].delete(id);
+    _deadline.delete(id);
+  }
+  _summary = null;
+
+  if (entry && MAX_DEVICES > 0 && _registry.size > MAX_DEVICES) {
+    drop(_deadline.keys().next().value, 'evicted');
+  }
+}
+
+const devicesIn = ids => (ids ? [...ids].map(id => _registry.get(id)) : []);
+
+// ── CBOR encoding ─────────────────────────────────────────────────────────────
+// Must match CEP_CBOR_KEYS / CEP_CBOR_VALUES in clients/arduino/cep_json.h.
+// Both lists are append-only: an entry's index is its wire encoding.
+
+export const CEP_CBOR_KEYS = [
+  'device', 'capabilities', 'id', 'class', 'transport', 'model',
+  'firmware', 'type', 'mhz', 'ram_kb', 'flash_kb', 'buses',
+  'sda', 'scl', 'freq_hz', 'devices_found', 'chipset', 'bus',
+  'bus_id', 'address', 'provides', 'digital_out', 'digital_in', 'pins',
+  'resolution', 'channels', 'interfaces', 'kind', 'mac', 'mux',
+  'mux_channel', 'width_px', 'height_px', 'color', 'sensors', 't0_us',
+  'samples', 'inference', 'ops_per_sec', 'inputs', 'outputs', 'port',
+  'mosi', 'miso', 'sck', 'cs', 'ports', 'rx', 'tx', 'baud',
+  'uptime_s', 'scans', 'scan_us', 'scan_max_us', 'i2c_probes', 'i2c_nacks',
+  'builds', 'build_us', 'build_max_us', 'bytes_out', 'heap_peak_b',
+  'heap_min_free_b', 'heap_max_block_b', 'reg_ok', 'reg_failures', 'reg_ms',
+  'reg_max_ms', 'bundleId', 'features', 'window', 'period_us', 'mean',
+  'std', 'rms', 'fft', 'first', 'delta',
+];
+
+export const CEP_CBOR_VALUES = [
+  'compute', 'i2c', 'spi', 'uart', 'sensor', 'display', 'gpio', 'adc',
+  'network', 'microcontroller', 'serial', 'usb', 'ble', 'lora', 'wifi',
+  'ethernet', 'temperature', 'humidity', 'pressure', 'acceleration',
+  'gyroscope', 'computer', 'sensor-node', 'neopixel', 'telemetry',
+];
+
+/** Keys whose integer values index CEP_CBOR_VALUES */
+const ENUM_KEYS    = new Set(['type', 'class', 'transport', 'bus', 'kind', 'provides']);
+/** Keys whose integer values are I2C addresses, rendered "0x.." in JSON */
+const ADDRESS_KEYS = new Set(['address', 'mux', 'devices_found']);
+
+const hex8 = n => '0x' + n.toString(16).padStart(2, '0');
+
+function expandValue(key, v) {
+  if (Array.isArray(v)) return v.map(x => expandValue(key, x));
+  if (typeof v === 'number') {
+    if (ENUM_KEYS.has(key))    return CEP_CBOR_VALUES[v] ?? v;
+    if (ADDRESS_KEYS.has(key)) return hex8(v);
+    return v;
+  }
+  if (v !== null && typeof v === 'object' && !Buffer.isBuffer(v)) return expandObject(v);
+  return v;
+}
+
+function expandObject(obj) {
+  const out = {};
+  for (const [k, v] of Object.entries(obj)) out[k] = expandValue(k, v);
+  return out;
+}
+
+const cborKeyName = k => (typeof k === 'number' ? (CEP_CBOR_KEYS[k] ?? String(k)) : k);
+
+/**
+ * Decode a CBOR-encoded CEP document (Content-Type: application/cbor) into
+ * the same shape as its JSON form.
+ *
+ * @param {Buffer} buf
+ * @returns {object}
+ */
+export function decodeCepCbor(buf) {
+  const raw = decodeCbor(buf, { mapKey: cborKeyName });
+  if (raw === null || typeof raw !== 'object' || Array.isArray(raw)) {
+    throw new Error('CBOR CEP document must be a map');
+  }
+  return expandObject(raw);
+}
+
 // ── Write ─────────────────────────────────────────────────────────────────────
 
+const normaliseHash = h => (typeof h === 'string' && h ? h.toLowerCase() : null);
+
 /**
  * Register or update a device's capability document.
  *
  * @param {object} doc    — CEP document (must have doc.device.id)
  * @param {string} [ip]   — originating IP address
+ * @param {string} [hash] — device-reported content hash (X-CEP-Hash)
+ * @param {string} [addr] — socket address of the request
  * @returns {CepDevice}   — stored entry
  */
-export function registerDevice(doc, ip = null) {
+export function registerDevice(doc, ip = null, hash = null, addr = null) {
   if (!doc?.device?.id) {
     throw new Error('CEP document missing device.id');
   }
+  const now   = new Date().toISOString();
   const entry = {
     ...doc,
-    _registeredAt: new Date().toISOString(),
+    _registeredAt: now,
+    _lastSeen:     now,
     _ip:           ip,
+    _addr:         addr,
+    _hash:         normaliseHash(hash),
   };
-  _registry.set(doc.device.id, entry);
+  const id      = doc.device.id;
+  const prev    = _registry.get(id);
+  const prevDoc = _docOf.get(id);
+  store(id, entry);
+  // Re-registering an identical document (e.g. after a server restart) is
+  // not a change worth announcing
+  if (!prev || prevDoc !== _docOf.get(id) || prev._hash !== entry._hash ||
+      JSON.stringify(prev.device) !== JSON.stringify(entry.device)) {
+    emit({ event: prev ? 'update' : 'add', id, hash: entry._hash, device: _rows.get(id) });
+  }
   return entry;
 }
 
+/**
+ * Record a heartbeat. The device is "unchanged" only if the stored document
+ * carries the same hash; otherwise it must re-send the full document.
+ *
+ * @param {string} id
+ * @param {string} hash
+ * @param {string} [ip]
+ * @param {string} [addr] — socket address of the request
+ * @returns {'unknown'|'changed'|'unchanged'}
+ */
+export function heartbeat(id, hash, ip = null, addr = null) {
+  const entry = _registry.get(id);
+  if (!entry) return 'unknown';
+  if (!entry._hash || entry._hash !== normaliseHash(hash)) return 'changed';
+  entry._lastSeen = new Date().toISOString();
+  if (ip) entry._ip = ip;
+  if (addr) entry._addr = addr;
+  const row = _rows.get(id);   // no reindex: the document is unchanged
+  row.lastSeen = entry._lastSeen;
+  row.ip       = entry._ip;
+  touch(id);
+  return 'unchanged';
+}
+
+// ── Delta updates (JSON Patch subset, RFC 6902) ──────────────────────────────
+
+const FORBIDDEN_SEGMENTS = new Set(['__proto__', 'prototype', 'constructor']);
+
+function parsePointer(path) {
+  if (typeof path !== 'string' || !path.startsWith('/')) {
+    throw new Error(`Invalid JSON pointer: ${path}`);
+  }
+  const parts = path.slice(1).split('/').map(p => p.replace(/~1/g, '/').replace(/~0/g, '~'));
+  if (parts.some(p => FORBIDDEN_SEGMENTS.has(p) || p.startsWith('_'))) {
+    throw new Error(`Path not patchable: ${path}`);
+  }
+  return parts;
+}
+
+function arrayIndex(arr, seg, allowEnd) {
+  if (allowEnd && seg === '-') return arr.length;
+  const i = /^(0|[1-9][0-9]*)$/.test(seg) ? Number(seg) : -1;
+  if (i < 0 || i > arr.length || (!allowEnd && i === arr.length)) {
+    throw new Error(`Array index out of range: ${seg}`);
+  }
+  return i;
+}
+
+function applyOp(doc, op) {
+  const parts = parsePointer(op?.path);
+  if (parts.length === 0) throw new Error('Cannot patch the document root');
+  const last = parts.pop();
+  let parent = doc;
+  for (const seg of parts) {
+    parent = Array.isArray(parent) ? parent[arrayIndex(parent, seg, false)]
+                                   : Object.hasOwn(parent ?? {}, seg) ? parent[seg] : undefined;
+    if (parent === null || typeof parent !== 'object') {
+      throw new Error(`Path not found: ${op.path}`);
+    }
+  }
+
+  switch (op.op) {
+    case 'add':
+      if (Array.isArray(parent)) parent.splice(arrayIndex(parent, last, true), 0, op.value);
+      else parent[last] = op.value;
+      break;
+    case 'replace':
+      if (Array.isArray(parent)) parent[arrayIndex(parent, last, false)] = op.value;
+      else if (Object.hasOwn(parent, last)) parent[last] = op.value;
+      else throw new Error(`Path not found: ${op.path}`);
+      break;
+    case 'remove':
+      if (Array.isArray(parent)) parent.splice(arrayIndex(parent, last, false), 1);
+      else if (Object.hasOwn(parent, last)) delete parent[last];
+      else throw new Error(`Path not found: ${op.path}`);
+      break;
+    default:
+      throw new Error(`Unsupported patch op: ${op?.op}`);
+  }
+}
+
+/**
+ * Apply a delta to a stored document. The patch only applies on top of the
+ * exact document the device last sent (base === stored hash); the result
+ * must still be a valid CEP document for the same device.
+ *
+ * @param {string}   id
+ * @param {object}   patch       — { base, hash, ops: [{ op, path, value }] }
+ * @param {string}   [ip]
+ * @param {string}   [addr]      — socket address of the request
+ * @returns {{ status: 'unknown'|'changed'|'patched', entry?: CepDevice }}
+ * @throws {Error} when an operation is malformed or does not apply
+ */
+export function patchDevice(id, patch, ip = null, addr = null) {
+  const entry = _registry.get(id);
+  if (!entry) return { status: 'unknown' };
+  if (!entry._hash || entry._hash !== normaliseHash(patch?.base)) return { status: 'changed' };
+  if (!Array.isArray(patch.ops)) throw new Error('Patch must include an ops array');
+
+  const doc = structuredClone(
+    Object.fromEntries(Object.entries(entry).filter(([k]) => !k.startsWith('_'))));
+  for (const op of patch.ops) applyOp(doc, op);
+
+  if (doc.device?.id !== id) throw new Error('Patch must not change device.id');
+  if (!Array.isArray(doc.capabilities)) throw new Error('Patched document has no capabilities array');
+
+  Object.assign(doc, {
+    _registeredAt: entry._registeredAt,
+    _lastSeen:     new Date().toISOString(),
+    _ip:           ip ?? entry._ip,
+    _addr:         addr ?? entry._addr,
+    _hash:         normaliseHash(patch.hash),
+  });
+  store(id, doc);
+  emit({ event: 'update', id, hash: doc._hash, base: entry._hash, ops: patch.ops, device: _rows.get(id) });
+  return { status: 'patched', entry: doc };
+}
+
 // ── Read ──────────────────────────────────────────────────────────────────────
 
 /**
@@ -50,11 +448,8 @@ export function registerDevice(doc, ip = null) {
  * @returns {CepDevice[]}
  */
 export function listDevices(capType = null) {
-  const all = [..._registry.values()];
-  if (!capType) return all;
-  return all.filter(d =>
-    d.capabilities?.some(c => c.type === capType)
-  );
+  if (!capType) return [..._registry.values()];
+  return devicesIn(_byType.get(capType));
 }
 
 /**
@@ -74,7 +469,10 @@ export function getDevice(id) {
  * @returns {boolean}
  */
 export function removeDevice(id) {
-  return _registry.delete(id);
+  if (!_registry.has(id)) return false;
+  store(id, null);
+  emit({ event: 'remove', id, reason: 'removed' });
+  return true;
 }
 
 /**
@@ -85,27 +483,97 @@ export function removeDevice(id) {
  * @returns {CepDevice[]}
  */
 export function findByProvides(measurement) {
-  return [..._registry.values()].filter(d =>
-    d.capabilities?.some(c =>
-      Array.isArray(c.provides) && c.provides.includes(measurement)
-    )
-  );
+  return devicesIn(_byProvides.get(measurement));
 }
 
 /**
- * Summarise registry contents for the /devices endpoint.
+ * Find devices that run a model on board (cep_inference.h) and serve it over
+ * HTTP: a compute capability with inference.model === model and a port, from
+ * a device whose socket address is known.
+ * Fastest first, by advertised ops_per_sec.
+ *
+ * @param {string} model
+ * @param {number} [inputs]  — only devices whose model takes this many inputs
+ * @returns {{ device: CepDevice, compute: object, inference: object }[]}
  */
-export function summary() {
+export function findInferenceDevices(model, inputs = null) {
+  const out = [];
+  for (const d of devicesIn(_byType.get('compute'))) {
+    const compute = d.capabilities?.find(c => c.type === 'compute' && c.inference?.model === model);
+    const inf     = compute?.inference;
+    if (!inf?.port || !d._addr) continue;
+    if (inputs !== null && inf.inputs !== inputs) continue;
+    out.push({ device: d, compute, inference: inf });
+  }
+  return out.sort((a, b) => (b.inference.ops_per_sec ?? 0) - (a.inference.ops_per_sec ?? 0));
+}
+
+/**
+ * Find registered nodes that can take delegated /infer and /train work: a
+ * compute capability with gpu === "available" and the HTTP port of a
+ * JumpNet API (compute.port), from a device whose socket address is known.
+ *
+ * @returns {{ device: CepDevice, compute: object }[]}
+ */
+export function findComputeHelpers() {
+  const out = [];
+  for (const d of devicesIn(_byType.get('compute'))) {
+    const compute = d.capabilities?.find(c => c.type === 'compute' && c.gpu === 'available' && c.port);
+    if (compute && d._addr) out.push({ device: d, compute });
+  }
+  return out;
+}
+
+/**
+ * Call fn(id, reason) whenever a device leaves the registry on its own:
+ * reason is 'expired' (TTL) or 'evicted' (DEVICE_MAX). Not called for
+ * removeDevice().
+ *
+ * @param {(id: string, reason: 'expired'|'evicted') => void} fn
+ */
+export function onDeviceEvicted(fn) {
+  _evictListeners.push(fn);
+}
+
+/**
+ * Call fn(change) after every change to the registry, with one of
+ *   { event: 'add' | 'update', id, hash, device }    — device: summary() row
+ *   { event: 'update', id, hash, base, ops, device } — delta (patchDevice)
+ *   { event: 'remove', id, reason }                  — 'removed' | 'expired' | 'evicted'
+ * Heartbeats that find the document unchanged are not changes.
+ *
+ * @param {(change: object) => void} fn
+ * @returns {() => void} unsubscribe
+ */
+export function onRegistryChange(fn) {
+  _changeListeners.push(fn);
+  return () => {
+    const i = _changeListeners.indexOf(fn);
+    if (i >= 0) _changeListeners.splice(i, 1);
+  };
+}
+
+/**
+ * Registry size and limits: devices, distinct capability documents stored,
+ * and how many devices expired or were evicted so far.
+ */
+export function registryStats() {
   return {
-    count:   _registry.size,
-    devices: [..._registry.values()].map(d => ({
-      id:           d.device.id,
-      class:        d.device.class,
-      model:        d.device.model ?? null,
-      transport:    d.device.transport,
-      capabilities: d.capabilities?.map(c => c.type) ?? [],
-      registeredAt: d._registeredAt,
-      ip:           d._ip,
-    })),
+    devices:      _registry.size,
+    documents:    _documents.size,
+    max_devices:  MAX_DEVICES || null,
+    ttl_ms:       TTL_MS || null,
+    expired:      _stats.expired,
+    evicted:      _stats.evicted,
   };
 }
+
+/**
+ * Summarise registry contents for the /devices endpoint. The result is
+ * cached until the next registration, patch or removal (heartbeats update
+ * its rows in place), so treat it as read-only.
+ */
+export function summary() {
+  _summary ??= { count: _rows.size, devices: [..._rows.values()] };
+  return _summary;
+}
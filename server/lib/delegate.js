@@ -1,85 +1,349 @@
 /**
  * server/lib/delegate.js
  *
- * Optional GPU delegation helper.
+ * Optional GPU delegation.
  *
- * If GPU_HELPER_URL is set (e.g. "http://ZW8:4080"), every call to
- * tryDelegate() will:
- *  1. Probe helper's GET /capabilities
- *  2. If helper.compute.gpu === "available", forward the request there
- *  3. Return the helper's JSON response, or null if delegation is skipped
+ * Helpers are JumpNet nodes whose compute.gpu is "available". They come from
+ * two places:
+ *  - GPU_HELPER_URL, a comma-separated list ("http://ZW8:4080,http://ZW9:4080").
+ *    Each helper's GET /capabilities is cached for HELPER_CAPS_TTL_MS (30 s):
+ *    only the first request waits for it, later ones use the cached answer
+ *    and refresh it in the background once it is stale.
+ *  - Registered CEP devices whose compute capability has gpu "available" and
+ *    the port of their JumpNet API; their document is the capability data,
+ *    so they are never probed. Anyone can register, so these are used only
+ *    from the addresses or subnets in TRUSTED_DEVICE_NETS
+ *    ("192.168.1.0/24,fd00::/8"; unset: none), and only at the socket
+ *    address they registered from, never one from X-Forwarded-For.
+ *
+ * tryDelegate() orders the helpers that offer the route (compute.services,
+ * when listed) by load — requests this node has in flight to them, then
+ * gpuUtil and cpuLoad, then mhz and ram_kb — and forwards to the first one,
+ * moving on to the next when a helper can't be reached. A helper that fails
+ * is skipped until its TTL has passed. Uploads are streamed through as they
+ * were received, not copied into a new buffer.
  *
  * Routes call this before running locally, so if a dedicated GPU node is
- * available it handles the heavy lifting.
+ * available it handles the heavy lifting. Forwarded requests carry
+ * X-JumpNet-Delegated so that a helper never passes them on again.
  *
  * GPU_HELPER_URL=http://ZW8:4080  node server.js      # on ZL1 (orchestrator)
  * (unset)                                              # on ZW8 (worker) — runs locally
+ * TRUSTED_DEVICE_NETS=192.168.1.0/24  node server.js   # plus registered GPU nodes on the LAN
+ *
+ * Feature-vector /infer requests (cep_features.h) can also be answered by a
+ * registered microcontroller that runs the requested model on board
+ * (cep_inference.h advertises compute.inference); see tryDeviceInfer().
+ * The same TRUSTED_DEVICE_NETS rule applies; DEVICE_INFER=0 turns it off
+ * for trusted devices too.
  */
 
-const HELPER_URL   = process.env.GPU_HELPER_URL ?? null;
-const TIMEOUT_MS   = 5_000;
+import { randomUUID } from 'node:crypto';
+import { BlockList, isIP } from 'node:net';
+import { findInferenceDevices, findComputeHelpers } from './cepRegistry.js';
+
+const HELPER_URLS        = (process.env.GPU_HELPER_URL ?? '').split(',')
+  .map(s => s.trim().replace(/\/+$/, '')).filter(Boolean);
+const CAPS_TTL_MS        = Number(process.env.HELPER_CAPS_TTL_MS ?? 30_000);
+const PROBE_TIMEOUT_MS   = 2_000;
+const FORWARD_TIMEOUT_MS = 120_000;
+const DEVICE_INFER       = process.env.DEVICE_INFER !== '0';
+const DEVICE_TIMEOUT_MS  = 2_000;
+const TRUSTED_NETS       = (process.env.TRUSTED_DEVICE_NETS ?? '').split(',')
+  .map(s => s.trim()).filter(Boolean);
+
+/** Header set on forwarded requests; routes don't delegate those again */
+export const DELEGATED_HEADER = 'x-jumpnet-delegated';
+
+/** url → { url, compute, ok, checkedAt, probing } for GPU_HELPER_URL nodes */
+const _helpers = new Map(HELPER_URLS.map(url =>
+  [url, { url, compute: null, ok: false, checkedAt: 0, probing: null }]));
+
+/** TRUSTED_DEVICE_NETS: registered devices delegation may connect to */
+const _trusted = new BlockList();
+for (const net of TRUSTED_NETS) {
+  const [addr, bits] = net.split('/');
+  const family = isIP(addr) === 6 ? 'ipv6' : 'ipv4';
+  try {
+    if (!isIP(addr)) throw new Error('not an address');
+    if (bits === undefined) _trusted.addAddress(addr, family);
+    else _trusted.addSubnet(addr, Number(bits), family);
+  } catch (err) {
+    console.warn(`[delegate] Ignoring TRUSTED_DEVICE_NETS entry "${net}": ${err.message}`);
+  }
+}
+
+/** url → time a CEP helper failed; skipped for CAPS_TTL_MS after that */
+const _down = new Map();
+
+/** url or device id → requests this node has in flight there */
+const _inflight = new Map();
+
+/** Run fn with key counted as busy for as long as it takes */
+async function busy(key, fn) {
+  _inflight.set(key, (_inflight.get(key) ?? 0) + 1);
+  try {
+    return await fn();
+  } finally {
+    const n = _inflight.get(key) - 1;
+    if (n) _inflight.set(key, n);
+    else _inflight.delete(key);
+  }
+}
+
+/** Socket address a registered device reached us from, or null */
+function deviceHost(device) {
+  return device._addr?.replace(/^::ffff:/, '') ?? null;
+}
+
+/** Whether delegated work may be sent to a registered device */
+function trusted(device) {
+  const host = deviceHost(device);
+  return !!host && _trusted.check(host, isIP(host) === 6 ? 'ipv6' : 'ipv4');
+}
+
+/** Base URL of a registered device's HTTP server */
+function deviceUrl(device, port) {
+  const host = deviceHost(device);
+  return `http://${host.includes(':') ? `[${host}]` : host}:${port}`;
+}
+
+/** Registered GPU nodes in TRUSTED_DEVICE_NETS */
+function deviceHelpers() {
+  return TRUSTED_NETS.length ? findComputeHelpers().filter(h => trusted(h.device)) : [];
+}
+
+/** Fetch a GPU_HELPER_URL node's capabilities; concurrent callers share one probe */
+function probe(h) {
+  h.probing ??= (async () => {
+    try {
+      const r = await fetch(`${h.url}/capabilities`, { signal: AbortSignal.timeout(PROBE_TIMEOUT_MS) });
+      if (!r.ok) throw new Error(`status ${r.status}`);
+      h.compute = (await r.json()).compute ?? null;
+      h.ok      = true;
+    } catch (err) {
+      if (h.ok || !h.checkedAt) console.warn(`[delegate] Could not probe ${h.url}: ${err.message}`);
+      h.ok = false;
+    } finally {
+      h.checkedAt = Date.now();
+      h.probing   = null;
+    }
+  })();
+  return h.probing;
+}
+
+/** Mark a helper as failed until its TTL passes */
+function markDown(url) {
+  const h = _helpers.get(url);
+  if (h) {
+    h.ok        = false;
+    h.checkedAt = Date.now();
+  } else {
+    _down.set(url, Date.now());
+  }
+}
+
+/** Lower is better: in-flight requests, GPU utilisation, CPU load */
+function load(c) {
+  return (_inflight.get(c.url) ?? 0) + (c.compute.gpuUtil ?? 0) + 0.5 * (c.compute.cpuLoad ?? 0);
+}
+
+/** Larger nodes first among equally loaded ones */
+function bySize(a, b) {
+  return (b.mhz ?? 0) - (a.mhz ?? 0) || (b.ram_kb ?? 0) - (a.ram_kb ?? 0);
+}
+
+/**
+ * Helpers that can take `service` right now, best first.
+ *
+ * @param {string} service  e.g. 'infer'
+ * @returns {Promise<{ url: string, compute: object }[]>}
+ */
+async function helpersFor(service) {
+  const now    = Date.now();
+  const unseen = [];
+  for (const h of _helpers.values()) {
+    if (!h.checkedAt) unseen.push(probe(h));
+    else if (now - h.checkedAt > CAPS_TTL_MS) probe(h);   // answer this request from the cache
+  }
+  if (unseen.length) await Promise.all(unseen);
+
+  const out = [];
+  for (const h of _helpers.values()) {
+    if (h.ok && h.compute) out.push({ url: h.url, compute: h.compute });
+  }
+  for (const { device, compute } of deviceHelpers()) {
+    const url = deviceUrl(device, compute.port);
+    if (_helpers.has(url) || now - (_down.get(url) ?? -Infinity) <= CAPS_TTL_MS) continue;
+    _down.delete(url);
+    out.push({ url, compute });
+  }
+  return out
+    .filter(c => c.compute.gpu === 'available' &&
+                 (!Array.isArray(c.compute.services) || c.compute.services.includes(service)))
+    .sort((a, b) => load(a) - load(b) || bySize(a.compute, b.compute));
+}
+
+/** Quote a client-supplied name for a part header the way browsers do (%22, %0D, %0A) */
+const headerParam = s => String(s).replace(/["\r\n]/g, c => encodeURIComponent(c));
+
+/** type/subtype tokens only; anything else is sent as image/jpeg */
+const MIME_TYPE = /^[\w!#$&^.+-]+\/[\w!#$&^.+-]+$/;
+
+/**
+ * Multipart body for a forwarded upload: the request's text fields, then the
+ * file. body() returns a new stream over the same buffers for every attempt.
+ * Field names, the filename and the mimetype come from the client, so they
+ * are escaped or replaced before going into part headers.
+ *
+ * @param {object|Buffer} file  multer file ({ buffer, mimetype, originalname }) or raw bytes
+ * @param {object} [fields]
+ */
+function multipart(file, fields = {}) {
+  const buffer   = Buffer.isBuffer(file) ? file : file.buffer;
+  const boundary = `----JumpNetDelegate${randomUUID()}`;
+  const CRLF     = '\r\n';
+  const mimetype = MIME_TYPE.test(file.mimetype ?? '') ? file.mimetype : 'image/jpeg';
+  let head = '';
+  for (const [name, value] of Object.entries(fields ?? {})) {
+    if (typeof value !== 'string') continue;
+    head += `--${boundary}${CRLF}Content-Disposition: form-data; name="${headerParam(name)}"${CRLF}${CRLF}${value}${CRLF}`;
+  }
+  head += `--${boundary}${CRLF}` +
+    `Content-Disposition: form-data; name="image"; filename="${headerParam(file.originalname ?? 'image.jpg')}"${CRLF}` +
+    `Content-Type: ${mimetype}${CRLF}${CRLF}`;
+  const bHead = Buffer.from(head);
+  const bTail = Buffer.from(`${CRLF}--${boundary}--${CRLF}`);
+
+  return {
+    contentType: `multipart/form-data; boundary=${boundary}`,
+    body: () => new ReadableStream({
+      start(c) {
+        c.enqueue(bHead);
+        c.enqueue(buffer);
+        c.enqueue(bTail);
+        c.close();
+      },
+    }),
+  };
+}
+
+/** Order in which feature arrays are concatenated into a model input */
+export const FEATURE_ORDER = ['mean', 'std', 'rms', 'fft', 'first', 'delta'];
+
+/**
+ * Flatten a cep_features.h document into one input vector: FEATURE_ORDER,
+ * channel by channel within each array.
+ *
+ * @param {object} features
+ * @returns {number[]}
+ */
+export function flattenFeatures(features) {
+  const out = [];
+  for (const k of FEATURE_ORDER) {
+    for (const v of features?.[k] ?? []) {
+      if (Array.isArray(v)) out.push(...v);
+      else out.push(v);
+    }
+  }
+  return out;
+}
+
+/** Softmax probability of the chosen class from int8 scores and their scale */
+function deviceConfidence(r) {
+  if (!Array.isArray(r.scores) || !r.scores.length) return null;
+  const scale = (r.score_scale_milli ?? 1000) / 1000;
+  const max   = Math.max(...r.scores);
+  const exps  = r.scores.map(s => Math.exp((s - max) * scale));
+  const total = exps.reduce((a, b) => a + b, 0);
+  return exps[r.class] !== undefined ? exps[r.class] / total : null;
+}
+
+/**
+ * Run a feature-vector /infer request on a microcontroller in
+ * TRUSTED_DEVICE_NETS that serves the requested bundleId. Spreads concurrent requests across matching devices:
+ * advertised ops_per_sec shared among the requests already in flight there,
+ * then mhz and ram_kb; falls through to the next device on failure.
+ *
+ * @param {object} body  — { features, bundleId }
+ * @returns {Promise<object|null>}  /infer-shaped result, or null to run elsewhere
+ */
+export async function tryDeviceInfer(body) {
+  if (!DEVICE_INFER || !TRUSTED_NETS.length || !body?.features || !body.bundleId) return null;
+  const input = flattenFeatures(body.features);
+
+  const rate = c => (c.inference.ops_per_sec ?? 0) / (1 + (_inflight.get(c.device.device.id) ?? 0));
+  const devices = findInferenceDevices(body.bundleId, input.length)
+    .filter(c => trusted(c.device))
+    .sort((a, b) => rate(b) - rate(a) || bySize(a.compute, b.compute));
+
+  for (const { device, inference } of devices) {
+    try {
+      return await busy(device.device.id, async () => {
+        const r = await fetch(`${deviceUrl(device, inference.port)}/infer`, {
+          method:  'POST',
+          headers: { 'Content-Type': 'application/json' },
+          body:    JSON.stringify({ input }),
+          signal:  AbortSignal.timeout(DEVICE_TIMEOUT_MS),
+        });
+        if (!r.ok) throw new Error(`status ${r.status}`);
+        const result = await r.json();
+        return {
+          bundleId:        result.bundleId ?? body.bundleId,
+          output:          result.output,
+          confidenceScore: deviceConfidence(result),
+          elapsedMs:       (result.elapsedUs ?? 0) / 1000,
+          _delegatedTo:    device.device.id,
+        };
+      });
+    } catch (err) {
+      console.warn(`[delegate] Device ${device.device.id} could not run ${body.bundleId}: ${err.message}`);
+    }
+  }
+  return null;
+}
 
 /**
  * Attempt to delegate a route to a GPU helper node.
  *
  * @param {string} route    e.g. '/train'  or  '/infer'
  * @param {object} body     original request body (may be undefined for GET)
- * @param {Buffer|null} [fileBuffer]  raw upload buffer for multipart routes
+ * @param {object|Buffer|null} [file]  multer upload (or its buffer) for multipart routes
  * @returns {Promise<object|null>}   parsed JSON from helper, or null to run locally
  */
-export async function tryDelegate(route, body, fileBuffer = null) {
-  if (!HELPER_URL) return null;
+export async function tryDelegate(route, body, file = null) {
+  if (!HELPER_URLS.length && !deviceHelpers().length) return null;
 
-  try {
-    // ── 1. Check helper capabilities ────────────────────────────────────
-    const capsRes = await fetch(`${HELPER_URL}/capabilities`, {
-      signal: AbortSignal.timeout(TIMEOUT_MS),
-    });
-    if (!capsRes.ok) return null;
-
-    const caps = await capsRes.json();
-    if (caps.compute?.gpu !== 'available') return null;
-
-    // ── 2. Forward the request ───────────────────────────────────────────
-    let forwardRes;
-
-    if (fileBuffer) {
-      // Multipart — rebuild simple multipart body
-      const boundary = `----JumpNetDelegate${Date.now()}`;
-      const CRLF     = '\r\n';
-      const bHead    = Buffer.from(
-        `--${boundary}${CRLF}` +
-        `Content-Disposition: form-data; name="image"; filename="image.jpg"${CRLF}` +
-        `Content-Type: image/jpeg${CRLF}${CRLF}`
-      );
-      const bTail    = Buffer.from(`${CRLF}--${boundary}--${CRLF}`);
-      const payload  = Buffer.concat([bHead, fileBuffer, bTail]);
-
-      forwardRes = await fetch(`${HELPER_URL}${route}`, {
-        method:  'POST',
-        headers: { 'Content-Type': `multipart/form-data; boundary=${boundary}` },
-        body:    payload,
-        signal:  AbortSignal.timeout(120_000),
-      });
-    } else {
-      forwardRes = await fetch(`${HELPER_URL}${route}`, {
-        method:  'POST',
-        headers: { 'Content-Type': 'application/json' },
-        body:    JSON.stringify(body ?? {}),
-        signal:  AbortSignal.timeout(120_000),
-      });
-    }
+  const helpers = await helpersFor(route.replace(/^\//, ''));
+  const upload  = file ? multipart(file, body) : null;
 
-    if (!forwardRes.ok) {
-      const text = await forwardRes.text();
-      throw new Error(`Helper ${route} returned ${forwardRes.status}: ${text}`);
+  for (const { url } of helpers) {
+    try {
+      const result = await busy(url, async () => {
+        const r = await fetch(`${url}${route}`, {
+          method:  'POST',
+          headers: {
+            'Content-Type':     upload ? upload.contentType : 'application/json',
+            [DELEGATED_HEADER]: '1',
+          },
+          body:    upload ? upload.body() : JSON.stringify(body ?? {}),
+          duplex:  'half',
+          signal:  AbortSignal.timeout(FORWARD_TIMEOUT_MS),
+        });
+        if (r.status >= 400 && r.status < 500) {
+          // The request itself was refused; another helper won't take it either
+          console.warn(`[delegate] ${url}${route} returned ${r.status}: ${await r.text()}`);
+          return null;
+        }
+        if (!r.ok) throw new Error(`status ${r.status}: ${await r.text()}`);
+        return r.json();
+      });
+      return result && { ...result, _delegatedTo: url };
+    } catch (err) {
+      // Try the next helper; local execution when none is left
+      console.warn(`[delegate] Could not reach ${url}${route}: ${err.message}`);
+      markDown(url);
     }
-
-    const result = await forwardRes.json();
-    return { ...result, _delegatedTo: HELPER_URL };
-  } catch (err) {
-    // Log and fall through to local execution
-    console.warn(`[delegate] Could not reach ${HELPER_URL}${route}: ${err.message}`);
-    return null;
   }
+  return null;
 }
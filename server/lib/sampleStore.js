@@ -0,0 +1,127 @@
+/**
+ * server/lib/sampleStore.js
+ *
+ * In-memory store for live sensor samples uploaded by CEP devices
+ * (POST /devices/:id/samples, written by cep_sampling.h cepWriteBatch()).
+ *
+ * Each sensor (device + bus_id + address) keeps the most recent
+ * SAMPLE_HISTORY rows in a fixed-size ring, so a fast sensor cannot grow the
+ * heap without bound. A device keeps at most SAMPLE_SENSORS_MAX (32)
+ * sensors; a batch that would add more is rejected. Rows are
+ * [t_us, v0, v1, ...] with t_us on the device's micros() clock; each batch
+ * also records the server time it arrived.
+ */
+
+const HISTORY     = parseInt(process.env.SAMPLE_HISTORY ?? '4096');
+const SENSORS_MAX = parseInt(process.env.SAMPLE_SENSORS_MAX ?? '32');
+
+const sensorKey = s => `${s.bus_id ?? 0}/${s.address ?? s.chipset}`;
+
+class SampleRing {
+  constructor(capacity) {
+    this.rows  = new Array(capacity);
+    this.start = 0;
+    this.size  = 0;
+  }
+
+  push(row) {
+    const cap = this.rows.length;
+    this.rows[(this.start + this.size) % cap] = row;
+    if (this.size < cap) this.size++;
+    else this.start = (this.start + 1) % cap;
+  }
+
+  /** Up to n most recent rows, oldest first */
+  latest(n) {
+    const count = Math.min(n, this.size);
+    const out   = new Array(count);
+    const cap   = this.rows.length;
+    for (let i = 0; i < count; i++) {
+      out[i] = this.rows[(this.start + this.size - count + i) % cap];
+    }
+    return out;
+  }
+}
+
+/** @type {Map<string, Map<string, object>>} device id → sensor key → sensor */
+const _samples = new Map();
+
+/**
+ * Store one uploaded batch.
+ *
+ * @param {string} id     — device id
+ * @param {object} batch  — { sensors: [{ chipset, bus_id, address, channels, t0_us, samples }] }
+ * @returns {{ sensors: number, samples: number }}
+ * @throws {Error} if the batch is malformed or has too many sensors (nothing is stored then)
+ */
+export function addSamples(id, batch) {
+  if (!Array.isArray(batch?.sensors)) throw new Error('Batch must include a sensors array');
+
+  // Validate everything first so a bad batch is rejected as a whole
+  for (const s of batch.sensors) {
+    if (!Array.isArray(s?.channels) || !Array.isArray(s?.samples)) {
+      throw new Error('Each sensor needs channels and samples arrays');
+    }
+    if (s.samples.length && !Number.isFinite(s.t0_us)) {
+      throw new Error('Each sensor with samples needs t0_us');
+    }
+    for (const row of s.samples) {
+      if (!Array.isArray(row) || row.length !== s.channels.length + 1 ||
+          !row.every(Number.isFinite)) {
+        throw new Error('Sample rows must be [dt_us, one number per channel]');
+      }
+    }
+  }
+
+  const sensors = _samples.get(id) ?? new Map();
+  const added   = new Set(batch.sensors.map(sensorKey).filter(k => !sensors.has(k)));
+  if (sensors.size + added.size > SENSORS_MAX) {
+    throw new Error(`A device can have at most ${SENSORS_MAX} sensors`);
+  }
+  _samples.set(id, sensors);
+
+  const receivedAt = new Date().toISOString();
+  let total = 0;
+  for (const s of batch.sensors) {
+    const key = sensorKey(s);
+    let entry = sensors.get(key);
+    if (!entry || entry.channels.join() !== s.channels.join()) {
+      entry = { chipset: s.chipset ?? null, bus_id: s.bus_id ?? 0, address: s.address ?? null,
+                channels: s.channels, received: 0, ring: new SampleRing(HISTORY) };
+      sensors.set(key, entry);
+    }
+    for (const [dt, ...values] of s.samples) {
+      entry.ring.push([s.t0_us + dt, ...values]);
+    }
+    entry.received  += s.samples.length;
+    entry.receivedAt = receivedAt;
+    total += s.samples.length;
+  }
+  return { sensors: batch.sensors.length, samples: total };
+}
+
+/**
+ * Recent samples for a device.
+ *
+ * @param {string} id
+ * @param {number} [limit]  — rows per sensor
+ * @returns {object[]}      — one entry per sensor, rows oldest first
+ */
+export function getSamples(id, limit = 100) {
+  const sensors = _samples.get(id);
+  if (!sensors) return [];
+  return [...sensors.values()].map(e => ({
+    chipset:    e.chipset,
+    bus_id:     e.bus_id,
+    address:    e.address,
+    channels:   ['t_us', ...e.channels],
+    received:   e.received,
+    receivedAt: e.receivedAt,
+    samples:    e.ring.latest(limit),
+  }));
+}
+
+/** Drop all samples of a device (e.g. when it is removed). */
+export function clearSamples(id) {
+  return _samples.delete(id);
+}
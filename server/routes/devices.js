@@ -4,41 +4,88 @@
  * REST API for CEP device registration and discovery.
  *
  * POST  /devices/register         — device submits its CEP document
- * GET   /devices                  — list all registered devices
+ *                                   (application/json or application/cbor;
+ *                                   optional X-CEP-Hash header or trailer:
+ *                                   cep.h lastHash())
+ * POST  /devices/register/batch   — many documents in one request (gateways):
+ *                                   JSON array, or NDJSON streamed line by line
+ * POST  /devices/heartbeat        — { id, hash }: 200 unchanged, 404/409 send full
+ * PATCH /devices/:id              — { base, hash, ops } JSON Patch delta
+ *                                   (cep.h writeDelta()); 404/409 send full
+ * POST  /devices/:id/samples      — batched sensor samples (cep_sampling.h)
+ * GET   /devices/:id/samples      — recent samples per sensor (?limit=100)
+ * GET   /devices                  — list all registered devices, plus
+ *                                   registry limits and counters
+ * GET   /devices/events           — Server-Sent Events: add / update / remove
+ *                                   as they happen (?type=, ?provides= filter)
  * GET   /devices/:id              — get full CEP document for one device
  * DELETE /devices/:id             — remove a device
  * GET   /devices/query/capability/:type    — filter by capability type
  * GET   /devices/query/provides/:measure   — filter by sensor measurement
  */
 
-import { Router }         from 'express';
+import express, { Router } from 'express';
 import {
+  decodeCepCbor,
   registerDevice,
+  heartbeat,
+  patchDevice,
   listDevices,
   getDevice,
   removeDevice,
   findByProvides,
   summary,
+  registryStats,
+  onDeviceEvicted,
+  onRegistryChange,
 } from '../lib/cepRegistry.js';
+import { addSamples, getSamples, clearSamples } from '../lib/sampleStore.js';
 
 const router = Router();
 
+// Expired / evicted devices take their samples with them
+onDeviceEvicted(id => clearSamples(id));
+
+// CBOR bodies from constrained transports (cep.h CEP_FORMAT_CBOR)
+const cborBody = express.raw({ type: 'application/cbor', limit: '256kb' });
+
+// JSON or CBOR body → plain object; sends 400 and returns null on bad CBOR
+function readBody(req, res) {
+  if (!Buffer.isBuffer(req.body)) return req.body;
+  try {
+    return decodeCepCbor(req.body);
+  } catch (err) {
+    res.status(400).json({ error: `Invalid CBOR: ${err.message}` });
+    return null;
+  }
+}
+
+// Why doc cannot be registered, or null
+function invalidDoc(doc) {
+  if (!doc?.device?.id) return 'CEP document must include device.id';
+  if (!Array.isArray(doc.capabilities)) return 'CEP document must include capabilities array';
+  return null;
+}
+
+const clientIp = req => req.headers['x-forwarded-for']?.split(',')[0]?.trim()
+                     ?? req.socket.remoteAddress;
+
+// Where the request really came from; the only address delegation connects to
+const socketIp = req => req.socket.remoteAddress;
+
 // ── POST /devices/register ───────────────────────────────────────────────────
 
-router.post('/register', (req, res, next) => {
+router.post('/register', cborBody, (req, res, next) => {
   try {
-    const doc = req.body;
+    const doc = readBody(req, res);
+    if (doc === null) return;
 
-    if (!doc?.device?.id) {
-      return res.status(400).json({ error: 'CEP document must include device.id' });
-    }
-    if (!Array.isArray(doc.capabilities)) {
-      return res.status(400).json({ error: 'CEP document must include capabilities array' });
-    }
+    const invalid = invalidDoc(doc);
+    if (invalid) return res.status(400).json({ error: invalid });
 
-    const ip    = req.headers['x-forwarded-for']?.split(',')[0]?.trim()
-               ?? req.socket.remoteAddress;
-    const entry = registerDevice(doc, ip);
+    // Chunked uploads (cep_registrar.h) send the hash as a trailer
+    const hash  = req.headers['x-cep-hash'] ?? req.trailers?.['x-cep-hash'];
+    const entry = registerDevice(doc, clientIp(req), hash, socketIp(req));
 
     console.log(`[CEP] Registered: ${doc.device.id}  (${doc.device.model ?? doc.device.class})`);
 
@@ -52,10 +99,195 @@ router.post('/register', (req, res, next) => {
   }
 });
 
+// ── POST /devices/register/batch ─────────────────────────────────────────────
+// A gateway registers every board behind it at once. Each item is a CEP
+// document, or { hash, document } to pass the board's lastHash() along.
+// Content-Type application/json: an array of items. application/x-ndjson:
+// one item per line, applied as lines arrive, so a large boot-time batch is
+// never buffered whole. Bad items are reported and skipped; the rest apply.
+// The boards are not reachable at the gateway's address, so they get no
+// socket address and are never delegated to.
+
+const NDJSON_LINE_LIMIT = 256 * 1024;
+
+function registerItem(item, index, ip, result) {
+  const doc     = item?.document ?? item;
+  const invalid = invalidDoc(doc);
+  if (invalid) {
+    result.errors.push({ index, id: doc?.device?.id ?? null, error: invalid });
+    return;
+  }
+  registerDevice(doc, ip, item?.document ? item.hash : null);
+  result.registered++;
+}
+
+// Feed each complete NDJSON line to onLine; resolves once the body ends
+function readNdjson(req, onLine) {
+  return new Promise((resolve, reject) => {
+    let pending = '';
+    let line    = 0;
+    let settled = false;   // rejected: nothing more is registered or reported
+    const feed  = text => {
+      if (settled) return;
+      if (text.trim()) onLine(text, line);
+      line++;
+    };
+    req.setEncoding('utf8');
+    req.on('data', chunk => {
+      pending += chunk;
+      let nl;
+      while ((nl = pending.indexOf('\n')) >= 0) {
+        feed(pending.slice(0, nl));
+        pending = pending.slice(nl + 1);
+      }
+      if (pending.length > NDJSON_LINE_LIMIT) {
+        settled = true;
+        req.removeAllListeners('data');
+        req.resume();   // discard the rest, keep the socket for the reply
+        reject(Object.assign(new Error(`NDJSON line ${line} exceeds ${NDJSON_LINE_LIMIT} bytes`),
+                             { status: 413 }));
+      }
+    });
+    req.on('end', () => {
+      if (settled) return;
+      feed(pending);
+      resolve();
+    });
+    req.on('error', reject);
+  });
+}
+
+router.post('/register/batch', async (req, res, next) => {
+  const ip     = clientIp(req);
+  const result = { status: 'registered', registered: 0, errors: [] };
+  try {
+    if (/^application\/x-ndjson\b/.test(req.headers['content-type'] ?? '')) {
+      await readNdjson(req, (text, index) => {
+        let item;
+        try {
+          item = JSON.parse(text);
+        } catch (err) {
+          result.errors.push({ index, id: null, error: `Invalid JSON: ${err.message}` });
+          return;
+        }
+        registerItem(item, index, ip, result);
+      });
+    } else if (Array.isArray(req.body)) {
+      req.body.forEach((item, index) => registerItem(item, index, ip, result));
+    } else {
+      return res.status(400).json({ error: 'Batch must be a JSON array or NDJSON' });
+    }
+  } catch (err) {
+    if (err.status) {
+      return res.status(err.status).json({ error: err.message, registered: result.registered,
+                                           errors: result.errors });
+    }
+    return next(err);
+  }
+
+  console.log(`[CEP] Registered batch: ${result.registered} devices from ${ip}` +
+              (result.errors.length ? `, ${result.errors.length} rejected` : ''));
+  res.status(result.errors.length && !result.registered ? 400 : 201).json(result);
+});
+
+// ── POST /devices/heartbeat ──────────────────────────────────────────────────
+// Cheap keep-alive: the device sends only its id and content hash. Any
+// non-200 answer means "POST the full document to /devices/register".
+
+router.post('/heartbeat', (req, res) => {
+  const { id, hash } = req.body ?? {};
+  if (!id || !hash) {
+    return res.status(400).json({ error: 'Heartbeat must include id and hash' });
+  }
+  switch (heartbeat(id, hash, clientIp(req), socketIp(req))) {
+    case 'unknown':
+      return res.status(404).json({ status: 'send_full', id });
+    case 'changed':
+      return res.status(409).json({ status: 'send_full', id });
+    default:
+      return res.json({ status: 'unchanged', id });
+  }
+});
+
 // ── GET /devices ─────────────────────────────────────────────────────────────
 
 router.get('/', (_req, res) => {
-  res.json(summary());
+  res.json({ ...summary(), registry: registryStats() });
+});
+
+// ── GET /devices/events ──────────────────────────────────────────────────────
+// Change stream for dashboards and orchestrators, instead of polling the
+// routes above. A new subscriber first gets one "snapshot" event (the
+// GET /devices body), then one event per change, named after change.event:
+//   event: add | update    data: { id, hash, device: <summary row> }
+//   event: update          data: { id, hash, base, ops, device }  (a PATCH delta)
+//   event: remove          data: { id, reason }
+// Every event carries an id; a client reconnecting with Last-Event-ID (or
+// ?since=) is replayed what it missed instead of a new snapshot, as long as
+// that is still within the last EVENT_HISTORY events. ?type= and ?provides=
+// narrow add/update events to matching devices, like the query routes;
+// removes always go through.
+
+const EVENT_HISTORY = 256;
+const PING_MS       = 20_000;   // comment line that keeps proxies from closing idle streams
+
+const _history     = [];                  // last EVENT_HISTORY { seq, name, data }
+const _subscribers = new Set();
+let   _seq         = 0;
+let   _ping        = null;
+
+function matches(sub, change) {
+  if (change.event === 'remove' || (!sub.type && !sub.provides)) return true;
+  const caps = getDevice(change.id)?.capabilities ?? [];
+  return (!sub.type     || caps.some(c => c.type === sub.type)) &&
+         (!sub.provides || caps.some(c => Array.isArray(c.provides) && c.provides.includes(sub.provides)));
+}
+
+function sendEvent(res, seq, name, data) {
+  res.write(`id: ${seq}\nevent: ${name}\ndata: ${data}\n\n`);
+}
+
+onRegistryChange(change => {
+  const ev = { seq: ++_seq, name: change.event, change, data: JSON.stringify(change) };
+  _history.push(ev);
+  if (_history.length > EVENT_HISTORY) _history.shift();
+  for (const sub of _subscribers) {
+    if (matches(sub, change)) sendEvent(sub.res, ev.seq, ev.name, ev.data);
+  }
+});
+
+router.get('/events', (req, res) => {
+  const sub = { res, type: req.query.type ?? null, provides: req.query.provides ?? null };
+  res.writeHead(200, {
+    'Content-Type':      'text/event-stream',
+    'Cache-Control':     'no-cache',
+    'Connection':        'keep-alive',
+    'X-Accel-Buffering': 'no',
+  });
+
+  const since  = parseInt(req.headers['last-event-id'] ?? req.query.since ?? '');
+  const oldest = _history.length ? _history[0].seq : _seq + 1;
+  if (Number.isInteger(since) && since >= oldest - 1 && since <= _seq) {
+    for (const ev of _history) {
+      if (ev.seq > since && matches(sub, ev.change)) sendEvent(res, ev.seq, ev.name, ev.data);
+    }
+  } else {
+    const snap = summary();
+    const rows = snap.devices.filter(d => matches(sub, { event: 'add', id: d.id }));
+    sendEvent(res, _seq, 'snapshot', JSON.stringify({ ...snap, count: rows.length, devices: rows }));
+  }
+
+  _subscribers.add(sub);
+  _ping ??= setInterval(() => {
+    for (const s of _subscribers) s.res.write(': ping\n\n');
+  }, PING_MS).unref();
+  req.on('close', () => {
+    _subscribers.delete(sub);
+    if (_subscribers.size === 0 && _ping) {
+      clearInterval(_ping);
+      _ping = null;
+    }
+  });
 });
 
 // ── GET /devices/query/capability/:type ───────────────────────────────────────
@@ -83,10 +315,66 @@ router.get('/:id', (req, res) => {
   res.json(device);
 });
 
+// ── PATCH /devices/:id ────────────────────────────────────────────────────────
+// Delta against the document the device last sent (patch.base must equal the
+// stored hash). 404/409 mean "send the full document" as for heartbeats.
+
+router.patch('/:id', cborBody, (req, res) => {
+  const patch = readBody(req, res);
+  if (patch === null) return;
+  if (!patch?.base || !patch?.hash) {
+    return res.status(400).json({ error: 'Patch must include base and hash' });
+  }
+
+  let result;
+  try {
+    result = patchDevice(req.params.id, patch, clientIp(req), socketIp(req));
+  } catch (err) {
+    return res.status(400).json({ error: `Invalid patch: ${err.message}` });
+  }
+
+  if (result.status === 'unknown') {
+    return res.status(404).json({ status: 'send_full', id: req.params.id });
+  }
+  if (result.status === 'changed') {
+    return res.status(409).json({ status: 'send_full', id: req.params.id });
+  }
+  console.log(`[CEP] Patched: ${req.params.id}  (${patch.ops.length} op(s))`);
+  res.json({ status: 'patched', id: req.params.id, hash: result.entry._hash });
+});
+
+// ── POST /devices/:id/samples ────────────────────────────────────────────────
+
+router.post('/:id/samples', cborBody, (req, res) => {
+  if (!getDevice(req.params.id)) {
+    return res.status(404).json({ error: `Device '${req.params.id}' not found` });
+  }
+  const batch = readBody(req, res);
+  if (batch === null) return;
+
+  try {
+    const stored = addSamples(req.params.id, batch);
+    res.status(202).json({ status: 'accepted', id: req.params.id, ...stored });
+  } catch (err) {
+    res.status(400).json({ error: `Invalid batch: ${err.message}` });
+  }
+});
+
+// ── GET /devices/:id/samples ─────────────────────────────────────────────────
+
+router.get('/:id/samples', (req, res) => {
+  if (!getDevice(req.params.id)) {
+    return res.status(404).json({ error: `Device '${req.params.id}' not found` });
+  }
+  const limit = Math.max(1, parseInt(req.query.limit ?? '100') || 100);
+  res.json({ id: req.params.id, sensors: getSamples(req.params.id, limit) });
+});
+
 // ── DELETE /devices/:id ───────────────────────────────────────────────────────
 
 router.delete('/:id', (req, res) => {
   const removed = removeDevice(req.params.id);
+  clearSamples(req.params.id);
   if (!removed) {
     return res.status(404).json({ error: `Device '${req.params.id}' not found` });
   }
@@ -7,30 +7,114 @@
  *   - multipart/form-data  with field "image" (image file) + optional "bundleId"
  *   - JSON { image: "<base64>", bundleId?: string }
  *   - JSON { imageId: "<dataset>/<label>/<filename>", bundleId?: string }
+ *   - JSON { features: {...}, bundleId?: string }   feature vector computed on
+ *     a device by cep_features.h (clients/arduino), also as application/cbor
+ *     (CEP_FORMAT_CBOR, keys as in lib/cepRegistry.js); answered by a registered
+ *     device running that bundleId on board when there is one in
+ *     TRUSTED_DEVICE_NETS (see lib/delegate.js)
  *
- * Converts the image to base64 and proxies to JumpSmartsRuntime (port 7312).
+ * Converts the image to base64 (feature vectors pass through unchanged) and
+ * proxies to JumpSmartsRuntime (port 7312).
  *
- * Optional: if GPU_HELPER_URL is set and that node advertises a GPU,
- * the request is delegated there first.
+ * Optional: when a GPU helper is known (GPU_HELPER_URL, or a registered
+ * node advertising compute.gpu), the request is delegated there first.
  */
-import { Router }   from 'express';
+import express, { Router } from 'express';
 import multer       from 'multer';
 import { readFile } from 'node:fs/promises';
 import { UPSTREAM } from '../server.js';
 import { getImagePath } from '../localDatastore.js';
-import { tryDelegate }  from '../lib/delegate.js';
+import { tryDelegate, tryDeviceInfer, DELEGATED_HEADER } from '../lib/delegate.js';
+import { decodeCepCbor } from '../lib/cepRegistry.js';
 
 const router = Router();
+
+const FEATURE_VECTORS = ['mean', 'std', 'rms', 'first'];   // one number per channel
+const FEATURE_MATRICES = ['fft', 'delta'];                 // one array per channel
+
+/**
+ * Check a cep_features.h feature document.
+ * @returns {string|null} error message, or null if it is usable
+ */
+function featuresError(f) {
+  if (!f || typeof f !== 'object' || Array.isArray(f)) return 'features must be an object';
+  if (!Array.isArray(f.channels) || f.channels.length === 0) {
+    return 'features.channels must be a non-empty array';
+  }
+  const n = f.channels.length;
+  let found = 0;
+  for (const k of FEATURE_VECTORS) {
+    if (f[k] === undefined) continue;
+    if (!Array.isArray(f[k]) || f[k].length !== n || !f[k].every(Number.isFinite)) {
+      return `features.${k} must hold one number per channel`;
+    }
+    found++;
+  }
+  for (const k of FEATURE_MATRICES) {
+    if (f[k] === undefined) continue;
+    if (!Array.isArray(f[k]) || f[k].length !== n ||
+        !f[k].every(row => Array.isArray(row) && row.every(Number.isFinite))) {
+      return `features.${k} must hold one array of numbers per channel`;
+    }
+    found++;
+  }
+  return found ? null : `features needs at least one of ${[...FEATURE_VECTORS, ...FEATURE_MATRICES].join(', ')}`;
+}
+
+/** POST body to JumpSmartsRuntime /infer and relay its answer */
+async function proxyInfer(res, body) {
+  const r = await fetch(`${UPSTREAM}/infer`, {
+    method:  'POST',
+    headers: { 'Content-Type': 'application/json' },
+    body:    JSON.stringify(body),
+    signal:  AbortSignal.timeout(60_000),
+  });
+
+  let data;
+  try {
+    data = await r.json();
+  } catch {
+    const text = await r.text();
+    data = { error: text || 'Upstream returned a non-JSON response' };
+  }
+  res.status(r.status).json(data);
+}
+
+// CBOR feature documents from constrained transports (cep_features.h CEP_FORMAT_CBOR)
+const cborBody = express.raw({ type: 'application/cbor', limit: '256kb' });
+
 const upload = multer({ storage: multer.memoryStorage(), limits: { fileSize: 20 * 1024 * 1024 } });
 
-router.post('/', upload.single('image'), async (req, res, next) => {
+router.post('/', cborBody, upload.single('image'), async (req, res, next) => {
   try {
+    if (Buffer.isBuffer(req.body)) {
+      try {
+        req.body = decodeCepCbor(req.body);
+      } catch (err) {
+        return res.status(400).json({ error: `Invalid CBOR: ${err.message}` });
+      }
+    }
+
+    // A malformed feature vector is refused here, not sent to every helper
+    const features = req.body?.features !== undefined;
+    if (features) {
+      const error = featuresError(req.body.features);
+      if (error) return res.status(400).json({ error });
+    }
+
     // ── Optional delegation ───────────────────────────────────────────────
-    if (process.env.GPU_HELPER_URL) {
-      const delegated = await tryDelegate('/infer', req.body, req.file?.buffer ?? null);
+    if (!req.headers[DELEGATED_HEADER]) {
+      const delegated = await tryDelegate('/infer', req.body, req.file ?? null);
       if (delegated !== null) return res.json(delegated);
     }
 
+    // ── Device feature vector: no image to resolve ────────────────────────
+    if (features) {
+      const local = await tryDeviceInfer(req.body);   // a device serving this bundleId
+      if (local !== null) return res.json(local);
+      return await proxyInfer(res, { features: req.body.features, bundleId: req.body.bundleId ?? 'current' });
+    }
+
     // ── Resolve image → base64 ────────────────────────────────────────────
     let imageBase64 = null;
 
@@ -51,26 +135,12 @@ router.post('/', upload.single('image'), async (req, res, next) => {
       imageBase64 = req.body.image.split(',').at(-1);
     } else {
       return res.status(400).json({
-        error: 'Provide multipart "image", JSON { image: "<base64>" }, or JSON { imageId: "dataset/label/file" }',
+        error: 'Provide multipart "image", JSON { image: "<base64>" }, JSON { imageId: "dataset/label/file" }, or JSON { features: {...} }',
       });
     }
 
     // ── Proxy to JumpSmartsRuntime ────────────────────────────────────────
-    const r = await fetch(`${UPSTREAM}/infer`, {
-      method:  'POST',
-      headers: { 'Content-Type': 'application/json' },
-      body:    JSON.stringify({ imageBase64, bundleId: req.body?.bundleId ?? 'current' }),
-      signal:  AbortSignal.timeout(60_000),
-    });
-
-    let data;
-    try {
-      data = await r.json();
-    } catch {
-      const text = await r.text();
-      data = { error: text || 'Upstream returned a non-JSON response' };
-    }
-    res.status(r.status).json(data);
+    await proxyInfer(res, { imageBase64, bundleId: req.body?.bundleId ?? 'current' });
   } catch (err) {
     next(err);
   }
@@ -7,17 +7,79 @@
  * {
  *   "jumpnet":   { "status": "ok", "uptime": 123.4 },
  *   "upstream":  { "status": "ok" | "unreachable", "url": "http://..." },
+ *   "fleet":     { "devices": 12, "reporting": 9, "totals": {...}, "metrics": {...} },
  *   "timestamp": "2026-02-21T12:00:00.000Z"
  * }
+ *
+ * fleet aggregates the "telemetry" capability (cep.h counters) of every
+ * registered device that publishes one: totals of the counters, and for
+ * each metric its min / mean / max and the device at the bad end ("worst"),
+ * to point at slow buses, fragmented heaps and flaky links.
  */
 import { Router } from 'express';
 import { UPSTREAM } from '../server.js';
 import { scanJumpapps } from '../localDatastore.js';
+import { listDevices } from '../lib/cepRegistry.js';
 
 export const router = Router();
 
 const startedAt = Date.now();
 
+/** Telemetry counters summed across the fleet */
+const TOTALS  = ['scans', 'i2c_probes', 'i2c_nacks', 'builds', 'bytes_out', 'reg_ok', 'reg_failures'];
+
+/** metric → true when higher is worse */
+const METRICS = {
+  scan_us:          true,
+  scan_max_us:      true,
+  build_us:         true,
+  build_max_us:     true,
+  heap_peak_b:      true,
+  heap_min_free_b:  false,
+  heap_max_block_b: false,
+  reg_ms:           true,
+  reg_max_ms:       true,
+  reg_failure_rate: true,
+};
+
+/** Per-device metric values: the telemetry fields plus derived ones */
+function telemetryRow(t) {
+  const requests = (t.reg_ok ?? 0) + (t.reg_failures ?? 0);
+  return { ...t, reg_failure_rate: requests ? (t.reg_failures ?? 0) / requests : undefined };
+}
+
+/**
+ * Aggregate the telemetry capability of every registered device.
+ *
+ * @returns {{ devices: number, reporting: number, totals: object, metrics: object }}
+ */
+export function fleetTelemetry() {
+  const rows = [];
+  for (const d of listDevices('telemetry')) {
+    const t = d.capabilities.find(c => c.type === 'telemetry');
+    if (t) rows.push({ id: d.device.id, t: telemetryRow(t) });
+  }
+
+  const totals = {};
+  for (const k of TOTALS) totals[k] = rows.reduce((sum, r) => sum + (r.t[k] ?? 0), 0);
+
+  const metrics = {};
+  for (const [k, higherIsWorse] of Object.entries(METRICS)) {
+    let n = 0, sum = 0, min = Infinity, max = -Infinity, worst = null;
+    for (const { id, t } of rows) {
+      const v = t[k];
+      if (typeof v !== 'number') continue;
+      n++;
+      sum += v;
+      if (v < min) { min = v; if (!higherIsWorse) worst = id; }
+      if (v > max) { max = v; if (higherIsWorse) worst = id; }
+    }
+    if (n) metrics[k] = { min, mean: Math.round(sum / n * 1000) / 1000, max, worst };
+  }
+
+  return { devices: listDevices().length, reporting: rows.length, totals, metrics };
+}
+
 router.get('/', async (_req, res) => {
   let upstreamStatus = 'unreachable';
   let trainAvailable = null;
@@ -37,6 +99,7 @@ router.get('/', async (_req, res) => {
     upstream:       { status: upstreamStatus, url: UPSTREAM },
     trainAvailable: trainAvailable,
     storage:        { jumpapps },
+    fleet:          fleetTelemetry(),
     timestamp:      new Date().toISOString(),
   });
 });
@@ -11,18 +11,19 @@
  * Body (POST /train): { datasetId, bundleId?, epochs?, imageSize?, batchSize? }
  *
  * All requests proxy to JumpSmartsRuntime (port 7312).
- * If GPU_HELPER_URL is set the train-start request is delegated there.
+ * When a GPU helper is known (GPU_HELPER_URL, or a registered node advertising
+ * compute.gpu) the train-start request is delegated there.
  */
 import { Router }      from 'express';
 import { UPSTREAM }    from '../server.js';
-import { tryDelegate } from '../lib/delegate.js';
+import { tryDelegate, DELEGATED_HEADER } from '../lib/delegate.js';
 
 const router = Router();
 
 // ── POST /train  — start a new training job ───────────────────────────────────
 router.post('/', async (req, res, next) => {
   try {
-    if (process.env.GPU_HELPER_URL) {
+    if (!req.headers[DELEGATED_HEADER]) {
       const delegated = await tryDelegate('/train', req.body);
       if (delegated !== null) return res.json(delegated);
     }
@@ -16,6 +16,9 @@ import { router as compileRouter      } from './routes/compile.js';
 // ── Config ────────────────────────────────────────────────────────────────────
 export const UPSTREAM = process.env.JUMPSMARTS_URL ?? 'http://localhost:7312';
 export const PORT     = parseInt(process.env.PORT  ?? '4080');
+// Idle keep-alive window; longer than the CEP heartbeat interval (60 s) so
+// devices reuse one connection instead of reconnecting for every request
+export const KEEPALIVE_MS = parseInt(process.env.KEEPALIVE_MS ?? '75000');
 
 const __dirname = dirname(fileURLToPath(import.meta.url));
 const WEB_DIR   = join(__dirname, '..', 'web');
@@ -57,7 +60,9 @@ app.use((err, _req, res, _next) => {
 });
 
 // ── Start ─────────────────────────────────────────────────────────────────────
-app.listen(PORT, () => {
+const server = app.listen(PORT, () => {
   console.log(`JumpNet server listening on http://localhost:${PORT}`);
   console.log(`Upstream JumpSmarts: ${UPSTREAM}`);
 });
+server.keepAliveTimeout = KEEPALIVE_MS;
+server.headersTimeout   = KEEPALIVE_MS + 1000;   // must exceed keepAliveTimeout